@@ -0,0 +1,271 @@
+// Microbenchmarks of the hot paths: ignore rule compilation and matching,
+// binary classification and the output writer. Built as
+// ProjectCompressorBench when Google Benchmark is installed; run with
+// --benchmark_format=json (or --benchmark_out=FILE) to compare commits.
+
+#include <benchmark/benchmark.h>
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include "compressor.hpp"
+#include "gitignore.hpp"
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// Rule sets modeled on real .gitignore files, from a short one to the kind
+// that collects the GitHub templates of several languages.
+const std::vector<std::string> kSmallRules = {
+    "# Build output",
+    "build/",
+    "*.o",
+    "*.log",
+    "/dist",
+    "node_modules/",
+};
+
+const std::vector<std::string> kTypicalRules = {
+    "# Dependencies",
+    "node_modules/",
+    "vendor/",
+    ".venv/",
+    "__pycache__/",
+    "*.py[cod]",
+    "",
+    "# Build output",
+    "/build/",
+    "/dist/",
+    "out/",
+    "target/",
+    "*.o",
+    "*.obj",
+    "*.a",
+    "*.so",
+    "*.dll",
+    "*.exe",
+    "*.class",
+    "*.jar",
+    "",
+    "# Editors and tools",
+    ".idea/",
+    ".vscode/",
+    "*.swp",
+    "*~",
+    ".DS_Store",
+    "coverage/",
+    "*.log",
+    "npm-debug.log*",
+    ".env",
+    ".env.*",
+    "!.env.example",
+    "",
+    "# Generated sources",
+    "src/**/generated/",
+    "docs/_build/",
+    "*.min.js",
+    "!vendor/keep.txt",
+};
+
+// The typical set plus negations and "**" patterns, the costly cases of the
+// regex translation.
+const std::vector<std::string> kComplexRules = [] {
+    std::vector<std::string> rules = kTypicalRules;
+    for (const char *line : {"**/tmp/**", "**/*.generated.*", "!**/tmp/README.md", "/third_party/**/test/",
+                             "logs/**/*.gz", "!logs/**/keep.gz", "**/cache", "packages/*/lib/", "*.[oa]",
+                             "src/**/*.pb.*"})
+        rules.push_back(line);
+    return rules;
+}();
+
+const std::vector<std::string> &ruleLines(int64_t set) {
+    switch (set) {
+    case 0:
+        return kSmallRules;
+    case 1:
+        return kTypicalRules;
+    default:
+        return kComplexRules;
+    }
+}
+
+std::vector<GitIgnoreRule> compileRules(const std::vector<std::string> &lines) {
+    std::vector<GitIgnoreRule> rules;
+    for (const auto &line : lines) {
+        if (auto rule = parseGitIgnoreLine(line))
+            rules.push_back(std::move(*rule));
+    }
+    return rules;
+}
+
+// Relative paths of a made-up project: sources, tests, dependencies and
+// build output, in a fixed order so runs are comparable.
+std::vector<std::string> samplePaths() {
+    const char *dirs[] = {"src", "src/core", "src/net/generated", "include", "tests", "docs", "node_modules/lodash",
+                          "build/obj", "vendor/lib", "logs/2024", "packages/app/lib", "tools/scripts"};
+    const char *names[] = {"main.cpp", "util.hpp", "index.js", "app.min.js", "model.pb.cc", "README.md",
+                           "module.o", "server.log", "data.generated.json", "setup.py", "config.env", "keep.txt"};
+    std::vector<std::string> paths;
+    uint64_t state = 42;
+    for (int i = 0; i < 512; ++i) {
+        state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+        const char *dir = dirs[(state >> 33) % std::size(dirs)];
+        const char *name = names[(state >> 45) % std::size(names)];
+        paths.push_back(std::string(dir) + "/" + std::to_string(i % 7) + "_" + name);
+    }
+    return paths;
+}
+
+const char *const kRuleSetNames[] = {"small", "typical", "complex"};
+
+void BM_ParseRules(benchmark::State &state) {
+    const auto &lines = ruleLines(state.range(0));
+    for (auto _ : state) {
+        for (const auto &line : lines)
+            benchmark::DoNotOptimize(parseGitIgnoreLine(line));
+    }
+    state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(lines.size()));
+    state.SetLabel(kRuleSetNames[state.range(0)]);
+}
+BENCHMARK(BM_ParseRules)->DenseRange(0, 2);
+
+// The matcher alone: every rule against every path, last match wins.
+void BM_MatchRules(benchmark::State &state) {
+    const auto rules = compileRules(ruleLines(state.range(0)));
+    const auto paths = samplePaths();
+    for (auto _ : state) {
+        for (const auto &path : paths) {
+            bool ignored = false;
+            for (const auto &rule : rules) {
+                if (matchesRule(rule, path, false))
+                    ignored = !rule.negate;
+            }
+            benchmark::DoNotOptimize(ignored);
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(paths.size()));
+    state.SetLabel(kRuleSetNames[state.range(0)]);
+}
+BENCHMARK(BM_MatchRules)->DenseRange(0, 2);
+
+// isIgnored as the traversal calls it, on files that exist, so that the
+// path arithmetic and directory checks it does are included.
+class IgnoreTree : public benchmark::Fixture {
+public:
+    void SetUp(const benchmark::State &) override {
+        root = fs::temp_directory_path() / "ProjectCompressorBench-ignore";
+        std::error_code ec;
+        fs::remove_all(root, ec);
+        for (const auto &path : samplePaths()) {
+            fs::create_directories((root / path).parent_path(), ec);
+            std::ofstream(root / path) << "x\n";
+            files.push_back(root / path);
+        }
+    }
+
+    void TearDown(const benchmark::State &) override {
+        std::error_code ec;
+        fs::remove_all(root, ec);
+        files.clear();
+    }
+
+    fs::path root;
+    std::vector<fs::path> files;
+};
+
+BENCHMARK_DEFINE_F(IgnoreTree, BM_IsIgnored)(benchmark::State &state) {
+    const auto rules = compileRules(ruleLines(state.range(0)));
+    for (auto _ : state) {
+        for (const auto &file : files)
+            benchmark::DoNotOptimize(isIgnored(rules, root, file));
+    }
+    state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(files.size()));
+    state.SetLabel(kRuleSetNames[state.range(0)]);
+}
+BENCHMARK_REGISTER_F(IgnoreTree, BM_IsIgnored)->DenseRange(0, 2);
+
+// Source text, or bytes spread over the whole range like compressed data.
+std::vector<char> sampleBytes(size_t size, bool binary) {
+    const std::string text = "int main(int argc, char *argv[]) {\n\treturn run(argc, argv); // TODO\n}\n";
+    std::vector<char> bytes(size);
+    uint64_t state = 7;
+    for (size_t i = 0; i < size; ++i) {
+        state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+        bytes[i] = binary ? static_cast<char>(state >> 56) : text[i % text.size()];
+    }
+    return bytes;
+}
+
+void BM_ClassifyText(benchmark::State &state) {
+    const auto bytes = sampleBytes(static_cast<size_t>(state.range(0)), false);
+    for (auto _ : state)
+        benchmark::DoNotOptimize(isBinaryBuffer(bytes.data(), bytes.size()));
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_ClassifyText)->RangeMultiplier(8)->Range(64, 1 << 18);
+
+void BM_ClassifyBinary(benchmark::State &state) {
+    const auto bytes = sampleBytes(static_cast<size_t>(state.range(0)), true);
+    for (auto _ : state)
+        benchmark::DoNotOptimize(isBinaryBuffer(bytes.data(), bytes.size()));
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_ClassifyBinary)->RangeMultiplier(8)->Range(64, 1 << 18);
+
+// OutputWriter::write in chunks of the given size, into the null device: a
+// measure of the cost of a call (offset tracking and stdio buffering), not
+// of writing. The null device discards whole buffers for free, so bytes per
+// second would be meaningless; calls per second are reported instead.
+void BM_WriterWrite(benchmark::State &state) {
+    const auto bytes = sampleBytes(static_cast<size_t>(state.range(0)), false);
+#ifdef _WIN32
+    const fs::path sink = "NUL";
+#else
+    const fs::path sink = "/dev/null";
+#endif
+    OutputWriter writer;
+    if (!writer.open(sink)) {
+        state.SkipWithError("cannot open the null device");
+        return;
+    }
+    for (auto _ : state)
+        writer.write(bytes.data(), bytes.size());
+    writer.close();
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_WriterWrite)->RangeMultiplier(16)->Range(16, 1 << 20);
+
+// The same into a real file, reopened every 256 MiB so the disk does not
+// fill up; includes the page cache copy of write(2).
+void BM_WriterFile(benchmark::State &state) {
+    const auto bytes = sampleBytes(static_cast<size_t>(state.range(0)), false);
+    const fs::path path = fs::temp_directory_path() / "ProjectCompressorBench-writer.txt";
+    OutputWriter writer;
+    if (!writer.open(path)) {
+        state.SkipWithError("cannot create the output file");
+        return;
+    }
+    for (auto _ : state) {
+        if (writer.offset() >= (uint64_t(256) << 20)) {
+            state.PauseTiming();
+            writer.close();
+            writer.open(path);
+            state.ResumeTiming();
+        }
+        writer.write(bytes.data(), bytes.size());
+    }
+    writer.close();
+    std::error_code ec;
+    fs::remove(path, ec);
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_WriterFile)->RangeMultiplier(16)->Range(4096, 1 << 20);
+
+} // namespace
+
+BENCHMARK_MAIN();
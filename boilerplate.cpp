@@ -0,0 +1,177 @@
+#include "boilerplate.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+#include <unordered_map>
+
+#include "hash.hpp"
+#include "stats.hpp"
+
+namespace {
+
+const size_t kHeadBytes = 16 * 1024;
+
+enum class LineKind { Comment, Blank, Code };
+
+// Preprocessor directives, which look like '#' comments.
+const char *kDirectives[] = {"include", "define", "undef", "if", "ifdef", "ifndef", "elif", "else",
+                             "endif", "pragma", "error", "warning", "line", "import"};
+
+bool startsWith(const char *begin, const char *end, const char *prefix) {
+    size_t length = std::strlen(prefix);
+    return static_cast<size_t>(end - begin) >= length && std::memcmp(begin, prefix, length) == 0;
+}
+
+bool contains(const char *begin, const char *end, const char *needle) {
+    size_t length = std::strlen(needle);
+    for (const char *p = begin; p + length <= end; ++p) {
+        if (std::memcmp(p, needle, length) == 0)
+            return true;
+    }
+    return false;
+}
+
+bool isDirective(const char *begin, const char *end) {
+    const char *word = begin + 1;
+    while (word < end && (*word == ' ' || *word == '\t'))
+        ++word;
+    const char *wordEnd = word;
+    while (wordEnd < end && std::isalpha(static_cast<unsigned char>(*wordEnd)))
+        ++wordEnd;
+    for (const char *directive : kDirectives) {
+        if (static_cast<size_t>(wordEnd - word) == std::strlen(directive) && std::memcmp(word, directive, wordEnd - word) == 0)
+            return true;
+    }
+    return false;
+}
+
+/**
+ * Classify one line of a file's leading comment block. blockEnd is the
+ * terminator of a multi-line comment the line is inside of, or null.
+ */
+LineKind classifyLine(const char *begin, const char *end, const char *&blockEnd) {
+    while (begin < end && std::isspace(static_cast<unsigned char>(*begin)))
+        ++begin;
+    while (end > begin && std::isspace(static_cast<unsigned char>(end[-1])))
+        --end;
+    if (blockEnd) {
+        if (contains(begin, end, blockEnd))
+            blockEnd = nullptr;
+        return LineKind::Comment;
+    }
+    if (begin == end)
+        return LineKind::Blank;
+    if (startsWith(begin, end, "/*")) {
+        if (!contains(begin + 2, end, "*/"))
+            blockEnd = "*/";
+        return LineKind::Comment;
+    }
+    if (startsWith(begin, end, "<!--")) {
+        if (!contains(begin + 4, end, "-->"))
+            blockEnd = "-->";
+        return LineKind::Comment;
+    }
+    if (startsWith(begin, end, "//") || startsWith(begin, end, "--") || startsWith(begin, end, "*"))
+        return LineKind::Comment;
+    if (*begin == '#')
+        return isDirective(begin, end) ? LineKind::Code : LineKind::Comment;
+    return LineKind::Code;
+}
+
+// A prefix of a file that ends after a comment line.
+struct Candidate {
+    uint64_t hash;
+    uint32_t length;
+};
+
+uint64_t candidateKey(const Candidate &candidate) {
+    return candidate.hash ^ (static_cast<uint64_t>(candidate.length) * 0x9E3779B97F4A7C15ULL);
+}
+
+size_t readHead(const fs::path &path, std::vector<char> &head) {
+    head.resize(kHeadBytes);
+    std::FILE *in = openInput(path);
+    if (!in)
+        return 0;
+    size_t bytesRead = readInput(in, head.data(), head.size());
+    std::fclose(in);
+    return bytesRead;
+}
+
+/**
+ * The prefixes of a file's leading comment block that are long enough to
+ * be worth sharing, shortest first.
+ */
+void findCandidates(const fs::path &path, const char *data, size_t size, size_t minBytes,
+                    std::vector<Candidate> &candidates) {
+    if (isBinaryBuffer(data, std::min<size_t>(size, 512), &path))
+        return;
+    Hasher64 hasher;
+    const char *blockEnd = nullptr;
+    const char *line = data;
+    const char *end = data + size;
+    while (line < end) {
+        const char *newline = static_cast<const char *>(std::memchr(line, '\n', static_cast<size_t>(end - line)));
+        if (!newline)
+            break; // Only whole lines can be shared.
+        LineKind kind = classifyLine(line, newline, blockEnd);
+        if (kind == LineKind::Code)
+            break;
+        hasher.update(line, static_cast<size_t>(newline + 1 - line));
+        line = newline + 1;
+        size_t length = static_cast<size_t>(line - data);
+        if (kind == LineKind::Comment && !blockEnd && length >= minBytes)
+            candidates.push_back({hasher.digest(), static_cast<uint32_t>(length)});
+    }
+}
+
+} // namespace
+
+BoilerplatePlan findBoilerplate(const std::vector<FileEntry> &files, size_t minFiles, size_t minBytes) {
+    BoilerplatePlan plan;
+    plan.blockOf.assign(files.size(), -1);
+
+    std::vector<char> head;
+    std::vector<std::vector<Candidate>> candidates(files.size());
+    std::unordered_map<uint64_t, size_t> counts;
+    for (size_t i = 0; i < files.size(); ++i) {
+        if (files[i].size < minBytes)
+            continue;
+        size_t size = readHead(files[i].path, head);
+        findCandidates(files[i].path, head.data(), size, minBytes, candidates[i]);
+        for (const auto &candidate : candidates[i])
+            counts[candidateKey(candidate)]++;
+    }
+
+    // Each file takes its longest prefix shared by enough files.
+    std::unordered_map<uint64_t, int> blockIds;
+    for (size_t i = 0; i < files.size(); ++i) {
+        for (auto it = candidates[i].rbegin(); it != candidates[i].rend(); ++it) {
+            uint64_t key = candidateKey(*it);
+            if (counts[key] < minFiles)
+                continue;
+            auto block = blockIds.find(key);
+            if (block == blockIds.end()) {
+                // First use: take the text from this file.
+                size_t size = readHead(files[i].path, head);
+                if (size < it->length || hash64(head.data(), it->length) != it->hash)
+                    break; // Changed in the meantime.
+                plan.blocks.push_back({std::string(head.data(), it->length), it->hash});
+                block = blockIds.emplace(key, static_cast<int>(plan.blocks.size() - 1)).first;
+            }
+            plan.blockOf[i] = block->second;
+            break;
+        }
+        std::vector<Candidate>().swap(candidates[i]);
+    }
+    return plan;
+}
+
+std::string boilerplatePreamble(const BoilerplatePlan &plan) {
+    std::string preamble;
+    for (size_t i = 0; i < plan.blocks.size(); ++i)
+        preamble += "# Boilerplate " + std::to_string(i + 1) + "\n\n" + plan.blocks[i].text + "\n\n";
+    return preamble;
+}
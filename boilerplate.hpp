@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "compressor.hpp"
+
+// A leading comment block shared by many files.
+struct BoilerplateBlock {
+    std::string text;         // Including its final newline.
+    uint64_t hash = 0;        // XXH64 of text.
+};
+
+// Which block, if any, each file starts with.
+struct BoilerplatePlan {
+    std::vector<BoilerplateBlock> blocks;  // Numbered from 1 in the output, in order of first use.
+    std::vector<int> blockOf;              // Per file: index into blocks, or -1.
+};
+
+/**
+ * Find the leading comment blocks repeated across files (license headers
+ * and the like). The first 16 KiB of every file are read; the longest
+ * run of leading comment lines whose bytes start at least minFiles files,
+ * and that is at least minBytes long, becomes that file's block. Prefixes
+ * are compared through cumulative XXH64 digests taken after every comment
+ * line, so each file is hashed once whatever the number of candidates.
+ */
+BoilerplatePlan findBoilerplate(const std::vector<FileEntry> &files, size_t minFiles = 3, size_t minBytes = 200);
+
+/**
+ * The preamble that holds every block once, written before the first file.
+ */
+std::string boilerplatePreamble(const BoilerplatePlan &plan);
@@ -0,0 +1,108 @@
+#include "budget.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <numeric>
+
+#include "minify.hpp"
+#include "stats.hpp"
+#include "tokens.hpp"
+
+namespace {
+
+const size_t kReadBufferSize = 1 << 18;
+
+// No text file of note packs more bytes than this into a token.
+const uint64_t kMaxBytesPerToken = 16;
+
+size_t preferenceOf(const FileEntry &file, const std::vector<GitIgnoreRule> &prefer) {
+    for (size_t i = 0; i < prefer.size(); ++i) {
+        if (matchesRule(prefer[i], file.relPath, false))
+            return i;
+    }
+    return prefer.size();
+}
+
+} // namespace
+
+bool estimateSegmentTokens(const FileEntry &file, const CombineOptions &combine, std::vector<char> &buffer,
+                           uint64_t &tokens) {
+    std::FILE *in = openInput(file.path);
+    if (!in)
+        return false;
+    size_t bytesRead = readInput(in, buffer.data(), buffer.size());
+    if (isBinaryBuffer(buffer.data(), std::min<size_t>(bytesRead, 512), &file.path)) {
+        std::fclose(in);
+        return false;
+    }
+    std::string header = "# File: " + file.path.string() + "\n\n\n\n";
+    TokenCounter counter;
+    counter.update(header.data(), header.size());
+    SourceLanguage language = combine.minify || combine.outline ? languageForPath(file.path) : SourceLanguage::None;
+    Minifier minifier(language, combine.outline);
+    std::string minified;
+    while (bytesRead > 0) {
+        if (language != SourceLanguage::None) {
+            minifier.feed(buffer.data(), bytesRead, minified);
+            counter.update(minified.data(), minified.size());
+            minified.clear();
+        } else {
+            counter.update(buffer.data(), bytesRead);
+        }
+        bytesRead = readInput(in, buffer.data(), buffer.size());
+    }
+    std::fclose(in);
+    minifier.finish(minified);
+    counter.update(minified.data(), minified.size());
+    tokens = counter.count();
+    return true;
+}
+
+std::vector<FileEntry> selectWithinBudget(const std::vector<FileEntry> &files,
+                                          const BudgetOptions &options,
+                                          const CombineOptions &combine,
+                                          BudgetSummary &summary)
+{
+    std::vector<size_t> preference(files.size());
+    for (size_t i = 0; i < files.size(); ++i)
+        preference[i] = preferenceOf(files[i], options.prefer);
+    std::vector<size_t> ranking(files.size());
+    std::iota(ranking.begin(), ranking.end(), 0);
+    std::stable_sort(ranking.begin(), ranking.end(), [&](size_t a, size_t b) {
+        if (preference[a] != preference[b])
+            return preference[a] < preference[b];
+        switch (options.order) {
+        case BudgetOrder::Recent: return files[a].mtimeNs > files[b].mtimeNs;
+        case BudgetOrder::Small: return files[a].size < files[b].size;
+        case BudgetOrder::Path: break;
+        }
+        return false; // files is in path order already.
+    });
+
+    const bool sizeBound = !combine.minify && !combine.outline;
+    std::vector<char> buffer(kReadBufferSize);
+    std::vector<bool> selected(files.size(), false);
+    uint64_t room = options.maxTokens;
+    for (size_t index : ranking) {
+        if (room == 0)
+            break;
+        const FileEntry &file = files[index];
+        if (sizeBound && file.size / kMaxBytesPerToken > room)
+            continue;
+        uint64_t tokens = 0;
+        summary.estimated++;
+        if (!estimateSegmentTokens(file, combine, buffer, tokens) || tokens > room)
+            continue;
+        room -= tokens;
+        summary.tokens += tokens;
+        selected[index] = true;
+    }
+
+    std::vector<FileEntry> result;
+    for (size_t i = 0; i < files.size(); ++i) {
+        if (selected[i])
+            result.push_back(files[i]);
+    }
+    summary.selected = result.size();
+    return result;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "compressor.hpp"
+#include "gitignore.hpp"
+
+// Order of files of equal preference when filling a budget.
+enum class BudgetOrder { Path, Recent, Small };
+
+struct BudgetOptions {
+    uint64_t maxTokens = 0;            // 0: no budget.
+    std::vector<GitIgnoreRule> prefer; // Files matching an earlier pattern go first.
+    BudgetOrder order = BudgetOrder::Path;
+};
+
+struct BudgetSummary {
+    size_t selected = 0;
+    size_t estimated = 0;   // Files read to estimate their tokens.
+    uint64_t tokens = 0;    // Estimated tokens of the selected segments.
+};
+
+/**
+ * Estimated tokens of the segment combineFiles would write for file with
+ * combine (minified or outlined, header included). buffer is used for
+ * reading and must not be empty. Returns false for binary and unreadable
+ * files.
+ */
+bool estimateSegmentTokens(const FileEntry &file, const CombineOptions &combine, std::vector<char> &buffer,
+                           uint64_t &tokens);
+
+/**
+ * The files, in their original order, that fit in options.maxTokens
+ * (estimated with TokenCounter). Files are ranked by the first prefer
+ * pattern they match (files matching none come last), then by order: path
+ * order, most recently modified first, or smallest first. Going down the
+ * ranking, each file is taken if its segment still fits; a file that does
+ * not is left out and the next one is tried. Estimates are of the text as
+ * combineFiles would write it with combine (minified or outlined), headers
+ * included, but not of the savings from references.
+ *
+ * A file is only read if it could fit: without minification, its size is
+ * compared with the room left at 16 bytes per token first, so files far
+ * too large are never opened. Binary files are left out.
+ */
+std::vector<FileEntry> selectWithinBudget(const std::vector<FileEntry> &files,
+                                          const BudgetOptions &options,
+                                          const CombineOptions &combine,
+                                          BudgetSummary &summary);
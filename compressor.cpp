@@ -0,0 +1,814 @@
+#include "compressor.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "boilerplate.hpp"
+#include "hash.hpp"
+#include "probes.hpp"
+#include "simhash.hpp"
+#include "stats.hpp"
+
+#ifndef _WIN32
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+const char *kOutputStem = "combined";
+const char *kOutputExtension = ".txt";
+const size_t kCopyBufferSize = 1 << 18;
+
+// Version control metadata directories, skipped by name before anything else.
+std::vector<std::string> prunedNameList = {".git", ".hg", ".svn"};
+SymlinkPolicy currentSymlinkPolicy = SymlinkPolicy::FollowOnce;
+
+int64_t nowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+bool seekFile(std::FILE *file, uint64_t offset) {
+#ifdef _WIN32
+    return _fseeki64(file, static_cast<__int64>(offset), SEEK_SET) == 0;
+#else
+    return fseeko(file, static_cast<off_t>(offset), SEEK_SET) == 0;
+#endif
+}
+
+std::string segmentHeader(const FileEntry &file, const std::string &note = "") {
+    return "# File: " + file.path.string() + "\n" + note + "\n";
+}
+
+// Bytes at the start of data that style leaves out (0 if they do not match).
+size_t skippedPrefix(const SegmentStyle *style, const char *data, size_t size) {
+    if (!style || style->skipBytes == 0 || style->skipBytes > size ||
+        hash64(data, static_cast<size_t>(style->skipBytes)) != style->skipHash)
+        return 0;
+    return static_cast<size_t>(style->skipBytes);
+}
+
+// Files larger than this are streamed even if they may be duplicates.
+const uint64_t kDedupReadLimit = 64u << 20;
+
+// The first text segment written with given contents.
+struct ContentOrigin {
+    uint64_t size;
+    std::string path;  // As written in its "# File:" header.
+};
+
+// How the first link to a hard-linked inode was written.
+struct LinkOrigin {
+    char kind;         // 'T', 'B' or 'R', as in the manifest.
+    uint64_t hash;
+    std::string path;  // The segment later links refer to.
+};
+
+// Counts a file as handled when it goes out of scope, however its segment
+// was written.
+struct SegmentCounter {
+    uint64_t size;
+    ~SegmentCounter() {
+        countEvent(Counter::Segments);
+        countEvent(Counter::SegmentBytes, size);
+    }
+};
+
+bool readWholeFile(const fs::path &path, uint64_t sizeHint, std::string &contents) {
+    std::FILE *in = openInput(path);
+    if (!in)
+        return false;
+    // Read one byte past the expected size to notice a file that grew.
+    contents.resize(static_cast<size_t>(sizeHint) + 1);
+    size_t total = 0;
+    while (true) {
+        size_t bytesRead = readInput(in, &contents[total], contents.size() - total);
+        total += bytesRead;
+        if (total < contents.size())
+            break;
+        contents.resize(contents.size() * 2);
+    }
+    bool ok = !std::ferror(in);
+    std::fclose(in);
+    contents.resize(total);
+    return ok;
+}
+
+void walkDirectory(const fs::path &dir,
+                   TreeListing &listing,
+                   const std::vector<GitIgnoreRule> &rules,
+                   const fs::path &baseDir,
+                   const std::string &relDir,
+                   TraversalState &state)
+{
+    bool entered = state.enter(dir);
+    DirectoryListing children;
+    listDirectory(dir, relDir, rules, baseDir, children, &state);
+
+    // Files and subdirectories are interleaved in name order.
+    size_t fileIndex = 0;
+    for (auto &subdir : children.subdirs) {
+        while (fileIndex < children.files.size() && pathOrderLess(children.files[fileIndex].relPath, subdir.relPath))
+            listing.files.push_back(std::move(children.files[fileIndex++]));
+        listing.directories.push_back(subdir);
+        walkDirectory(baseDir / subdir.relPath, listing, rules, baseDir, subdir.relPath, state);
+    }
+    while (fileIndex < children.files.size())
+        listing.files.push_back(std::move(children.files[fileIndex++]));
+    if (entered)
+        state.leave();
+}
+
+} // namespace
+
+bool TraversalState::enter(const fs::path &dir) {
+    if (symlinkPolicy() != SymlinkPolicy::Follow)
+        return false;
+    FileStat st;
+    if (!statPath(dir, st) || st.ino == 0)
+        return false;
+    ancestors.emplace_back(st.dev, st.ino);
+    return true;
+}
+
+OutputWriter::~OutputWriter() {
+    if (file)
+        std::fclose(file);
+}
+
+void OutputWriter::attach(std::FILE *stream) {
+    file = stream;
+    currentOffset = 0;
+    writeFailed = false;
+}
+
+bool OutputWriter::open(const fs::path &path) {
+    file = std::fopen(path.string().c_str(), "wb");
+    if (!file)
+        return false;
+    std::setvbuf(file, nullptr, _IOFBF, 1 << 20);
+    currentOffset = 0;
+    writeFailed = false;
+    return true;
+}
+
+void OutputWriter::write(const char *data, size_t size) {
+    PROJECTCOMPRESSOR_PROBE2(write, size, currentOffset);
+    PhaseTimer timer(Phase::Write);
+    countEvent(Counter::Writes);
+    countEvent(Counter::BytesWritten, size);
+    if (std::fwrite(data, 1, size, file) != size)
+        writeFailed = true;
+    currentOffset += size;
+}
+
+bool OutputWriter::copyRange(std::FILE *source, uint64_t offset, uint64_t length) {
+    if (length == 0)
+        return true;
+    PROJECTCOMPRESSOR_PROBE2(copy, offset, length);
+    {
+        // Only the kernel copy is timed here: the fallback below goes through
+        // readInput and write, which time themselves.
+        PhaseTimer timer(Phase::Write);
+        if (std::fflush(file) != 0) {
+            writeFailed = true;
+            return false;
+        }
+#if defined(__linux__)
+        // Let the kernel move the bytes; on reflink-capable filesystems this
+        // shares extents instead of copying them.
+        loff_t inOffset = static_cast<loff_t>(offset);
+        loff_t outOffset = static_cast<loff_t>(currentOffset);
+        while (length > 0) {
+            ssize_t copied = copy_file_range(fileno(source), &inOffset, fileno(file), &outOffset, length, 0);
+            countEvent(Counter::CopyRanges);
+            if (copied <= 0)
+                break; // Unsupported here; copy the remainder by hand.
+            countEvent(Counter::BytesCopied, static_cast<uint64_t>(copied));
+            offset += static_cast<uint64_t>(copied);
+            currentOffset += static_cast<uint64_t>(copied);
+            length -= static_cast<uint64_t>(copied);
+        }
+        if (!seekFile(file, currentOffset)) {
+            writeFailed = true;
+            return false;
+        }
+#endif
+    }
+    if (length == 0)
+        return true;
+    if (!seekFile(source, offset))
+        return false;
+    std::vector<char> buffer(kCopyBufferSize);
+    while (length > 0) {
+        size_t chunk = static_cast<size_t>(std::min<uint64_t>(length, buffer.size()));
+        if (readInput(source, buffer.data(), chunk) != chunk)
+            return false;
+        write(buffer.data(), chunk);
+        length -= chunk;
+    }
+    return !writeFailed;
+}
+
+bool OutputWriter::close() {
+    if (!file)
+        return !writeFailed;
+    PhaseTimer timer(Phase::Write);
+    if (std::fclose(file) != 0)
+        writeFailed = true;
+    file = nullptr;
+    return !writeFailed;
+}
+
+char writeFileSegment(OutputWriter &out, const FileEntry &file, std::vector<char> &buffer, uint64_t *contentHash,
+                      const SegmentStyle *style) {
+    TraceSpan span("segment", "file");
+    span.note(file.relPath);
+    PROJECTCOMPRESSOR_PROBE2(segment__start, file.path.c_str(), file.size);
+    std::FILE *in = openInput(file.path);
+    if (!in) {
+        std::cerr << "Failed to open file: " << file.path << "\n";
+        PROJECTCOMPRESSOR_PROBE2(segment__done, file.path.c_str(), 0);
+        return 0;
+    }
+    size_t bytesRead = readInput(in, buffer.data(), buffer.size());
+    if (isBinaryBuffer(buffer.data(), std::min<size_t>(bytesRead, 512), &file.path)) {
+        std::cerr << "Skipping binary file: " << file.path << "\n";
+        countEvent(Counter::Binary);
+        std::fclose(in);
+        PROJECTCOMPRESSOR_PROBE2(segment__done, file.path.c_str(), 'B');
+        return 'B';
+    }
+    // The skipped prefix is at most a few KiB, so it lies in the first chunk.
+    size_t skip = skippedPrefix(style, buffer.data(), bytesRead);
+    out.write(segmentHeader(file, skip > 0 ? style->note : ""));
+    Minifier minifier(style ? style->minify : SourceLanguage::None, style && style->outline);
+    std::string minified;
+    Hasher64 hasher;
+    while (bytesRead > 0) {
+        if (style && style->minify != SourceLanguage::None) {
+            minifier.feed(buffer.data() + skip, bytesRead - skip, minified);
+            out.write(minified);
+            minified.clear();
+        } else {
+            out.write(buffer.data() + skip, bytesRead - skip);
+        }
+        skip = 0;
+        if (contentHash)
+            hasher.update(buffer.data(), bytesRead);
+        bytesRead = readInput(in, buffer.data(), buffer.size());
+    }
+    if (contentHash)
+        *contentHash = hasher.digest();
+    minifier.finish(minified);
+    out.write(minified);
+    out.write("\n\n", 2);
+    std::fclose(in);
+    PROJECTCOMPRESSOR_PROBE2(segment__done, file.path.c_str(), 'T');
+    return 'T';
+}
+
+char writeBufferSegment(OutputWriter &out, const FileEntry &file, const char *data, size_t size,
+                        const SegmentStyle *style) {
+    TraceSpan span("segment", "file");
+    span.note(file.relPath);
+    PROJECTCOMPRESSOR_PROBE2(segment__start, file.path.c_str(), size);
+    if (isBinaryBuffer(data, std::min<size_t>(size, 512), &file.path)) {
+        std::cerr << "Skipping binary file: " << file.path << "\n";
+        countEvent(Counter::Binary);
+        PROJECTCOMPRESSOR_PROBE2(segment__done, file.path.c_str(), 'B');
+        return 'B';
+    }
+    size_t skip = skippedPrefix(style, data, size);
+    out.write(segmentHeader(file, skip > 0 ? style->note : ""));
+    if (style && style->minify != SourceLanguage::None) {
+        Minifier minifier(style->minify, style->outline);
+        std::string minified;
+        minifier.feed(data + skip, size - skip, minified);
+        minifier.finish(minified);
+        out.write(minified);
+    } else {
+        out.write(data + skip, size - skip);
+    }
+    out.write("\n\n", 2);
+    PROJECTCOMPRESSOR_PROBE2(segment__done, file.path.c_str(), 'T');
+    return 'T';
+}
+
+void writeReferenceSegment(OutputWriter &out, const FileEntry &file, const std::string &original,
+                           const char *relation) {
+    out.write("# File: " + file.path.string() + "\n# " + relation + ": " + original + "\n\n");
+}
+
+bool statPath(const fs::path &path, FileStat &st) {
+#ifdef _WIN32
+    std::error_code ec;
+    st.isSymlink = fs::is_symlink(fs::symlink_status(path, ec));
+    auto status = fs::status(path, ec);
+    if (ec || !fs::exists(status))
+        return false;
+    st.isDirectory = fs::is_directory(status);
+    st.size = st.isDirectory ? 0 : fs::file_size(path, ec);
+    auto mtime = fs::last_write_time(path, ec);
+    st.mtimeNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::clock_cast<std::chrono::system_clock>(mtime).time_since_epoch()).count();
+    return true;
+#else
+    PhaseTimer timer(Phase::Stat);
+    countEvent(Counter::Stats);
+    struct stat sb;
+    if (::lstat(path.c_str(), &sb) != 0)
+        return false;
+    st.isSymlink = S_ISLNK(sb.st_mode);
+    if (st.isSymlink) {
+        countEvent(Counter::Stats);
+        if (::stat(path.c_str(), &sb) != 0)
+            return false;
+    }
+    st.isDirectory = S_ISDIR(sb.st_mode);
+    st.size = static_cast<uint64_t>(sb.st_size);
+    st.dev = static_cast<uint64_t>(sb.st_dev);
+    st.ino = static_cast<uint64_t>(sb.st_ino);
+    st.nlink = static_cast<uint64_t>(sb.st_nlink);
+#ifdef __APPLE__
+    st.mtimeNs = static_cast<int64_t>(sb.st_mtimespec.tv_sec) * 1000000000 + sb.st_mtimespec.tv_nsec;
+#else
+    st.mtimeNs = static_cast<int64_t>(sb.st_mtim.tv_sec) * 1000000000 + sb.st_mtim.tv_nsec;
+#endif
+    return true;
+#endif
+}
+
+bool isOutputArtifact(const fs::path &fileName) {
+    std::string name = fileName.string();
+    if (name.rfind(kOutputStem, 0) != 0)
+        return false;
+    // Shards are named like combined.001.txt, parts like combined.2-of-4.txt.
+    size_t at = std::char_traits<char>::length(kOutputStem);
+    auto skipNumber = [&](size_t from) {
+        size_t end = from;
+        while (end < name.size() && std::isdigit(static_cast<unsigned char>(name[end])))
+            end++;
+        return end > from ? end : std::string::npos;
+    };
+    if (at < name.size() && name[at] == '.') {
+        size_t end = skipNumber(at + 1);
+        if (end != std::string::npos && name.compare(end, 4, "-of-") == 0)
+            end = skipNumber(end + 4);
+        if (end != std::string::npos)
+            at = end;
+    }
+    size_t extension = std::char_traits<char>::length(kOutputExtension);
+    return name.compare(at, extension, kOutputExtension) == 0 &&
+           (name.size() == at + extension || name[at + extension] == '.');
+}
+
+void setPrunedNames(std::vector<std::string> names) {
+    prunedNameList = std::move(names);
+}
+
+const std::vector<std::string> &prunedNames() {
+    return prunedNameList;
+}
+
+void setSymlinkPolicy(SymlinkPolicy policy) {
+    currentSymlinkPolicy = policy;
+}
+
+SymlinkPolicy symlinkPolicy() {
+    return currentSymlinkPolicy;
+}
+
+bool isPrunedName(const fs::path &fileName) {
+#ifdef _WIN32
+    const std::string name = fileName.string();
+#else
+    const std::string &name = fileName.native();
+#endif
+    for (const auto &pruned : prunedNameList) {
+        if (name == pruned)
+            return true;
+    }
+    return false;
+}
+
+bool isBinaryBuffer(const char *data, size_t size, const fs::path *path) {
+    PhaseTimer timer(Phase::Classify);
+    if (size == 0)
+        return false;
+    size_t nonPrintable = 0;
+    for (size_t i = 0; i < size; ++i) {
+        unsigned char c = static_cast<unsigned char>(data[i]);
+        if (!((c >= 32 && c <= 126) || c == 9 || c == 10 || c == 13))
+            nonPrintable++;
+    }
+    bool binary = (static_cast<double>(nonPrintable) / size) > 0.30;
+    PROJECTCOMPRESSOR_PROBE3(classify, path ? path->c_str() : "", size, binary);
+    return binary;
+}
+
+bool isBinaryFile(const fs::path &filePath) {
+    std::ifstream in(filePath, std::ios::binary);
+    if (!in)
+        return false;
+    const size_t sampleSize = 512;
+    char buffer[sampleSize];
+    in.read(buffer, sampleSize);
+    return isBinaryBuffer(buffer, static_cast<size_t>(in.gcount()), &filePath);
+}
+
+bool pathOrderLess(const std::string &a, const std::string &b) {
+    size_t n = std::min(a.size(), b.size());
+    for (size_t i = 0; i < n; ++i) {
+        if (a[i] == b[i])
+            continue;
+        // The path whose component ends first sorts first.
+        if (a[i] == '/')
+            return true;
+        if (b[i] == '/')
+            return false;
+        return static_cast<unsigned char>(a[i]) < static_cast<unsigned char>(b[i]);
+    }
+    return a.size() < b.size();
+}
+
+void listDirectory(const fs::path &dir,
+                   const std::string &relDir,
+                   const std::vector<GitIgnoreRule> &rules,
+                   const fs::path &baseDir,
+                   DirectoryListing &listing,
+                   TraversalState *state)
+{
+    // Visit entries in name order so that the output layout is stable from
+    // one run to the next, which is what makes incremental updates possible.
+    std::vector<fs::path> children;
+    {
+        PROJECTCOMPRESSOR_PROBE1(directory__start, dir.c_str());
+        PhaseTimer timer(Phase::ReadDir);
+        timer.note(relDir.empty() ? "." : relDir);
+        countEvent(Counter::Directories);
+        for (const auto &entry : fs::directory_iterator(dir))
+            children.push_back(entry.path());
+    }
+    std::sort(children.begin(), children.end());
+
+    // Stat and ignore rules are traced per directory rather than per entry.
+    TraceSpan filter("filter", "tree");
+    filter.note(relDir.empty() ? "." : relDir);
+    const SymlinkPolicy policy = symlinkPolicy();
+    for (const auto &path : children) {
+        fs::path name = path.filename();
+        if (isPrunedName(name) || name == ".gitignore" || isOutputArtifact(name))
+            continue;
+        FileStat st;
+        if (!statPath(path, st))
+            continue;
+        if (st.isSymlink && policy == SymlinkPolicy::Skip)
+            continue;
+        if (isIgnored(rules, baseDir, path))
+            continue;
+        if (state && st.ino != 0) {
+            if (policy == SymlinkPolicy::Follow) {
+                auto key = std::make_pair(st.dev, st.ino);
+                if (st.isDirectory && std::find(state->ancestors.begin(), state->ancestors.end(), key) != state->ancestors.end())
+                    continue; // A link back to a directory being walked.
+            } else if ((policy == SymlinkPolicy::FollowOnce || st.isDirectory) && !state->visited.insert(st.dev, st.ino) &&
+                       (st.isDirectory || st.isSymlink || st.nlink == 1)) {
+                state->skipped++;
+                continue; // Already included through another path (or a bind mount).
+            }
+            // Further hard links to a file are kept; the output refers them to the first.
+        }
+        std::string relPath = relDir.empty() ? path.filename().generic_string()
+                                             : relDir + "/" + path.filename().generic_string();
+        if (st.isDirectory)
+            listing.subdirs.push_back({relPath, st.mtimeNs, st.dev, st.ino});
+        else
+            listing.files.push_back({path, relPath, st.size, st.mtimeNs, st.dev, st.ino, st.nlink});
+        if (!st.isDirectory)
+            countEvent(Counter::Files);
+    }
+    PROJECTCOMPRESSOR_PROBE2(directory__done, dir.c_str(), listing.files.size() + listing.subdirs.size());
+}
+
+void processDirectory(const fs::path &dir,
+                      TreeListing &listing,
+                      const std::vector<GitIgnoreRule> &rules,
+                      const fs::path &baseDir,
+                      const std::string &relDir)
+{
+    FileStat st;
+    statPath(dir, st);
+    if (relDir.empty())
+        listing.directories.push_back({relDir, st.mtimeNs, st.dev, st.ino});
+    TraversalState state;
+    state.visited.insert(st.dev, st.ino);
+    PROJECTCOMPRESSOR_PROBE1(tree__start, dir.c_str());
+    walkDirectory(dir, listing, rules, baseDir, relDir, state);
+    PROJECTCOMPRESSOR_PROBE2(tree__done, dir.c_str(), listing.files.size());
+}
+
+bool combineFiles(const std::vector<FileEntry> &files,
+                  const fs::path &outputPath,
+                  const Manifest *previous,
+                  const fs::path &previousOutput,
+                  Manifest &manifest,
+                  CombineSummary &summary,
+                  const CombineOptions &options)
+{
+    OutputWriter out;
+    if (!out.open(outputPath)) {
+        std::cerr << "Failed to create output file " << outputPath << "\n";
+        return false;
+    }
+
+    manifest.options = options.nearDup ? "near-dup" : "";
+
+    // The preamble comes first; its hash identifies the layout, since the
+    // segments refer to its blocks by number.
+    BoilerplatePlan boilerplate;
+    std::string preamble;
+    manifest.layout = options.outline ? "outline" : options.minify ? "minify" : "";
+    if (options.boilerplate) {
+        boilerplate = findBoilerplate(files);
+        preamble = boilerplatePreamble(boilerplate);
+        manifest.layout += manifest.layout.empty() ? "" : ",";
+        manifest.layout += "boilerplate=" + hashToHex(hash64(preamble.data(), preamble.size()));
+    }
+    out.write(options.banner);
+    out.write(preamble);
+    if (previous && previous->layout != manifest.layout)
+        previous = nullptr;
+    std::unordered_map<std::string, const ManifestEntry *> previousEntries;
+    std::unordered_set<uint64_t> referencedHashes; // Contents of previous references.
+    // Sketches in the previous manifest can stand in for reading the files.
+    const bool previousSketched = options.nearDup && previous && previous->options == manifest.options;
+    std::FILE *previousFile = nullptr;
+    if (previous) {
+        previousFile = std::fopen(previousOutput.string().c_str(), "rb");
+        if (previousFile) {
+            for (const auto &entry : previous->entries) {
+                previousEntries.emplace(entry.relPath, &entry);
+                if (entry.kind == 'R')
+                    referencedHashes.insert(entry.hash);
+            }
+        }
+    }
+
+    // A file modified in the same clock tick as this run cannot be told apart
+    // from its next modification by mtime alone, so it is never reused.
+    const int64_t racyThresholdNs = nowNs() - 2'000'000'000;
+
+    // Adjacent reused segments are coalesced into a single copy.
+    uint64_t pendingOffset = 0;
+    uint64_t pendingLength = 0;
+    bool ok = true;
+    auto flushPending = [&]() {
+        ok = out.copyRange(previousFile, pendingOffset, pendingLength);
+        pendingLength = 0;
+        return ok;
+    };
+
+    // Text segments written so far, by content hash, for deduplication.
+    std::unordered_map<uint64_t, ContentOrigin> origins;
+    std::unordered_set<uint64_t> writtenSizes;
+    auto findOrigin = [&](uint64_t size, uint64_t hash) -> const ContentOrigin * {
+        auto it = origins.find(hash);
+        return it != origins.end() && it->second.size == size ? &it->second : nullptr;
+    };
+    auto remember = [&](const FileEntry &file, uint64_t hash) {
+        if (!options.dedup)
+            return;
+        writtenSizes.insert(file.size);
+        origins.emplace(hash, ContentOrigin{file.size, file.path.string()});
+    };
+
+    // Inodes with several links, by (st_dev, st_ino), once one link is written.
+    std::map<std::pair<uint64_t, uint64_t>, LinkOrigin> links;
+    std::pair<uint64_t, uint64_t> inode;
+    bool hardLinked = false;
+    auto rememberLink = [&](const ManifestEntry &entry, const std::string &path) {
+        if (hardLinked)
+            links.emplace(inode, LinkOrigin{entry.kind, entry.hash, path});
+    };
+
+    // Files written in full with a sketch, as the representatives of their
+    // near-duplicate clusters.
+    SimHashIndex representatives;
+    std::vector<std::string> representativePaths;
+    auto findSimilar = [&](uint64_t sketch) -> const std::string * {
+        size_t id;
+        return sketch != 0 && representatives.find(sketch, id) ? &representativePaths[id] : nullptr;
+    };
+    auto addRepresentative = [&](uint64_t sketch, const FileEntry &file) {
+        if (sketch == 0)
+            return;
+        representatives.insert(sketch, representativePaths.size());
+        representativePaths.push_back(file.path.string());
+    };
+
+    std::vector<char> buffer(kCopyBufferSize);
+    std::string contents;
+    for (size_t index = 0; index < files.size(); ++index) {
+        const FileEntry &file = files[index];
+        SegmentCounter counted{file.size};
+        SegmentStyle style;
+        if (options.boilerplate && boilerplate.blockOf[index] >= 0) {
+            const BoilerplateBlock &block = boilerplate.blocks[boilerplate.blockOf[index]];
+            style.note = "# Boilerplate: " + std::to_string(boilerplate.blockOf[index] + 1) + "\n";
+            style.skipBytes = block.text.size();
+            style.skipHash = block.hash;
+        }
+        if (options.minify || options.outline) {
+            style.minify = languageForPath(file.path);
+            style.outline = options.outline;
+        }
+        const SegmentStyle *fileStyle = style.skipBytes > 0 || style.minify != SourceLanguage::None ? &style : nullptr;
+        ManifestEntry entry;
+        entry.relPath = file.relPath;
+        entry.size = file.size;
+        entry.mtimeNs = file.mtimeNs < racyThresholdNs ? file.mtimeNs : 0;
+
+        auto it = previousEntries.find(file.relPath);
+        const ManifestEntry *old = it == previousEntries.end() ? nullptr : it->second;
+
+        inode = {file.dev, file.ino};
+        hardLinked = file.nlink > 1 && file.ino != 0;
+        if (file.ino == 0 && old && referencedHashes.count(old->hash)) {
+            // Listed without a stat (see processDirectoryTrustingMtimes), but
+            // possibly the first link of a file referenced last time.
+            FileStat st;
+            if (statPath(file.path, st)) {
+                inode = {st.dev, st.ino};
+                hardLinked = st.nlink > 1 && st.ino != 0;
+            }
+        }
+        auto link = hardLinked ? links.find(inode) : links.end();
+        if (link != links.end()) {
+            // Another name for an inode already handled: nothing to read.
+            entry.hash = link->second.hash;
+            if (link->second.kind == 'B') {
+                entry.kind = 'B';
+                summary.binary++;
+                manifest.entries.push_back(std::move(entry));
+                continue;
+            }
+            if (pendingLength > 0 && !flushPending())
+                break;
+            entry.kind = 'R';
+            entry.offset = out.offset();
+            writeReferenceSegment(out, file, link->second.path);
+            entry.length = out.offset() - entry.offset;
+            summary.linked++;
+            manifest.entries.push_back(std::move(entry));
+            continue;
+        }
+
+        if (old && old->mtimeNs != 0 && old->mtimeNs == file.mtimeNs && old->size == file.size) {
+            entry.kind = old->kind;
+            entry.hash = old->hash;
+            entry.sketch = previousSketched ? old->sketch : 0;
+            if (old->kind == 'B') {
+                summary.binary++;
+                rememberLink(entry, "");
+                manifest.entries.push_back(std::move(entry));
+                continue;
+            }
+            if (const ContentOrigin *origin = options.dedup ? findOrigin(file.size, old->hash) : nullptr) {
+                // The contents are known from the manifest; no need to read the file.
+                if (pendingLength > 0 && !flushPending())
+                    break;
+                entry.kind = 'R';
+                entry.offset = out.offset();
+                writeReferenceSegment(out, file, origin->path);
+                entry.length = out.offset() - entry.offset;
+                summary.deduplicated++;
+                rememberLink(entry, origin->path);
+                manifest.entries.push_back(std::move(entry));
+                continue;
+            }
+            if (const std::string *similar = previousSketched ? findSimilar(old->sketch) : nullptr) {
+                if (pendingLength > 0 && !flushPending())
+                    break;
+                entry.kind = 'R';
+                entry.offset = out.offset();
+                writeReferenceSegment(out, file, *similar, "Similar to");
+                entry.length = out.offset() - entry.offset;
+                summary.similar++;
+                rememberLink(entry, file.path.string());
+                manifest.entries.push_back(std::move(entry));
+                continue;
+            }
+            if (old->kind == 'T' && (!options.nearDup || previousSketched)) {
+                if (pendingLength > 0 && pendingOffset + pendingLength != old->offset && !flushPending())
+                    break;
+                if (pendingLength == 0)
+                    pendingOffset = old->offset;
+                entry.offset = out.offset() + pendingLength;
+                entry.length = old->length;
+                pendingLength += old->length;
+                summary.reused++;
+                remember(file, entry.hash);
+                rememberLink(entry, file.path.string());
+                addRepresentative(entry.sketch, file);
+                manifest.entries.push_back(std::move(entry));
+                continue;
+            }
+            // A reference whose original is gone, or a file without a sketch:
+            // write the contents below.
+            entry.sketch = 0;
+        }
+
+        if (pendingLength > 0 && !flushPending())
+            break;
+        entry.offset = out.offset();
+        if (file.size <= kDedupReadLimit && (options.nearDup || (options.dedup && writtenSizes.count(file.size)))) {
+            // Possibly a duplicate: hash it before anything is written.
+            if (!readWholeFile(file.path, file.size, contents)) {
+                std::cerr << "Failed to open file: " << file.path << "\n";
+                continue;
+            }
+            entry.hash = hash64(contents.data(), contents.size());
+            const ContentOrigin *origin = options.dedup ? findOrigin(contents.size(), entry.hash) : nullptr;
+            if (!origin && options.nearDup && !isBinaryBuffer(contents.data(), std::min<size_t>(contents.size(), 512), &file.path))
+                entry.sketch = simHash(contents.data(), contents.size());
+            const std::string *similar = origin ? nullptr : findSimilar(entry.sketch);
+            if (origin) {
+                entry.kind = 'R';
+                writeReferenceSegment(out, file, origin->path);
+                summary.deduplicated++;
+                rememberLink(entry, origin->path);
+            } else if (similar) {
+                entry.kind = 'R';
+                writeReferenceSegment(out, file, *similar, "Similar to");
+                summary.similar++;
+                rememberLink(entry, file.path.string());
+            } else {
+                entry.kind = writeBufferSegment(out, file, contents.data(), contents.size(), fileStyle);
+            }
+        } else {
+            entry.kind = writeFileSegment(out, file, buffer, &entry.hash, fileStyle);
+        }
+        if (entry.kind == 0)
+            continue;
+        if (entry.kind == 'B') {
+            entry.hash = 0;
+            summary.binary++;
+            rememberLink(entry, "");
+        } else if (entry.kind == 'T') {
+            summary.written++;
+            remember(file, entry.hash);
+            rememberLink(entry, file.path.string());
+            addRepresentative(entry.sketch, file);
+        }
+        entry.length = out.offset() - entry.offset;
+        manifest.entries.push_back(std::move(entry));
+    }
+    if (ok && pendingLength > 0)
+        flushPending();
+
+    if (previousFile)
+        std::fclose(previousFile);
+    manifest.outputSize = out.offset();
+    if (!out.close() || !ok) {
+        std::cerr << "Failed to write output file " << outputPath << "\n";
+        return false;
+    }
+    return true;
+}
+
+bool loadPreviousManifest(const fs::path &outputPath, const std::string &root, Manifest &previous) {
+    // The previous output is only trusted if it was generated from the same
+    // root and has not been modified since its manifest was written.
+    std::error_code ec;
+    return loadManifest(manifestPathFor(outputPath), previous) &&
+           previous.root == root &&
+           fs::file_size(outputPath, ec) == previous.outputSize && !ec;
+}
+
+bool updateOutput(const std::vector<FileEntry> &files,
+                  const fs::path &outputPath,
+                  const Manifest *previous,
+                  Manifest &manifest,
+                  CombineSummary &summary,
+                  const CombineOptions &options)
+{
+    fs::path tmpPath = outputPath;
+    tmpPath += ".tmp";
+    if (!combineFiles(files, tmpPath, previous, outputPath, manifest, summary, options))
+        return false;
+    std::error_code ec;
+    fs::rename(tmpPath, outputPath, ec);
+    if (ec) {
+        std::cerr << "Failed to replace " << outputPath << ": " << ec.message() << "\n";
+        return false;
+    }
+    return saveManifest(manifestPathFor(outputPath), manifest);
+}
@@ -0,0 +1,286 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "gitignore.hpp"
+#include "inodeset.hpp"
+#include "manifest.hpp"
+#include "minify.hpp"
+
+namespace fs = std::filesystem;
+
+// The subset of stat(2) information the traversal needs.
+struct FileStat {
+    uint64_t size = 0;
+    int64_t mtimeNs = 0;      // Nanoseconds since the Unix epoch.
+    bool isDirectory = false;
+    bool isSymlink = false;   // The path itself is a symlink; the rest describes its target.
+    uint64_t dev = 0;         // st_dev and st_ino of the target; 0 where unavailable.
+    uint64_t ino = 0;
+    uint64_t nlink = 1;
+};
+
+// How the traversal treats symbolic links.
+enum class SymlinkPolicy {
+    Skip,        // Symlinks are not listed.
+    FollowOnce,  // Followed, but every physical file and directory is included once.
+    Follow,      // Followed everywhere; only links back to an ancestor are cut.
+};
+
+// Per-walk state used to detect cycles and files reached more than once.
+struct TraversalState {
+    InodeSet visited;  // Directories, and under FollowOnce files, included so far.
+    std::vector<std::pair<uint64_t, uint64_t>> ancestors; // Directories being walked (Follow).
+    size_t skipped = 0; // Entries left out because visited already held them.
+
+    // Push dir on the ancestor stack under the Follow policy. Returns true
+    // if it was pushed, in which case leave() must be called afterwards.
+    bool enter(const fs::path &dir);
+    void leave() { ancestors.pop_back(); }
+};
+
+// A file selected for the combined output.
+struct FileEntry {
+    fs::path path;            // Path as written in the "# File:" header.
+    std::string relPath;      // Path relative to the base directory, using '/'.
+    uint64_t size = 0;
+    int64_t mtimeNs = 0;
+    uint64_t dev = 0;         // Identity of the inode, used to spot hard links;
+    uint64_t ino = 0;         // 0 if unknown.
+    uint64_t nlink = 1;
+};
+
+// A directory reached by the traversal.
+struct DirectoryEntry {
+    std::string relPath;      // "" for the root.
+    int64_t mtimeNs = 0;
+    uint64_t dev = 0;
+    uint64_t ino = 0;
+};
+
+// The included children of a single directory, each list in name order.
+struct DirectoryListing {
+    std::vector<FileEntry> files;
+    std::vector<DirectoryEntry> subdirs;
+};
+
+// Result of walking a directory tree.
+struct TreeListing {
+    std::vector<FileEntry> files;             // In traversal order.
+    std::vector<DirectoryEntry> directories;  // Visited directories, the root first.
+};
+
+// Counters reported after the output has been written.
+struct CombineSummary {
+    size_t written = 0;  // Segments generated from the source files.
+    size_t reused = 0;   // Segments copied from the previous output.
+    size_t binary = 0;   // Binary files that were skipped.
+    size_t deduplicated = 0; // Segments written as a reference to identical contents.
+    size_t linked = 0;   // Hard links written as a reference to an earlier link.
+    size_t similar = 0;  // Segments written as a reference to a near-duplicate.
+};
+
+// Choices that affect the contents of the output.
+struct CombineOptions {
+    bool dedup = false;  // Write files identical to an earlier one as a reference.
+    bool nearDup = false; // Write files similar to an earlier one as a reference.
+    bool boilerplate = false; // Move leading comment blocks shared by many files to a preamble.
+    bool minify = false;  // Strip comments and blank lines from the languages Minifier knows.
+    bool outline = false; // Minify and leave out function bodies as well.
+    std::string banner;   // Written at the very top of the output, as is.
+};
+
+// How a segment is rendered beyond copying the file.
+struct SegmentStyle {
+    std::string note;       // Header lines (each ending in '\n') after the "# File:" line.
+    uint64_t skipBytes = 0; // Leading bytes of the file left out because they are
+    uint64_t skipHash = 0;  // already in the output; only if their XXH64 is skipHash.
+    SourceLanguage minify = SourceLanguage::None; // Run the rest through a Minifier,
+    bool outline = false;                          // in outline mode if set.
+};
+
+/**
+ * Buffered writer for the combined output. It tracks the current offset so
+ * the manifest can record where each segment starts, and can splice byte
+ * ranges from a previous output without passing them through user space.
+ */
+class OutputWriter {
+public:
+    ~OutputWriter();
+
+    bool open(const fs::path &path);
+    void attach(std::FILE *stream); // Takes ownership of an already open stream.
+    void write(const char *data, size_t size);
+    void write(const std::string &text) { write(text.data(), text.size()); }
+    bool copyRange(std::FILE *source, uint64_t offset, uint64_t length);
+    bool close();
+
+    uint64_t offset() const { return currentOffset; }
+    bool failed() const { return writeFailed; }
+
+private:
+    std::FILE *file = nullptr;
+    uint64_t currentOffset = 0;
+    bool writeFailed = false;
+};
+
+/**
+ * stat() the given path, following symlinks. Returns false if it does not
+ * exist (or is a dangling symlink). isSymlink tells whether the path itself
+ * is a link, which costs a second system call only for links.
+ */
+bool statPath(const fs::path &path, FileStat &st);
+
+/**
+ * True if the file name belongs to the output, one of its shards
+ * (combined.001.txt) or parts (combined.2-of-4.txt) or one of their side
+ * files.
+ */
+bool isOutputArtifact(const fs::path &fileName);
+
+/**
+ * Replace the set of names that traversal never enters or lists (by default
+ * the VCS metadata directories `.git`, `.hg` and `.svn`). The names are
+ * compared with the file name only, before it is stat'ed or matched against
+ * the ignore rules. Call before starting any traversal.
+ */
+void setPrunedNames(std::vector<std::string> names);
+const std::vector<std::string> &prunedNames();
+
+/**
+ * True if the file name is in the pruned set.
+ */
+bool isPrunedName(const fs::path &fileName);
+
+/**
+ * Set how symlinks are treated by every traversal (FollowOnce by default).
+ * Call before starting any traversal.
+ */
+void setSymlinkPolicy(SymlinkPolicy policy);
+SymlinkPolicy symlinkPolicy();
+
+/**
+ * A heuristic to check if a buffer holds binary data. path, if given, is
+ * the file the buffer was read from, for the classify probe.
+ */
+bool isBinaryBuffer(const char *data, size_t size, const fs::path *path = nullptr);
+
+/**
+ * A heuristic to check if a file is binary.
+ */
+bool isBinaryFile(const fs::path &filePath);
+
+/**
+ * Order of two relative paths in the traversal: component by component, with
+ * the entries of a directory sorted by name.
+ */
+bool pathOrderLess(const std::string &a, const std::string &b);
+
+// Comparator for ordered containers keyed by relative path.
+struct PathOrder {
+    bool operator()(const std::string &a, const std::string &b) const { return pathOrderLess(a, b); }
+};
+
+/**
+ * List the included files and subdirectories directly inside dir, without
+ * descending into the subdirectories. With a traversal state, entries that
+ * the symlink policy says were already included (or that would close a
+ * cycle) are left out.
+ */
+void listDirectory(const fs::path &dir,
+                   const std::string &relDir,
+                   const std::vector<GitIgnoreRule> &rules,
+                   const fs::path &baseDir,
+                   DirectoryListing &listing,
+                   TraversalState *state = nullptr);
+
+/**
+ * Recursively collect the text file candidates below dir, in name order.
+ * Each call is a separate walk with its own traversal state.
+ */
+void processDirectory(const fs::path &dir,
+                      TreeListing &listing,
+                      const std::vector<GitIgnoreRule> &rules,
+                      const fs::path &baseDir,
+                      const std::string &relDir = "");
+
+/**
+ * Read one file and append its segment to the output. The first chunk of
+ * buffer (which must hold at least 512 bytes) is used for binary detection,
+ * so every file is opened exactly once. If contentHash is given, it receives
+ * the XXH64 of the file contents (all of them, whatever style leaves out).
+ * Returns 'T' if the segment was written, 'B' for a skipped binary file and
+ * 0 if the file could not be read.
+ */
+char writeFileSegment(OutputWriter &out, const FileEntry &file, std::vector<char> &buffer,
+                      uint64_t *contentHash = nullptr, const SegmentStyle *style = nullptr);
+
+/**
+ * Append the segment for a file whose contents are already in memory, such
+ * as a blob read from a git repository. Returns 'T' or 'B' as above.
+ */
+char writeBufferSegment(OutputWriter &out, const FileEntry &file, const char *data, size_t size,
+                        const SegmentStyle *style = nullptr);
+
+/**
+ * Write a segment standing for file that only names original, an earlier
+ * segment with the same (or, as relation says, similar) contents.
+ */
+void writeReferenceSegment(OutputWriter &out, const FileEntry &file, const std::string &original,
+                           const char *relation = "Same as");
+
+/**
+ * Write the combined output for files to outputPath and describe its layout
+ * in manifest. If previous is given, segments of files whose size and
+ * modification time are unchanged are copied from previousOutput instead of
+ * being regenerated.
+ *
+ * A file with more than one hard link is only read once: later links to
+ * the same inode are written as a reference to the first, without opening
+ * them. With options.dedup, a file whose size and XXH64 match a file written
+ * earlier becomes a reference to it. Hashes are computed while the files are
+ * streamed; a file is only read into memory before being written if an
+ * earlier file had the same size, so duplicates are never written out.
+ *
+ * With options.nearDup, every text file is read into memory and sketched
+ * with SimHash. A file whose fingerprint is within a few bits of a file
+ * written in full earlier becomes a "Similar to" reference to it; the files
+ * written in full are the representatives of their clusters.
+ *
+ * With options.boilerplate, leading comment blocks shared by several files
+ * (see findBoilerplate) are written once in a preamble, and the segments of
+ * those files name the block instead of repeating it.
+ *
+ * With options.minify, files in a language Minifier knows have their
+ * comments, trailing whitespace and extra blank lines removed on the way
+ * to the output; options.outline also leaves out function bodies. Content
+ * hashes are still those of the files.
+ */
+bool combineFiles(const std::vector<FileEntry> &files,
+                  const fs::path &outputPath,
+                  const Manifest *previous,
+                  const fs::path &previousOutput,
+                  Manifest &manifest,
+                  CombineSummary &summary,
+                  const CombineOptions &options = CombineOptions());
+
+/**
+ * Load the manifest of outputPath if it describes that output as generated
+ * from root. Returns false if the previous output cannot be reused.
+ */
+bool loadPreviousManifest(const fs::path &outputPath, const std::string &root, Manifest &previous);
+
+/**
+ * Regenerate outputPath through a temporary file, reusing the segments of
+ * previous where possible, then save the new manifest next to it.
+ */
+bool updateOutput(const std::vector<FileEntry> &files,
+                  const fs::path &outputPath,
+                  const Manifest *previous,
+                  Manifest &manifest,
+                  CombineSummary &summary,
+                  const CombineOptions &options = CombineOptions());
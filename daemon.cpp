@@ -0,0 +1,398 @@
+#include "daemon.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "compressor.hpp"
+#include "gitignore.hpp"
+
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#endif
+#ifdef __linux__
+#include <poll.h>
+#endif
+
+namespace {
+
+const size_t kMaxRequestSize = 64 * 1024;
+// A client has this long to send its request, and any single write of the
+// output may stall this long, before the connection is dropped; otherwise
+// a client that hangs would keep its thread, and shutdown, waiting forever.
+const int kRequestTimeoutSeconds = 5;
+const int kWriteTimeoutSeconds = 30;
+
+#ifndef _WIN32
+bool makeSocketAddress(const fs::path &socketPath, sockaddr_un &address) {
+    std::string path = socketPath.string();
+    if (path.size() >= sizeof(address.sun_path)) {
+        std::cerr << "Socket path too long: " << socketPath << "\n";
+        return false;
+    }
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+    return true;
+}
+
+bool writeAll(int fd, const char *data, size_t size) {
+    while (size > 0) {
+        ssize_t written = ::write(fd, data, size);
+        if (written < 0 && errno == EINTR)
+            continue;
+        if (written <= 0)
+            return false;
+        data += written;
+        size -= static_cast<size_t>(written);
+    }
+    return true;
+}
+
+// Requests are a single line: "COMBINE\t<subtree>\t<filter>\n".
+std::string encodeRequest(const DaemonRequest &request) {
+    return "COMBINE\t" + request.subtree + "\t" + request.filter + "\n";
+}
+
+std::optional<DaemonRequest> decodeRequest(const std::string &line) {
+    size_t first = line.find('\t');
+    size_t second = first == std::string::npos ? std::string::npos : line.find('\t', first + 1);
+    if (second == std::string::npos || line.compare(0, first, "COMBINE") != 0)
+        return std::nullopt;
+    DaemonRequest request;
+    request.subtree = line.substr(first + 1, second - first - 1);
+    request.filter = line.substr(second + 1);
+    while (!request.subtree.empty() && request.subtree.back() == '/')
+        request.subtree.pop_back();
+    if (request.subtree == ".")
+        request.subtree.clear();
+    return request;
+}
+#endif
+
+bool matchesFilter(const GitIgnoreRule &rule, bool onPath, const std::string &relPath) {
+    if (onPath)
+        return matchesRule(rule, relPath, false);
+    size_t slash = relPath.rfind('/');
+    return matchesRule(rule, slash == std::string::npos ? relPath : relPath.substr(slash + 1), false);
+}
+
+} // namespace
+
+#ifdef __linux__
+
+namespace {
+
+volatile std::sig_atomic_t daemonStopRequested = 0;
+
+void onDaemonStopSignal(int) {
+    daemonStopRequested = 1;
+}
+
+// Binary classification of a file, valid while its size and mtime match.
+struct Classification {
+    uint64_t size = 0;
+    int64_t mtimeNs = 0;
+    bool binary = false;
+};
+
+// State shared between the event loop and the connection threads.
+struct DaemonState {
+    TreeWatcher watcher;
+    std::unordered_map<std::string, Classification> classifications;
+    std::mutex mutex;
+    std::atomic<int> activeConnections{0};
+    const CombineOptions combine;
+
+    DaemonState(const fs::path &root, const WatchOptions &options, const CombineOptions &combine)
+        : watcher(root, options), combine(combine) {}
+};
+
+void sendError(int fd, const std::string &message) {
+    std::string line = "ERROR " + message + "\n";
+    writeAll(fd, line.data(), line.size());
+}
+
+void setTimeout(int fd, int option, int seconds) {
+    struct timeval timeout = {seconds, 0};
+    setsockopt(fd, SOL_SOCKET, option, &timeout, sizeof(timeout));
+}
+
+void handleConnection(DaemonState &state, int fd) {
+    setTimeout(fd, SO_RCVTIMEO, kRequestTimeoutSeconds);
+    setTimeout(fd, SO_SNDTIMEO, kWriteTimeoutSeconds);
+    std::string line;
+    char c;
+    while (line.size() < kMaxRequestSize) {
+        ssize_t n = ::read(fd, &c, 1);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            sendError(fd, "timed out waiting for the request");
+            close(fd);
+            return;
+        }
+        if (n <= 0 || c == '\n')
+            break;
+        line += c;
+    }
+    auto request = decodeRequest(line);
+    if (!request) {
+        sendError(fd, "malformed request");
+        close(fd);
+        return;
+    }
+    if (request->subtree == ".." || request->subtree.rfind("../", 0) == 0 ||
+        request->subtree.find("/../") != std::string::npos ||
+        (request->subtree.size() > 3 && request->subtree.compare(request->subtree.size() - 3, 3, "/..") == 0)) {
+        sendError(fd, "subtree must stay below the root");
+        close(fd);
+        return;
+    }
+    std::optional<GitIgnoreRule> filter;
+    if (!request->filter.empty()) {
+        filter = parseGitIgnoreLine(request->filter);
+        if (!filter) {
+            sendError(fd, "invalid filter");
+            close(fd);
+            return;
+        }
+    }
+    bool filterOnPath = request->filter.find('/') != std::string::npos;
+
+    // Apply changes that are still being debounced so the answer reflects
+    // the tree as of now, then take a snapshot of the selected files.
+    std::vector<FileEntry> selected;
+    {
+        std::lock_guard<std::mutex> lock(state.mutex);
+        state.watcher.readEvents();
+        state.watcher.flush(true);
+        for (auto &file : state.watcher.filesUnder(request->subtree)) {
+            if (filter && !matchesFilter(*filter, filterOnPath, file.relPath))
+                continue;
+            auto it = state.classifications.find(file.relPath);
+            if (it != state.classifications.end() && it->second.binary &&
+                it->second.size == file.size && it->second.mtimeNs == file.mtimeNs)
+                continue;
+            selected.push_back(std::move(file));
+        }
+    }
+
+    if (!writeAll(fd, "OK\n", 3)) {
+        close(fd);
+        return;
+    }
+    std::FILE *stream = fdopen(fd, "wb");
+    if (!stream) {
+        close(fd);
+        return;
+    }
+    OutputWriter out;
+    out.attach(stream);
+    std::vector<char> buffer(1 << 18);
+    for (const auto &file : selected) {
+        SegmentStyle style;
+        if (state.combine.minify || state.combine.outline) {
+            style.minify = languageForPath(file.path);
+            style.outline = state.combine.outline;
+        }
+        const SegmentStyle *fileStyle = style.minify != SourceLanguage::None ? &style : nullptr;
+        char kind = writeFileSegment(out, file, buffer, nullptr, fileStyle);
+        if (kind != 0) {
+            std::lock_guard<std::mutex> lock(state.mutex);
+            state.classifications[file.relPath] = Classification{file.size, file.mtimeNs, kind == 'B'};
+        }
+        if (out.failed())
+            break; // The client went away.
+    }
+    out.close();
+}
+
+void serveConnection(DaemonState &state, int fd) {
+    handleConnection(state, fd);
+    state.activeConnections--;
+}
+
+/**
+ * Remove the socket a previous daemon left at path. Anything else there is
+ * left alone and reported: --socket must never delete a regular file.
+ */
+bool removeStaleSocket(const fs::path &path) {
+    struct stat st;
+    if (lstat(path.c_str(), &st) != 0) {
+        if (errno == ENOENT)
+            return true;
+        std::cerr << "Cannot stat " << path << ": " << std::strerror(errno) << "\n";
+        return false;
+    }
+    if (!S_ISSOCK(st.st_mode)) {
+        std::cerr << "Not a socket, refusing to replace it: " << path << "\n";
+        return false;
+    }
+    if (::unlink(path.c_str()) != 0 && errno != ENOENT) {
+        std::cerr << "Cannot remove the stale socket " << path << ": " << std::strerror(errno) << "\n";
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+int runDaemon(const fs::path &targetDir, const fs::path &socketPath, const WatchOptions &options,
+              const CombineOptions &combine) {
+    sockaddr_un address;
+    if (!makeSocketAddress(socketPath, address))
+        return 1;
+
+    DaemonState state(targetDir, options, combine);
+    if (!state.watcher.start())
+        return 1;
+
+    int listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listenFd < 0) {
+        std::cerr << "Failed to create socket\n";
+        return 1;
+    }
+    if (!removeStaleSocket(socketPath)) {
+        close(listenFd);
+        return 1;
+    }
+    // The daemon serves file contents, so only the owner may connect. The
+    // socket is created with these permissions rather than fixed after
+    // bind, which would leave a window for other users to connect.
+    mode_t previousMask = umask(077);
+    int bound = bind(listenFd, reinterpret_cast<sockaddr *>(&address), sizeof(address));
+    umask(previousMask);
+    if (bound != 0 || listen(listenFd, 64) != 0) {
+        std::cerr << "Failed to listen on " << socketPath << ": " << std::strerror(errno) << "\n";
+        close(listenFd);
+        return 1;
+    }
+    chmod(socketPath.c_str(), 0600); // In case the filesystem ignored the umask.
+    // Remembered so that shutdown only removes this very socket.
+    struct stat socketStat;
+    bool haveSocketStat = lstat(socketPath.c_str(), &socketStat) == 0;
+
+    std::cout << "Serving " << targetDir.string() << " on " << socketPath.string() << " ("
+              << state.watcher.directoryCount() << " directories watched)\n";
+
+    std::signal(SIGPIPE, SIG_IGN);
+    std::signal(SIGINT, onDaemonStopSignal);
+    std::signal(SIGTERM, onDaemonStopSignal);
+    while (!daemonStopRequested) {
+        int timeout;
+        {
+            std::lock_guard<std::mutex> lock(state.mutex);
+            timeout = state.watcher.timeoutMs();
+        }
+        struct pollfd fds[2] = {{listenFd, POLLIN, 0}, {state.watcher.fd(), POLLIN, 0}};
+        int ready = poll(fds, 2, timeout);
+        if (ready < 0 && errno != EINTR) {
+            std::cerr << "poll failed\n";
+            break;
+        }
+        if (ready > 0 && (fds[0].revents & POLLIN)) {
+            int clientFd = accept4(listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+            if (clientFd >= 0) {
+                state.activeConnections++;
+                std::thread(serveConnection, std::ref(state), clientFd).detach();
+            }
+        }
+        std::lock_guard<std::mutex> lock(state.mutex);
+        if (ready > 0 && (fds[1].revents & POLLIN))
+            state.watcher.readEvents();
+        state.watcher.flush();
+    }
+
+    close(listenFd);
+    struct stat current;
+    if (haveSocketStat && lstat(socketPath.c_str(), &current) == 0 && S_ISSOCK(current.st_mode) &&
+        current.st_dev == socketStat.st_dev && current.st_ino == socketStat.st_ino)
+        ::unlink(socketPath.c_str());
+    // Connections end on their own: requests and writes time out.
+    while (state.activeConnections > 0)
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    return 0;
+}
+
+#else
+
+int runDaemon(const fs::path &, const fs::path &, const WatchOptions &, const CombineOptions &) {
+    std::cerr << "Daemon mode is only supported on Linux\n";
+    return 1;
+}
+
+#endif
+
+#ifndef _WIN32
+
+int runClient(const fs::path &socketPath, const DaemonRequest &request) {
+    sockaddr_un address;
+    if (!makeSocketAddress(socketPath, address))
+        return 1;
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0) {
+        std::cerr << "Failed to connect to " << socketPath << ": " << std::strerror(errno) << "\n";
+        if (fd >= 0)
+            close(fd);
+        return 1;
+    }
+    std::string line = encodeRequest(request);
+    if (!writeAll(fd, line.data(), line.size())) {
+        std::cerr << "Failed to send request\n";
+        close(fd);
+        return 1;
+    }
+
+    // The first line is the status; everything after it is the output.
+    std::vector<char> buffer(1 << 18);
+    std::string status;
+    bool inBody = false;
+    while (true) {
+        ssize_t n = ::read(fd, buffer.data(), buffer.size());
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+        size_t start = 0;
+        if (!inBody) {
+            while (start < static_cast<size_t>(n) && buffer[start] != '\n')
+                status += buffer[start++];
+            if (start == static_cast<size_t>(n))
+                continue;
+            ++start;
+            inBody = true;
+            if (status != "OK") {
+                std::cerr << "Daemon: " << status << "\n";
+                close(fd);
+                return 1;
+            }
+        }
+        if (!writeAll(STDOUT_FILENO, buffer.data() + start, static_cast<size_t>(n) - start)) {
+            close(fd);
+            return 1;
+        }
+    }
+    close(fd);
+    return inBody ? 0 : 1;
+}
+
+#else
+
+int runClient(const fs::path &, const DaemonRequest &) {
+    std::cerr << "Unix domain sockets are not supported on this platform\n";
+    return 1;
+}
+
+#endif
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <filesystem>
+#include <string>
+
+#include "compressor.hpp"
+#include "watch.hpp"
+
+namespace fs = std::filesystem;
+
+// A request sent by --connect: which part of the tree to combine.
+struct DaemonRequest {
+    std::string subtree; // Relative path below the daemon's root; empty for everything.
+    std::string filter;  // Optional glob; matched against the file name unless it contains '/'.
+};
+
+/**
+ * Serve combine requests for targetDir on a Unix domain socket until
+ * interrupted. The ignore rules, the file list and the binary classification
+ * of every file stay in memory and are kept current with inotify, so a
+ * request only has to read the selected files. combine.minify and outline
+ * apply to every response; the options that need the whole output at once
+ * (dedup, nearDup, boilerplate) do not. Returns the exit code.
+ */
+int runDaemon(const fs::path &targetDir, const fs::path &socketPath, const WatchOptions &options,
+              const CombineOptions &combine = CombineOptions());
+
+/**
+ * Send a request to a running daemon and copy the combined output it
+ * streams back to stdout. Returns the exit code.
+ */
+int runClient(const fs::path &socketPath, const DaemonRequest &request);
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <filesystem>
+#include <optional>
+#include <regex>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+// A structure representing a single .gitignore rule.
+struct GitIgnoreRule {
+    std::regex patternRegex; // The pattern converted to a regex.
+    bool negate = false;     // True if the rule starts with '!'
+    bool directoryOnly = false; // True if the pattern ends with '/'
+    bool anchored = false;      // True if the pattern starts with '/'
+    std::string originalPattern; // The original pattern text.
+};
+
+// Utility: trim whitespace.
+std::string trim(const std::string &s);
+
+/**
+ * Convert a .gitignore pattern into a regex string.
+ */
+std::string patternToRegex(const std::string &pattern, bool anchored);
+
+/**
+ * Parse a single line of a .gitignore file into a GitIgnoreRule.
+ * Returns std::nullopt for blank lines or comments.
+ */
+std::optional<GitIgnoreRule> parseGitIgnoreLine(const std::string &line);
+
+/**
+ * Parse a .gitignore file and return a vector of rules.
+ */
+std::vector<GitIgnoreRule> parseGitIgnore(const fs::path &gitignorePath);
+
+/**
+ * Determine if the given relative path (with '/' as separator) matches a single rule.
+ */
+bool matchesRule(const GitIgnoreRule &rule, const std::string &relPath, bool isDir);
+
+/**
+ * Determine if the file with the given path should be ignored. The last
+ * matching rule wins.
+ */
+bool isIgnored(const std::vector<GitIgnoreRule> &rules, const fs::path &baseDir, const fs::path &filePath);
+
+/**
+ * Gather .gitignore rules from the given directory and its parents.
+ */
+std::vector<GitIgnoreRule> gatherGitIgnoreRules(const fs::path &startDir);
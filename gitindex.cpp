@@ -0,0 +1,330 @@
+#include "gitindex.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <unordered_set>
+
+#include "hash.hpp"
+
+namespace {
+
+uint32_t readBE32(const unsigned char *p) {
+    return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | uint32_t(p[3]);
+}
+
+uint16_t readBE16(const unsigned char *p) {
+    return static_cast<uint16_t>((p[0] << 8) | p[1]);
+}
+
+// The variable-length integer of index v4 (same encoding as pack offsets).
+bool readVarint(const unsigned char *&p, const unsigned char *end, uint64_t &value) {
+    if (p >= end)
+        return false;
+    unsigned char c = *p++;
+    value = c & 0x7F;
+    while (c & 0x80) {
+        if (p >= end)
+            return false;
+        c = *p++;
+        value = ((value + 1) << 7) | (c & 0x7F);
+    }
+    return true;
+}
+
+std::string readFirstLine(const fs::path &path) {
+    std::ifstream in(path);
+    std::string line;
+    std::getline(in, line);
+    return trim(line);
+}
+
+bool isWithinPrefix(const std::string &path, const std::string &prefix) {
+    return prefix.empty() ||
+           (path.size() > prefix.size() && path.compare(0, prefix.size(), prefix) == 0 && path[prefix.size()] == '/');
+}
+
+// Add the directories leading to each file so the listing looks like the
+// result of a walk (parents first, in traversal order).
+void addParentDirectories(TreeListing &listing) {
+    std::unordered_set<std::string> seen;
+    listing.directories.push_back({"", 0});
+    seen.insert("");
+    for (const auto &file : listing.files) {
+        size_t slash = 0;
+        while ((slash = file.relPath.find('/', slash)) != std::string::npos) {
+            std::string dir = file.relPath.substr(0, slash);
+            if (seen.insert(dir).second)
+                listing.directories.push_back({dir, 0});
+            ++slash;
+        }
+    }
+}
+
+void walkUntracked(const fs::path &dir,
+                   const std::string &relDir,
+                   const std::vector<GitIgnoreRule> &rules,
+                   const fs::path &baseDir,
+                   std::vector<FileEntry> &files,
+                   TraversalState &state)
+{
+    bool entered = state.enter(dir);
+    DirectoryListing children;
+    listDirectory(dir, relDir, rules, baseDir, children, &state);
+    for (auto &file : children.files)
+        files.push_back(std::move(file));
+    for (const auto &subdir : children.subdirs) {
+        fs::path path = baseDir / subdir.relPath;
+        if (path.filename() == ".git")
+            continue;
+        walkUntracked(path, subdir.relPath, rules, baseDir, files, state);
+    }
+    if (entered)
+        state.leave();
+}
+
+} // namespace
+
+fs::path commonGitDir(const fs::path &gitDir) {
+    std::string common = readFirstLine(gitDir / "commondir");
+    if (common.empty())
+        return gitDir;
+    fs::path path(common);
+    return path.is_absolute() ? path : gitDir / path;
+}
+
+size_t objectHashSize(const fs::path &gitDir) {
+    std::ifstream in(commonGitDir(gitDir) / "config");
+    std::string line;
+    while (std::getline(in, line)) {
+        std::string trimmed = trim(line);
+        std::transform(trimmed.begin(), trimmed.end(), trimmed.begin(), ::tolower);
+        if (trimmed.rfind("objectformat", 0) == 0 && trimmed.find("sha256") != std::string::npos)
+            return 32;
+    }
+    return 20;
+}
+
+bool findGitDir(const fs::path &dir, fs::path &gitDir, fs::path &workTree) {
+    std::error_code ec;
+    fs::path current = fs::canonical(dir, ec);
+    if (ec)
+        return false;
+    while (true) {
+        fs::path candidate = current / ".git";
+        if (fs::is_directory(candidate, ec)) {
+            gitDir = candidate;
+            workTree = current;
+            return true;
+        }
+        if (fs::is_regular_file(candidate, ec)) {
+            // A "gitdir: <path>" file, relative to the directory holding it.
+            std::string line = readFirstLine(candidate);
+            if (line.rfind("gitdir:", 0) != 0)
+                return false;
+            fs::path target(trim(line.substr(7)));
+            gitDir = target.is_absolute() ? target : current / target;
+            workTree = current;
+            return true;
+        }
+        if (!current.has_parent_path() || current == current.parent_path())
+            return false;
+        current = current.parent_path();
+    }
+}
+
+bool readGitIndex(const fs::path &indexPath, std::vector<GitIndexEntry> &entries, std::string &error) {
+    std::ifstream in(indexPath, std::ios::binary);
+    if (!in) {
+        error = "cannot open " + indexPath.string();
+        return false;
+    }
+    std::vector<unsigned char> data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    const size_t hashSize = objectHashSize(indexPath.parent_path());
+    const unsigned char *p = data.data();
+    if (data.size() < 12 || std::string(reinterpret_cast<const char *>(p), 4) != "DIRC") {
+        error = "not an index file";
+        return false;
+    }
+    if (data.size() < 12 + hashSize) {
+        error = "truncated index";
+        return false;
+    }
+    // Everything before the trailing checksum; all zeros if index.skipHash
+    // was set when the index was written.
+    const unsigned char *end = p + data.size() - hashSize;
+    if (std::any_of(end, end + hashSize, [](unsigned char c) { return c != 0; })) {
+        unsigned char digest[32];
+        if (hashSize == 32)
+            sha256(p, data.size() - hashSize, digest);
+        else
+            sha1(p, data.size() - hashSize, digest);
+        if (!std::equal(end, end + hashSize, digest)) {
+            error = "index checksum mismatch";
+            return false;
+        }
+    }
+    uint32_t version = readBE32(p + 4);
+    uint32_t count = readBE32(p + 8);
+    if (version < 2 || version > 4) {
+        error = "unsupported index version " + std::to_string(version);
+        return false;
+    }
+    p += 12;
+
+    // ctime, mtime, dev, ino, mode, uid, gid, size, then the object name.
+    const size_t fixedSize = 40 + hashSize + 2;
+    std::string previousPath;
+    entries.reserve(entries.size() + count);
+    for (uint32_t i = 0; i < count; ++i) {
+        const unsigned char *start = p;
+        if (static_cast<size_t>(end - p) < fixedSize) {
+            error = "truncated entry";
+            return false;
+        }
+        GitIndexEntry entry;
+        entry.mtimeNs = static_cast<int64_t>(readBE32(p + 8)) * 1000000000 + readBE32(p + 12);
+        entry.mode = readBE32(p + 24);
+        entry.size = readBE32(p + 36);
+        uint16_t flags = readBE16(p + 40 + hashSize);
+        entry.stage = (flags >> 12) & 0x3;
+        p += fixedSize;
+        if (flags & 0x4000) {
+            // Extended flags (version 3 and later).
+            if (version < 3 || end - p < 2) {
+                error = "bad extended flags";
+                return false;
+            }
+            uint16_t extended = readBE16(p);
+            entry.skipWorktree = extended & 0x4000;
+            entry.intentToAdd = extended & 0x2000;
+            p += 2;
+        }
+
+        if (version == 4) {
+            // The path is stored as the number of bytes to drop from the end
+            // of the previous path, followed by the new suffix.
+            uint64_t strip;
+            if (!readVarint(p, end, strip) || strip > previousPath.size()) {
+                error = "bad path compression";
+                return false;
+            }
+            const unsigned char *nul = std::find(p, end, 0);
+            if (nul == end) {
+                error = "truncated path";
+                return false;
+            }
+            entry.path = previousPath.substr(0, previousPath.size() - strip);
+            entry.path.append(reinterpret_cast<const char *>(p), static_cast<size_t>(nul - p));
+            p = nul + 1;
+        } else {
+            const unsigned char *nul = std::find(p, end, 0);
+            if (nul == end) {
+                error = "truncated path";
+                return false;
+            }
+            entry.path.assign(reinterpret_cast<const char *>(p), static_cast<size_t>(nul - p));
+            // Entries are NUL-padded to a multiple of eight bytes.
+            size_t length = static_cast<size_t>(nul - start) + 1;
+            size_t padded = (length + 7) & ~size_t(7);
+            if (static_cast<size_t>(end - start) < padded) {
+                error = "truncated entry";
+                return false;
+            }
+            p = start + padded;
+        }
+        previousPath = entry.path;
+        entries.push_back(std::move(entry));
+    }
+
+    // Extensions: a signature and a size each. Those whose signature starts
+    // with an upper-case letter are caches that may be ignored; any other
+    // changes what the entries mean. A split index ("link") keeps most
+    // entries in a shared index file, a sparse index ("sdir") folds whole
+    // directories into one entry; neither is read here.
+    while (p < end) {
+        if (end - p < 8) {
+            error = "truncated extension";
+            return false;
+        }
+        std::string signature(reinterpret_cast<const char *>(p), 4);
+        uint32_t size = readBE32(p + 4);
+        if (static_cast<size_t>(end - p) - 8 < size) {
+            error = "truncated extension";
+            return false;
+        }
+        if (signature == "link") {
+            error = "split index (core.splitIndex) is not supported";
+            return false;
+        }
+        if (signature[0] < 'A' || signature[0] > 'Z') {
+            error = "unsupported index extension '" + signature + "'";
+            return false;
+        }
+        p += 8 + size;
+    }
+    return true;
+}
+
+bool collectGitIndexFiles(const fs::path &targetDir,
+                          TreeListing &listing,
+                          const std::vector<GitIgnoreRule> &rules,
+                          bool includeUntracked)
+{
+    fs::path gitDir, workTree;
+    if (!findGitDir(targetDir, gitDir, workTree)) {
+        std::cerr << "Not inside a git work tree: " << targetDir << "\n";
+        return false;
+    }
+    std::vector<GitIndexEntry> entries;
+    std::string error;
+    if (!readGitIndex(gitDir / "index", entries, error)) {
+        std::cerr << "Failed to read git index: " << error << "\n";
+        return false;
+    }
+
+    std::error_code ec;
+    std::string prefix = fs::relative(fs::canonical(targetDir, ec), workTree, ec).generic_string();
+    if (prefix == ".")
+        prefix.clear();
+
+    std::vector<FileEntry> files;
+    std::unordered_set<std::string> tracked;
+    const std::string *lastPath = nullptr;
+    for (const auto &entry : entries) {
+        // Conflicted paths appear once per stage; take the first.
+        if (lastPath && *lastPath == entry.path)
+            continue;
+        lastPath = &entry.path;
+        uint32_t type = entry.mode & 0170000;
+        if (type == 0160000 || entry.skipWorktree || !isWithinPrefix(entry.path, prefix))
+            continue; // Submodules, files not checked out, files outside targetDir.
+        std::string relPath = prefix.empty() ? entry.path : entry.path.substr(prefix.size() + 1);
+        fs::path path = targetDir / relPath;
+        if (path.filename() == ".gitignore" || isOutputArtifact(path.filename()))
+            continue;
+        FileStat st;
+        if (!statPath(path, st) || st.isDirectory)
+            continue; // Deleted in the work tree, or a symlink to a directory.
+        tracked.insert(relPath);
+        files.push_back({path, relPath, st.size, st.mtimeNs, st.dev, st.ino, st.nlink});
+    }
+
+    if (includeUntracked) {
+        std::vector<FileEntry> walked;
+        TraversalState state;
+        walkUntracked(targetDir, "", rules, targetDir, walked, state);
+        for (auto &file : walked) {
+            if (!tracked.count(file.relPath))
+                files.push_back(std::move(file));
+        }
+    }
+
+    // The index is sorted bytewise; the output uses traversal order.
+    std::sort(files.begin(), files.end(),
+              [](const FileEntry &a, const FileEntry &b) { return pathOrderLess(a.relPath, b.relPath); });
+    listing.files = std::move(files);
+    addParentDirectories(listing);
+    return true;
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "compressor.hpp"
+#include "gitignore.hpp"
+
+namespace fs = std::filesystem;
+
+// One entry of .git/index.
+struct GitIndexEntry {
+    std::string path;       // Relative to the work tree, using '/'.
+    uint32_t mode = 0;      // 0100644, 0100755, 0120000 (symlink) or 0160000 (gitlink).
+    uint32_t size = 0;      // Size as of the last refresh (truncated to 32 bits).
+    int64_t mtimeNs = 0;    // Modification time as of the last refresh.
+    int stage = 0;          // Merge stage; non-zero for unresolved conflicts.
+    bool skipWorktree = false; // Not checked out (sparse checkout).
+    bool intentToAdd = false;  // Added with `git add -N`.
+};
+
+/**
+ * Find the git directory for the work tree containing dir. Handles both a
+ * `.git` directory and a `.git` file pointing elsewhere (linked worktrees and
+ * submodules). On success workTree receives the top of the work tree.
+ */
+bool findGitDir(const fs::path &dir, fs::path &gitDir, fs::path &workTree);
+
+/**
+ * The directory holding the data shared by all worktrees (config, objects,
+ * refs); the git directory itself unless it is a linked worktree.
+ */
+fs::path commonGitDir(const fs::path &gitDir);
+
+/**
+ * Size of object names in bytes: 20 for SHA-1, 32 for SHA-256 repositories.
+ */
+size_t objectHashSize(const fs::path &gitDir);
+
+/**
+ * Parse an index file (versions 2 to 4, including the path prefix
+ * compression of version 4) and verify its trailing checksum. Entries are
+ * returned in index order. A split or sparse index is reported as an error.
+ */
+bool readGitIndex(const fs::path &indexPath, std::vector<GitIndexEntry> &entries, std::string &error);
+
+/**
+ * Collect the files below targetDir from the git index instead of walking
+ * the tree: tracked files are taken as they are, without evaluating ignore
+ * rules. With includeUntracked, the tree is walked as well (skipping .git)
+ * and files that are neither tracked nor ignored are added. Returns false
+ * if targetDir is not inside a git work tree or the index cannot be read.
+ */
+bool collectGitIndexFiles(const fs::path &targetDir,
+                          TreeListing &listing,
+                          const std::vector<GitIgnoreRule> &rules,
+                          bool includeUntracked);
@@ -0,0 +1,900 @@
+#include "gitobjects.hpp"
+
+#include <iostream>
+
+#include "gitindex.hpp"
+
+#ifdef PROJECTCOMPRESSOR_HAVE_ZLIB
+
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <list>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include <zlib.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+enum ObjectType { kCommit = 1, kTree = 2, kBlob = 3, kTag = 4, kOfsDelta = 6, kRefDelta = 7 };
+
+// Pack objects are addressed by (pack number, offset) in the base cache.
+const size_t kBaseCacheBytes = 96u << 20;
+const int kMaxDeltaDepth = 10000;
+
+/**
+ * A read-only view of a whole file: mmap'ed where available, read into
+ * memory otherwise.
+ */
+class MappedFile {
+public:
+    MappedFile() = default;
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    ~MappedFile() {
+#ifndef _WIN32
+        if (mapped && length > 0)
+            munmap(const_cast<unsigned char *>(bytes), length);
+#endif
+    }
+
+    bool open(const fs::path &path) {
+#ifndef _WIN32
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+            return false;
+        struct stat sb;
+        if (fstat(fd, &sb) != 0) {
+            ::close(fd);
+            return false;
+        }
+        length = static_cast<size_t>(sb.st_size);
+        if (length > 0) {
+            void *address = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (address == MAP_FAILED) {
+                ::close(fd);
+                return false;
+            }
+            bytes = static_cast<const unsigned char *>(address);
+            mapped = true;
+        }
+        ::close(fd);
+        return true;
+#else
+        std::ifstream in(path, std::ios::binary);
+        if (!in)
+            return false;
+        storage.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+        bytes = reinterpret_cast<const unsigned char *>(storage.data());
+        length = storage.size();
+        return true;
+#endif
+    }
+
+    const unsigned char *data() const { return bytes; }
+    size_t size() const { return length; }
+
+private:
+    const unsigned char *bytes = nullptr;
+    size_t length = 0;
+    bool mapped = false;
+    std::vector<char> storage;
+};
+
+// An object as stored in the base cache and handed to callers.
+struct GitObject {
+    int type = 0;
+    std::string data;
+};
+using ObjectPtr = std::shared_ptr<const GitObject>;
+
+uint32_t readBE32(const unsigned char *p) {
+    return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | uint32_t(p[3]);
+}
+
+int hexDigit(char c) {
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+bool isHex(const std::string &text) {
+    return !text.empty() && std::all_of(text.begin(), text.end(), [](char c) { return hexDigit(c) >= 0; });
+}
+
+std::string toHex(const std::string &id) {
+    static const char digits[] = "0123456789abcdef";
+    std::string text;
+    for (unsigned char c : id) {
+        text += digits[c >> 4];
+        text += digits[c & 0xF];
+    }
+    return text;
+}
+
+std::string fromHex(const std::string &text) {
+    std::string id;
+    for (size_t i = 0; i + 1 < text.size(); i += 2)
+        id += static_cast<char>((hexDigit(text[i]) << 4) | hexDigit(text[i + 1]));
+    return id;
+}
+
+/**
+ * Inflate a zlib stream. If expectedSize is known the output is sized up
+ * front; otherwise it grows as needed.
+ */
+bool inflateData(const unsigned char *input, size_t inputSize, std::string &output, size_t expectedSize) {
+    z_stream stream = {};
+    if (inflateInit(&stream) != Z_OK)
+        return false;
+    output.resize(expectedSize > 0 ? expectedSize : std::max<size_t>(inputSize * 2, 64));
+    stream.next_in = const_cast<unsigned char *>(input);
+    stream.avail_in = static_cast<uInt>(std::min<size_t>(inputSize, UINT32_MAX));
+    size_t produced = 0;
+    int status = Z_OK;
+    while (status == Z_OK) {
+        if (produced == output.size()) {
+            if (expectedSize > 0)
+                break; // More data than the header promised.
+            output.resize(output.size() * 2);
+        }
+        stream.next_out = reinterpret_cast<unsigned char *>(&output[produced]);
+        stream.avail_out = static_cast<uInt>(std::min<size_t>(output.size() - produced, UINT32_MAX));
+        size_t before = stream.avail_out;
+        status = inflate(&stream, Z_NO_FLUSH);
+        produced += before - stream.avail_out;
+        if (status == Z_BUF_ERROR && stream.avail_out > 0)
+            break; // Truncated input.
+        if (status == Z_BUF_ERROR)
+            status = Z_OK;
+    }
+    inflateEnd(&stream);
+    output.resize(produced);
+    return status == Z_STREAM_END && (expectedSize == 0 || produced == expectedSize);
+}
+
+/**
+ * Apply a git delta to base.
+ */
+bool applyDelta(const std::string &base, const std::string &delta, std::string &result) {
+    const unsigned char *p = reinterpret_cast<const unsigned char *>(delta.data());
+    const unsigned char *end = p + delta.size();
+    auto readSize = [&](uint64_t &value) {
+        value = 0;
+        int shift = 0;
+        unsigned char c;
+        do {
+            if (p >= end || shift > 56)
+                return false;
+            c = *p++;
+            value |= static_cast<uint64_t>(c & 0x7F) << shift;
+            shift += 7;
+        } while (c & 0x80);
+        return true;
+    };
+    uint64_t sourceSize, targetSize;
+    if (!readSize(sourceSize) || !readSize(targetSize) || sourceSize != base.size())
+        return false;
+    result.clear();
+    result.reserve(targetSize);
+    while (p < end) {
+        unsigned char command = *p++;
+        if (command & 0x80) {
+            // Copy a range of the base.
+            uint64_t offset = 0, size = 0;
+            for (int i = 0; i < 4; ++i) {
+                if (command & (1 << i)) {
+                    if (p >= end)
+                        return false;
+                    offset |= static_cast<uint64_t>(*p++) << (8 * i);
+                }
+            }
+            for (int i = 0; i < 3; ++i) {
+                if (command & (0x10 << i)) {
+                    if (p >= end)
+                        return false;
+                    size |= static_cast<uint64_t>(*p++) << (8 * i);
+                }
+            }
+            if (size == 0)
+                size = 0x10000;
+            if (offset + size > base.size())
+                return false;
+            result.append(base, offset, size);
+        } else if (command != 0) {
+            // Insert literal bytes from the delta.
+            if (static_cast<size_t>(end - p) < command)
+                return false;
+            result.append(reinterpret_cast<const char *>(p), command);
+            p += command;
+        } else {
+            return false;
+        }
+    }
+    return result.size() == targetSize;
+}
+
+// A packfile with its version 2 index.
+struct Pack {
+    MappedFile index;
+    MappedFile data;
+    uint32_t count = 0;
+    const unsigned char *fanout = nullptr;
+    const unsigned char *names = nullptr;
+    const unsigned char *offsets = nullptr;
+    const unsigned char *largeOffsets = nullptr;
+    uint32_t largeOffsetCount = 0; // Entries of the 64-bit offset table.
+
+    // Range [first, last) of index positions whose names start with the given byte.
+    std::pair<uint32_t, uint32_t> bucket(unsigned char firstByte) const {
+        uint32_t first = firstByte == 0 ? 0 : readBE32(fanout + 4 * (firstByte - 1));
+        return {first, readBE32(fanout + 4 * firstByte)};
+    }
+
+    // False if the index points past its 64-bit offset table (corrupt).
+    bool offsetAt(uint32_t position, uint64_t &result) const {
+        uint32_t offset = readBE32(offsets + 4 * position);
+        if (!(offset & 0x80000000)) {
+            result = offset;
+            return true;
+        }
+        uint32_t large = offset & 0x7FFFFFFF;
+        if (large >= largeOffsetCount)
+            return false;
+        const unsigned char *p = largeOffsets + 8 * static_cast<size_t>(large);
+        result = (static_cast<uint64_t>(readBE32(p)) << 32) | readBE32(p + 4);
+        return true;
+    }
+};
+
+/**
+ * Bounded LRU cache of inflated pack objects, so that delta chains sharing
+ * a base do not inflate and patch it again for every object.
+ */
+class BaseCache {
+public:
+    explicit BaseCache(size_t capacity) : capacity(capacity) {}
+
+    ObjectPtr get(uint64_t key) {
+        auto it = entries.find(key);
+        if (it == entries.end())
+            return nullptr;
+        order.splice(order.begin(), order, it->second.position);
+        return it->second.object;
+    }
+
+    void put(uint64_t key, ObjectPtr object) {
+        size_t size = object->data.size();
+        if (size > capacity / 4 || entries.count(key))
+            return;
+        order.push_front(key);
+        entries[key] = {std::move(object), order.begin()};
+        usedBytes += size;
+        while (usedBytes > capacity && !order.empty()) {
+            auto last = entries.find(order.back());
+            usedBytes -= last->second.object->data.size();
+            entries.erase(last);
+            order.pop_back();
+        }
+    }
+
+private:
+    struct Entry {
+        ObjectPtr object;
+        std::list<uint64_t>::iterator position;
+    };
+    size_t capacity;
+    size_t usedBytes = 0;
+    std::list<uint64_t> order;
+    std::unordered_map<uint64_t, Entry> entries;
+};
+
+/**
+ * Read access to the objects of a repository: loose objects and packfiles
+ * of its object directory and of any alternates.
+ */
+class ObjectStore {
+public:
+    ObjectStore(const fs::path &gitDir) : gitDir(gitDir), commonDir(commonGitDir(gitDir)),
+                                          hashSize(objectHashSize(gitDir)), cache(kBaseCacheBytes) {}
+
+    bool open(std::string &error) {
+        addObjectDirectory(commonDir / "objects");
+        std::ifstream alternates(commonDir / "objects" / "info" / "alternates");
+        std::string line;
+        while (std::getline(alternates, line)) {
+            line = trim(line);
+            if (line.empty() || line[0] == '#')
+                continue;
+            fs::path path(line);
+            addObjectDirectory(path.is_absolute() ? path : commonDir / "objects" / path);
+        }
+        if (objectDirs.empty()) {
+            error = "no object directory in " + commonDir.string();
+            return false;
+        }
+        return true;
+    }
+
+    ObjectPtr read(const std::string &id) {
+        for (size_t i = 0; i < packs.size(); ++i) {
+            uint64_t offset;
+            if (findInPack(*packs[i], id, offset))
+                return readPacked(i, offset, 0);
+        }
+        return readLoose(id);
+    }
+
+    bool resolve(const std::string &revision, std::string &id, std::string &error) {
+        size_t opStart = revision.find_first_of("~^");
+        std::string name = revision.substr(0, opStart);
+        if (!resolveName(name.empty() ? "HEAD" : name, id, error))
+            return false;
+
+        // Ancestry suffixes: "~N" is the Nth first-parent ancestor, "^N" the Nth parent.
+        size_t i = opStart;
+        while (i != std::string::npos && i < revision.size()) {
+            char op = revision[i++];
+            size_t digits = i;
+            while (i < revision.size() && std::isdigit(static_cast<unsigned char>(revision[i])))
+                ++i;
+            unsigned n = 1;
+            if (i > digits) {
+                auto [end, status] = std::from_chars(revision.data() + digits, revision.data() + i, n);
+                if (status != std::errc()) {
+                    error = "invalid revision: " + revision;
+                    return false;
+                }
+            }
+            if (op == '~') {
+                for (unsigned k = 0; k < n; ++k) {
+                    if (!parent(id, 1, id, error))
+                        return false;
+                }
+            } else if (op == '^') {
+                if (n > 0 && !parent(id, n, id, error))
+                    return false;
+            } else {
+                error = "unsupported revision syntax: " + revision;
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Peel tags and commits down to a tree.
+    bool peelToTree(std::string id, std::string &tree, std::string &error) {
+        for (int depth = 0; depth < 64; ++depth) {
+            ObjectPtr object = read(id);
+            if (!object) {
+                error = "missing object " + toHex(id);
+                return false;
+            }
+            if (object->type == kTree) {
+                tree = id;
+                return true;
+            }
+            std::string field = object->type == kCommit ? "tree " : object->type == kTag ? "object " : "";
+            if (field.empty() || !headerField(object->data, field, id)) {
+                error = "cannot peel " + toHex(id) + " to a tree";
+                return false;
+            }
+        }
+        error = "tag chain too long";
+        return false;
+    }
+
+    size_t idSize() const { return hashSize; }
+
+private:
+    void addObjectDirectory(const fs::path &dir) {
+        std::error_code ec;
+        if (!fs::is_directory(dir, ec))
+            return;
+        objectDirs.push_back(dir);
+        for (const auto &entry : fs::directory_iterator(dir / "pack", ec)) {
+            if (entry.path().extension() != ".idx")
+                continue;
+            auto pack = std::make_unique<Pack>();
+            fs::path packPath = entry.path();
+            packPath.replace_extension(".pack");
+            if (loadPack(*pack, entry.path(), packPath))
+                packs.push_back(std::move(pack));
+            else
+                std::cerr << "Ignoring unreadable pack " << entry.path() << "\n";
+        }
+    }
+
+    bool loadPack(Pack &pack, const fs::path &indexPath, const fs::path &packPath) {
+        if (!pack.index.open(indexPath) || !pack.data.open(packPath))
+            return false;
+        const unsigned char *p = pack.index.data();
+        size_t size = pack.index.size();
+        // Only version 2 indexes ("\377tOc", 2) are written by git since 1.5.2.
+        if (size < 8 + 256 * 4 || readBE32(p) != 0xFF744F63 || readBE32(p + 4) != 2)
+            return false;
+        pack.fanout = p + 8;
+        pack.count = readBE32(pack.fanout + 255 * 4);
+        pack.names = pack.fanout + 256 * 4;
+        pack.offsets = pack.names + static_cast<size_t>(pack.count) * (hashSize + 4);
+        // The fanout must be sorted, and the tables plus the trailer (pack and
+        // index checksums) must fit; what is left is the 64-bit offset table.
+        for (int i = 1; i < 256; ++i) {
+            if (readBE32(pack.fanout + 4 * i) < readBE32(pack.fanout + 4 * (i - 1)))
+                return false;
+        }
+        size_t tables = 8 + 256 * 4 + static_cast<size_t>(pack.count) * (hashSize + 8);
+        if (tables + 2 * hashSize > size)
+            return false;
+        pack.largeOffsets = pack.offsets + static_cast<size_t>(pack.count) * 4;
+        pack.largeOffsetCount = static_cast<uint32_t>((size - tables - 2 * hashSize) / 8);
+        return pack.data.size() >= 12 && std::string(reinterpret_cast<const char *>(pack.data.data()), 4) == "PACK";
+    }
+
+    bool findInPack(const Pack &pack, const std::string &id, uint64_t &offset) const {
+        auto [low, high] = pack.bucket(static_cast<unsigned char>(id[0]));
+        while (low < high) {
+            uint32_t middle = low + (high - low) / 2;
+            int cmp = std::memcmp(pack.names + static_cast<size_t>(middle) * hashSize, id.data(), hashSize);
+            if (cmp == 0)
+                return pack.offsetAt(middle, offset);
+            if (cmp < 0)
+                low = middle + 1;
+            else
+                high = middle;
+        }
+        return false;
+    }
+
+    // All objects whose name starts with the given hex prefix.
+    void findByPrefix(const std::string &prefix, std::vector<std::string> &matches) {
+        std::string padded = prefix + std::string(hashSize * 2 - prefix.size(), '0');
+        std::string low = fromHex(padded);
+        for (const auto &pack : packs) {
+            auto [first, last] = pack->bucket(static_cast<unsigned char>(low[0]));
+            for (uint32_t i = first; i < last; ++i) {
+                std::string name(reinterpret_cast<const char *>(pack->names) + static_cast<size_t>(i) * hashSize, hashSize);
+                if (toHex(name).compare(0, prefix.size(), prefix) == 0 &&
+                    std::find(matches.begin(), matches.end(), name) == matches.end())
+                    matches.push_back(name);
+            }
+        }
+        for (const auto &dir : objectDirs) {
+            std::error_code ec;
+            for (const auto &entry : fs::directory_iterator(dir / prefix.substr(0, 2), ec)) {
+                std::string hex = prefix.substr(0, 2) + entry.path().filename().string();
+                if (hex.size() == hashSize * 2 && hex.compare(0, prefix.size(), prefix) == 0) {
+                    std::string name = fromHex(hex);
+                    if (std::find(matches.begin(), matches.end(), name) == matches.end())
+                        matches.push_back(name);
+                }
+            }
+        }
+    }
+
+    ObjectPtr readLoose(const std::string &id) {
+        std::string hex = toHex(id);
+        for (const auto &dir : objectDirs) {
+            std::ifstream in(dir / hex.substr(0, 2) / hex.substr(2), std::ios::binary);
+            if (!in)
+                continue;
+            std::string compressed((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+            std::string raw;
+            if (!inflateData(reinterpret_cast<const unsigned char *>(compressed.data()), compressed.size(), raw, 0))
+                return nullptr;
+            // "<type> <size>\0<data>"
+            size_t space = raw.find(' ');
+            size_t nul = raw.find('\0');
+            if (space == std::string::npos || nul == std::string::npos || space > nul)
+                return nullptr;
+            std::string typeName = raw.substr(0, space);
+            auto object = std::make_shared<GitObject>();
+            object->type = typeName == "commit" ? kCommit : typeName == "tree" ? kTree
+                         : typeName == "blob" ? kBlob : typeName == "tag" ? kTag : 0;
+            object->data = raw.substr(nul + 1);
+            return object->type ? object : nullptr;
+        }
+        return nullptr;
+    }
+
+    /**
+     * Read the object at offset in a pack. Delta chains are followed down to
+     * the first base that is cached or stored whole, then replayed upwards,
+     * caching every intermediate result.
+     */
+    ObjectPtr readPacked(size_t packNumber, uint64_t offset, int depth) {
+        const Pack &pack = *packs[packNumber];
+        const unsigned char *begin = pack.data.data();
+        const unsigned char *end = begin + pack.data.size();
+        auto cacheKey = [packNumber](uint64_t at) { return (static_cast<uint64_t>(packNumber) << 48) | at; };
+
+        std::vector<std::pair<uint64_t, std::string>> deltas; // (offset, delta), outermost first
+        ObjectPtr base;
+        uint64_t current = offset;
+        while (!base) {
+            if ((base = cache.get(cacheKey(current))))
+                break;
+            if (current >= pack.data.size() || deltas.size() > static_cast<size_t>(kMaxDeltaDepth))
+                return nullptr;
+            const unsigned char *p = begin + current;
+            unsigned char c = *p++;
+            int type = (c >> 4) & 7;
+            uint64_t size = c & 15;
+            int shift = 4;
+            while (c & 0x80) {
+                if (p >= end || shift > 57)
+                    return nullptr;
+                c = *p++;
+                size |= static_cast<uint64_t>(c & 0x7F) << shift;
+                shift += 7;
+            }
+
+            uint64_t baseOffset = 0;
+            std::string baseId;
+            if (type == kOfsDelta) {
+                if (p >= end)
+                    return nullptr;
+                c = *p++;
+                uint64_t distance = c & 0x7F;
+                while (c & 0x80) {
+                    if (p >= end)
+                        return nullptr;
+                    c = *p++;
+                    distance = ((distance + 1) << 7) | (c & 0x7F);
+                }
+                if (distance > current)
+                    return nullptr;
+                baseOffset = current - distance;
+            } else if (type == kRefDelta) {
+                if (static_cast<size_t>(end - p) < hashSize)
+                    return nullptr;
+                baseId.assign(reinterpret_cast<const char *>(p), hashSize);
+                p += hashSize;
+            }
+
+            std::string inflated;
+            if (!inflateData(p, static_cast<size_t>(end - p), inflated, static_cast<size_t>(size)))
+                return nullptr;
+            if (type >= kCommit && type <= kTag) {
+                auto object = std::make_shared<GitObject>();
+                object->type = type;
+                object->data = std::move(inflated);
+                base = object;
+                cache.put(cacheKey(current), base);
+                break;
+            }
+            if (type != kOfsDelta && type != kRefDelta)
+                return nullptr;
+            deltas.emplace_back(current, std::move(inflated));
+            if (type == kOfsDelta) {
+                current = baseOffset;
+            } else if (findInPack(pack, baseId, baseOffset)) {
+                current = baseOffset;
+            } else {
+                // The base lives in another pack or is a loose object.
+                if (depth > 8 || !(base = readAny(baseId, depth + 1)))
+                    return nullptr;
+            }
+        }
+
+        for (auto it = deltas.rbegin(); it != deltas.rend(); ++it) {
+            auto object = std::make_shared<GitObject>();
+            object->type = base->type;
+            if (!applyDelta(base->data, it->second, object->data))
+                return nullptr;
+            base = object;
+            cache.put(cacheKey(it->first), base);
+        }
+        return base;
+    }
+
+    ObjectPtr readAny(const std::string &id, int depth) {
+        for (size_t i = 0; i < packs.size(); ++i) {
+            uint64_t offset;
+            if (findInPack(*packs[i], id, offset))
+                return readPacked(i, offset, depth);
+        }
+        return readLoose(id);
+    }
+
+    // The value of a "<field><hex>" header line of a commit or tag.
+    bool headerField(const std::string &data, const std::string &field, std::string &id) const {
+        size_t position = 0;
+        while (position < data.size() && data[position] != '\n') {
+            size_t lineEnd = data.find('\n', position);
+            if (lineEnd == std::string::npos)
+                lineEnd = data.size();
+            if (data.compare(position, field.size(), field) == 0) {
+                std::string hex = data.substr(position + field.size(), lineEnd - position - field.size());
+                if (hex.size() != hashSize * 2 || !isHex(hex))
+                    return false;
+                id = fromHex(hex);
+                return true;
+            }
+            position = lineEnd + 1;
+        }
+        return false;
+    }
+
+    bool parent(const std::string &commit, unsigned n, std::string &result, std::string &error) {
+        std::string id = commit;
+        // Tags in front of the commit are peeled first.
+        for (int depth = 0; depth < 64; ++depth) {
+            ObjectPtr object = read(id);
+            if (!object) {
+                error = "missing object " + toHex(id);
+                return false;
+            }
+            if (object->type == kTag) {
+                if (!headerField(object->data, "object ", id))
+                    break;
+                continue;
+            }
+            if (object->type != kCommit)
+                break;
+            std::string parentId;
+            size_t position = 0;
+            unsigned seen = 0;
+            while (position < object->data.size() && object->data[position] != '\n') {
+                size_t lineEnd = object->data.find('\n', position);
+                if (lineEnd == std::string::npos)
+                    break;
+                if (object->data.compare(position, 7, "parent ") == 0 && ++seen == n) {
+                    result = fromHex(object->data.substr(position + 7, lineEnd - position - 7));
+                    return true;
+                }
+                position = lineEnd + 1;
+            }
+            error = toHex(commit) + " has no parent " + std::to_string(n);
+            return false;
+        }
+        error = toHex(commit) + " is not a commit";
+        return false;
+    }
+
+    // Read a ref from its loose file or packed-refs, following symbolic refs.
+    bool readRef(const std::string &name, std::string &id, int depth) {
+        if (depth > 8)
+            return false;
+        for (const auto &dir : {gitDir, commonDir}) {
+            std::ifstream in(dir / name);
+            std::string line;
+            if (in && std::getline(in, line)) {
+                line = trim(line);
+                if (line.rfind("ref:", 0) == 0)
+                    return readRef(trim(line.substr(4)), id, depth + 1);
+                if (line.size() == hashSize * 2 && isHex(line)) {
+                    id = fromHex(line);
+                    return true;
+                }
+            }
+        }
+        std::ifstream packed(commonDir / "packed-refs");
+        std::string line;
+        while (std::getline(packed, line)) {
+            if (line.empty() || line[0] == '#' || line[0] == '^')
+                continue;
+            size_t space = line.find(' ');
+            if (space == hashSize * 2 && trim(line.substr(space + 1)) == name) {
+                id = fromHex(line.substr(0, space));
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool resolveName(const std::string &name, std::string &id, std::string &error) {
+        if (name.size() == hashSize * 2 && isHex(name)) {
+            std::string lower = name;
+            std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+            id = fromHex(lower);
+            return true;
+        }
+        // The lookup order of `git rev-parse`.
+        for (const std::string &candidate : {name, "refs/" + name, "refs/tags/" + name, "refs/heads/" + name,
+                                             "refs/remotes/" + name, "refs/remotes/" + name + "/HEAD"}) {
+            if (readRef(candidate, id, 0))
+                return true;
+        }
+        if (name.size() >= 4 && name.size() < hashSize * 2 && isHex(name)) {
+            std::string lower = name;
+            std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+            std::vector<std::string> matches;
+            findByPrefix(lower, matches);
+            if (matches.size() == 1) {
+                id = matches[0];
+                return true;
+            }
+            if (matches.size() > 1) {
+                error = "ambiguous object name " + name;
+                return false;
+            }
+        }
+        error = "unknown revision " + name;
+        return false;
+    }
+
+    fs::path gitDir;
+    fs::path commonDir;
+    size_t hashSize;
+    std::vector<fs::path> objectDirs;
+    std::vector<std::unique_ptr<Pack>> packs;
+    BaseCache cache;
+};
+
+// An entry of a tree object.
+struct TreeItem {
+    std::string name;
+    uint32_t mode;
+    std::string id;
+};
+
+bool parseTree(const std::string &data, size_t hashSize, std::vector<TreeItem> &items) {
+    size_t position = 0;
+    while (position < data.size()) {
+        size_t space = data.find(' ', position);
+        size_t nul = space == std::string::npos ? std::string::npos : data.find('\0', space);
+        if (nul == std::string::npos || nul + 1 + hashSize > data.size())
+            return false;
+        TreeItem item;
+        // A corrupt mode makes the tree unreadable rather than throwing.
+        const char *modeEnd = data.data() + space;
+        auto [end, status] = std::from_chars(data.data() + position, modeEnd, item.mode, 8);
+        if (status != std::errc() || end != modeEnd)
+            return false;
+        item.name = data.substr(space + 1, nul - space - 1);
+        item.id = data.substr(nul + 1, hashSize);
+        items.push_back(std::move(item));
+        position = nul + 1 + hashSize;
+    }
+    // Git orders a directory as if its name ended in '/'; the output uses
+    // the plain name order of a directory walk.
+    std::sort(items.begin(), items.end(), [](const TreeItem &a, const TreeItem &b) { return a.name < b.name; });
+    return true;
+}
+
+struct CommitWriter {
+    ObjectStore &store;
+    OutputWriter &out;
+    const fs::path &targetDir;
+    CombineSummary &summary;
+    const CombineOptions &options;
+    // With --dedup, the path first written for each blob id. Identical
+    // contents have the same id, so nothing needs to be hashed.
+    std::unordered_map<std::string, std::string> origins;
+
+    bool writeTree(const std::string &treeId, const std::string &relDir) {
+        ObjectPtr tree = store.read(treeId);
+        std::vector<TreeItem> items;
+        if (!tree || tree->type != kTree || !parseTree(tree->data, store.idSize(), items)) {
+            std::cerr << "Failed to read tree " << toHex(treeId) << "\n";
+            return false;
+        }
+        for (const auto &item : items) {
+            std::string relPath = relDir.empty() ? item.name : relDir + "/" + item.name;
+            uint32_t type = item.mode & 0170000;
+            if (type == 0040000) {
+                if (!writeTree(item.id, relPath))
+                    return false;
+                continue;
+            }
+            // Symlinks and submodules have no file contents to combine.
+            if (type != 0100000 || item.name == ".gitignore" || isOutputArtifact(item.name))
+                continue;
+            ObjectPtr blob = store.read(item.id);
+            if (!blob || blob->type != kBlob) {
+                std::cerr << "Failed to read blob " << toHex(item.id) << " for " << relPath << "\n";
+                continue;
+            }
+            FileEntry file{targetDir / relPath, relPath, blob->data.size(), 0};
+            auto origin = options.dedup ? origins.find(item.id) : origins.end();
+            if (origin != origins.end()) {
+                writeReferenceSegment(out, file, origin->second);
+                summary.deduplicated++;
+                continue;
+            }
+            SegmentStyle style;
+            if (options.minify || options.outline) {
+                style.minify = languageForPath(file.path);
+                style.outline = options.outline;
+            }
+            const SegmentStyle *fileStyle = style.minify != SourceLanguage::None ? &style : nullptr;
+            if (writeBufferSegment(out, file, blob->data.data(), blob->data.size(), fileStyle) == 'B') {
+                summary.binary++;
+            } else {
+                summary.written++;
+                if (options.dedup)
+                    origins.emplace(item.id, file.path.string());
+            }
+        }
+        return true;
+    }
+};
+
+} // namespace
+
+bool combineCommit(const fs::path &targetDir,
+                   const std::string &revision,
+                   const fs::path &outputPath,
+                   CombineSummary &summary,
+                   const CombineOptions &options)
+{
+    fs::path gitDir, workTree;
+    if (!findGitDir(targetDir, gitDir, workTree)) {
+        std::cerr << "Not inside a git repository: " << targetDir << "\n";
+        return false;
+    }
+    ObjectStore store(gitDir);
+    std::string error, commitId, treeId;
+    if (!store.open(error) || !store.resolve(revision, commitId, error) || !store.peelToTree(commitId, treeId, error)) {
+        std::cerr << "Failed to resolve " << revision << ": " << error << "\n";
+        return false;
+    }
+
+    // Descend to the tree corresponding to targetDir.
+    std::error_code ec;
+    std::string prefix = fs::relative(fs::canonical(targetDir, ec), workTree, ec).generic_string();
+    if (!prefix.empty() && prefix != ".") {
+        size_t start = 0;
+        while (start < prefix.size()) {
+            size_t slash = prefix.find('/', start);
+            std::string component = prefix.substr(start, slash == std::string::npos ? std::string::npos : slash - start);
+            start = slash == std::string::npos ? prefix.size() : slash + 1;
+            ObjectPtr tree = store.read(treeId);
+            std::vector<TreeItem> items;
+            if (!tree || !parseTree(tree->data, store.idSize(), items)) {
+                std::cerr << "Failed to read tree " << toHex(treeId) << "\n";
+                return false;
+            }
+            auto it = std::find_if(items.begin(), items.end(), [&](const TreeItem &item) {
+                return item.name == component && (item.mode & 0170000) == 0040000;
+            });
+            if (it == items.end()) {
+                std::cerr << prefix << " does not exist in " << revision << "\n";
+                return false;
+            }
+            treeId = it->id;
+        }
+    }
+
+    OutputWriter out;
+    if (!out.open(outputPath)) {
+        std::cerr << "Failed to create output file " << outputPath << "\n";
+        return false;
+    }
+    out.write(options.banner);
+    CommitWriter writer{store, out, targetDir, summary, options, {}};
+    bool ok = writer.writeTree(treeId, "");
+    if (!out.close() || !ok) {
+        std::cerr << "Failed to write output file " << outputPath << "\n";
+        return false;
+    }
+    return true;
+}
+
+#else
+
+bool combineCommit(const fs::path &, const std::string &, const fs::path &, CombineSummary &,
+                   const CombineOptions &) {
+    std::cerr << "Reading commits requires zlib; rebuild with zlib available\n";
+    return false;
+}
+
+#endif
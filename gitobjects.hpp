@@ -0,0 +1,23 @@
+#pragma once
+
+#include <filesystem>
+#include <string>
+
+#include "compressor.hpp"
+
+namespace fs = std::filesystem;
+
+/**
+ * Combine the files of a commit into outputPath without checking it out.
+ * revision is resolved in the repository containing targetDir (a full or
+ * abbreviated object name, HEAD, a branch or tag, optionally followed by
+ * `~N` or `^`), and the blobs below targetDir are read directly from loose
+ * objects and packfiles. Paths in the output are written as if the commit
+ * were checked out at targetDir. options.minify, outline and dedup apply
+ * as in combineFiles (dedup by blob id); nearDup and boilerplate do not.
+ */
+bool combineCommit(const fs::path &targetDir,
+                   const std::string &revision,
+                   const fs::path &outputPath,
+                   CombineSummary &summary,
+                   const CombineOptions &options = CombineOptions());
@@ -0,0 +1,258 @@
+#include "hash.hpp"
+
+#include <cstring>
+
+namespace {
+
+const uint64_t kPrime1 = 0x9E3779B185EBCA87ULL;
+const uint64_t kPrime2 = 0xC2B2AE3D27D4EB4FULL;
+const uint64_t kPrime3 = 0x165667B19E3779F9ULL;
+const uint64_t kPrime4 = 0x85EBCA77C2B2AE63ULL;
+const uint64_t kPrime5 = 0x27D4EB2F165667C5ULL;
+
+inline uint64_t rotl(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+inline uint64_t read64(const unsigned char *p) {
+    uint64_t v;
+    std::memcpy(&v, p, sizeof(v)); // xxHash is defined on little-endian input.
+    return v;
+}
+
+inline uint32_t read32(const unsigned char *p) {
+    uint32_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+inline uint64_t round(uint64_t acc, uint64_t input) {
+    acc += input * kPrime2;
+    acc = rotl(acc, 31);
+    return acc * kPrime1;
+}
+
+inline uint64_t mergeRound(uint64_t acc, uint64_t value) {
+    acc ^= round(0, value);
+    return acc * kPrime1 + kPrime4;
+}
+
+inline uint32_t rotl32(uint32_t x, int r) {
+    return (x << r) | (x >> (32 - r));
+}
+
+inline uint32_t readBE32(const unsigned char *p) {
+    return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | uint32_t(p[3]);
+}
+
+// The Merkle-Damgard padding shared by SHA-1 and SHA-256: compress is
+// called on every 64-byte block of the input, followed by 0x80, zeros and
+// the length in bits (big-endian) to fill the last block or two.
+template <typename Compress>
+void compressPadded(const unsigned char *p, size_t size, Compress compress) {
+    size_t full = size & ~size_t(63);
+    for (size_t at = 0; at < full; at += 64)
+        compress(p + at);
+    unsigned char tail[128] = {};
+    size_t rest = size - full;
+    std::memcpy(tail, p + full, rest);
+    tail[rest] = 0x80;
+    size_t tailSize = rest < 56 ? 64 : 128;
+    uint64_t bits = static_cast<uint64_t>(size) * 8;
+    for (int i = 0; i < 8; ++i)
+        tail[tailSize - 1 - i] = static_cast<unsigned char>(bits >> (8 * i));
+    compress(tail);
+    if (tailSize == 128)
+        compress(tail + 64);
+}
+
+void writeBE32(uint32_t value, unsigned char *p) {
+    p[0] = static_cast<unsigned char>(value >> 24);
+    p[1] = static_cast<unsigned char>(value >> 16);
+    p[2] = static_cast<unsigned char>(value >> 8);
+    p[3] = static_cast<unsigned char>(value);
+}
+
+const uint32_t kSha256Rounds[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+} // namespace
+
+Hasher64::Hasher64(uint64_t seed) : seed(seed) {
+    acc[0] = seed + kPrime1 + kPrime2;
+    acc[1] = seed + kPrime2;
+    acc[2] = seed;
+    acc[3] = seed - kPrime1;
+}
+
+void Hasher64::update(const void *data, size_t size) {
+    const unsigned char *p = static_cast<const unsigned char *>(data);
+    const unsigned char *end = p + size;
+    totalSize += size;
+
+    if (pendingSize + size < 32) {
+        std::memcpy(pending + pendingSize, p, size);
+        pendingSize += size;
+        return;
+    }
+    if (pendingSize > 0) {
+        size_t fill = 32 - pendingSize;
+        std::memcpy(pending + pendingSize, p, fill);
+        for (int i = 0; i < 4; ++i)
+            acc[i] = round(acc[i], read64(pending + 8 * i));
+        p += fill;
+        pendingSize = 0;
+    }
+    // Consume full 32-byte stripes directly from the input.
+    uint64_t v1 = acc[0], v2 = acc[1], v3 = acc[2], v4 = acc[3];
+    while (end - p >= 32) {
+        v1 = round(v1, read64(p));
+        v2 = round(v2, read64(p + 8));
+        v3 = round(v3, read64(p + 16));
+        v4 = round(v4, read64(p + 24));
+        p += 32;
+    }
+    acc[0] = v1; acc[1] = v2; acc[2] = v3; acc[3] = v4;
+    pendingSize = static_cast<size_t>(end - p);
+    std::memcpy(pending, p, pendingSize);
+}
+
+uint64_t Hasher64::digest() const {
+    uint64_t h;
+    if (totalSize >= 32) {
+        h = rotl(acc[0], 1) + rotl(acc[1], 7) + rotl(acc[2], 12) + rotl(acc[3], 18);
+        for (int i = 0; i < 4; ++i)
+            h = mergeRound(h, acc[i]);
+    } else {
+        h = seed + kPrime5;
+    }
+    h += totalSize;
+
+    const unsigned char *p = pending;
+    const unsigned char *end = pending + pendingSize;
+    while (end - p >= 8) {
+        h ^= round(0, read64(p));
+        h = rotl(h, 27) * kPrime1 + kPrime4;
+        p += 8;
+    }
+    if (end - p >= 4) {
+        h ^= static_cast<uint64_t>(read32(p)) * kPrime1;
+        h = rotl(h, 23) * kPrime2 + kPrime3;
+        p += 4;
+    }
+    while (p < end) {
+        h ^= (*p++) * kPrime5;
+        h = rotl(h, 11) * kPrime1;
+    }
+    h ^= h >> 33;
+    h *= kPrime2;
+    h ^= h >> 29;
+    h *= kPrime3;
+    h ^= h >> 32;
+    return h;
+}
+
+uint64_t hash64(const void *data, size_t size, uint64_t seed) {
+    Hasher64 hasher(seed);
+    hasher.update(data, size);
+    return hasher.digest();
+}
+
+std::string hashToHex(uint64_t hash) {
+    static const char digits[] = "0123456789abcdef";
+    std::string text(16, '0');
+    for (int i = 15; i >= 0; --i) {
+        text[i] = digits[hash & 0xF];
+        hash >>= 4;
+    }
+    return text;
+}
+
+bool hashFromHex(const std::string &text, uint64_t &hash) {
+    if (text.size() != 16)
+        return false;
+    hash = 0;
+    for (char c : text) {
+        int digit = c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10 : -1;
+        if (digit < 0)
+            return false;
+        hash = (hash << 4) | static_cast<uint64_t>(digit);
+    }
+    return true;
+}
+
+void sha1(const void *data, size_t size, unsigned char *digest) {
+    uint32_t h[5] = {0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0};
+    compressPadded(static_cast<const unsigned char *>(data), size, [&](const unsigned char *block) {
+        uint32_t w[80];
+        for (int i = 0; i < 16; ++i)
+            w[i] = readBE32(block + 4 * i);
+        for (int i = 16; i < 80; ++i)
+            w[i] = rotl32(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+        uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+        for (int i = 0; i < 80; ++i) {
+            uint32_t f, k;
+            if (i < 20) {
+                f = (b & c) | (~b & d);
+                k = 0x5A827999;
+            } else if (i < 40) {
+                f = b ^ c ^ d;
+                k = 0x6ED9EBA1;
+            } else if (i < 60) {
+                f = (b & c) | (b & d) | (c & d);
+                k = 0x8F1BBCDC;
+            } else {
+                f = b ^ c ^ d;
+                k = 0xCA62C1D6;
+            }
+            uint32_t t = rotl32(a, 5) + f + e + k + w[i];
+            e = d;
+            d = c;
+            c = rotl32(b, 30);
+            b = a;
+            a = t;
+        }
+        h[0] += a; h[1] += b; h[2] += c; h[3] += d; h[4] += e;
+    });
+    for (int i = 0; i < 5; ++i)
+        writeBE32(h[i], digest + 4 * i);
+}
+
+void sha256(const void *data, size_t size, unsigned char *digest) {
+    uint32_t h[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+    auto rotr = [](uint32_t x, int r) { return (x >> r) | (x << (32 - r)); };
+    compressPadded(static_cast<const unsigned char *>(data), size, [&](const unsigned char *block) {
+        uint32_t w[64];
+        for (int i = 0; i < 16; ++i)
+            w[i] = readBE32(block + 4 * i);
+        for (int i = 16; i < 64; ++i) {
+            uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+            uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+        uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4], f = h[5], g = h[6], k = h[7];
+        for (int i = 0; i < 64; ++i) {
+            uint32_t t1 = k + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) + ((e & f) ^ (~e & g)) + kSha256Rounds[i] + w[i];
+            uint32_t t2 = (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+            k = g;
+            g = f;
+            f = e;
+            e = d + t1;
+            d = c;
+            c = b;
+            b = a;
+            a = t1 + t2;
+        }
+        h[0] += a; h[1] += b; h[2] += c; h[3] += d; h[4] += e; h[5] += f; h[6] += g; h[7] += k;
+    });
+    for (int i = 0; i < 8; ++i)
+        writeBE32(h[i], digest + 4 * i);
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/**
+ * Streaming 64-bit xxHash (XXH64). Fast, non-cryptographic; used to identify
+ * file contents while they are being copied.
+ */
+class Hasher64 {
+public:
+    explicit Hasher64(uint64_t seed = 0);
+
+    void update(const void *data, size_t size);
+    uint64_t digest() const;
+
+private:
+    uint64_t acc[4];
+    uint64_t seed;
+    uint64_t totalSize = 0;
+    unsigned char pending[32];
+    size_t pendingSize = 0;
+};
+
+/**
+ * One-shot XXH64 of a buffer.
+ */
+uint64_t hash64(const void *data, size_t size, uint64_t seed = 0);
+
+/**
+ * Format a hash as 16 lowercase hex digits, and parse it back.
+ */
+std::string hashToHex(uint64_t hash);
+bool hashFromHex(const std::string &text, uint64_t &hash);
+
+/**
+ * One-shot SHA-1 and SHA-256 of a buffer, for the checksums git stores at
+ * the end of its index and pack files. digest receives 20 and 32 bytes.
+ */
+void sha1(const void *data, size_t size, unsigned char *digest);
+void sha256(const void *data, size_t size, unsigned char *digest);
@@ -0,0 +1,77 @@
+#include "inodeset.hpp"
+
+namespace {
+
+const size_t kInitialSlots = 64;
+
+uint64_t mix(uint64_t dev, uint64_t ino) {
+    // The finalizer of SplitMix64; inode numbers are often sequential.
+    uint64_t x = ino ^ (dev * 0x9E3779B97F4A7C15ULL);
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+} // namespace
+
+size_t InodeSet::slotFor(uint64_t dev, uint64_t ino) const {
+    size_t mask = slots.size() - 1;
+    size_t index = static_cast<size_t>(mix(dev, ino)) & mask;
+    while (slots[index].ino != 0 && (slots[index].ino != ino || slots[index].dev != dev))
+        index = (index + 1) & mask;
+    return index;
+}
+
+bool InodeSet::insert(uint64_t dev, uint64_t ino) {
+    if (ino == 0)
+        return false;
+    if ((count + 1) * 2 > slots.size())
+        grow();
+    size_t index = slotFor(dev, ino);
+    if (slots[index].ino != 0)
+        return false;
+    slots[index] = {dev, ino};
+    count++;
+    return true;
+}
+
+bool InodeSet::contains(uint64_t dev, uint64_t ino) const {
+    if (ino == 0 || slots.empty())
+        return false;
+    return slots[slotFor(dev, ino)].ino != 0;
+}
+
+bool InodeSet::erase(uint64_t dev, uint64_t ino) {
+    if (ino == 0 || slots.empty())
+        return false;
+    size_t mask = slots.size() - 1;
+    size_t hole = slotFor(dev, ino);
+    if (slots[hole].ino == 0)
+        return false;
+    // Backward shift: move later slots of the probe run into the hole unless
+    // that would put them before their home slot, so no tombstones are needed.
+    for (size_t next = (hole + 1) & mask; slots[next].ino != 0; next = (next + 1) & mask) {
+        size_t home = static_cast<size_t>(mix(slots[next].dev, slots[next].ino)) & mask;
+        if (((next - home) & mask) >= ((next - hole) & mask)) {
+            slots[hole] = slots[next];
+            hole = next;
+        }
+    }
+    slots[hole] = {0, 0};
+    count--;
+    return true;
+}
+
+void InodeSet::clear() {
+    slots.clear();
+    count = 0;
+}
+
+void InodeSet::grow() {
+    std::vector<Slot> old = std::move(slots);
+    slots.assign(old.empty() ? kInitialSlots : old.size() * 2, Slot{0, 0});
+    for (const auto &slot : old) {
+        if (slot.ino != 0)
+            slots[slotFor(slot.dev, slot.ino)] = slot;
+    }
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * Set of (st_dev, st_ino) pairs identifying physical files. Open addressing
+ * with linear probing over a flat array of 16-byte slots, kept at most half
+ * full; inode 0 marks an empty slot, so it cannot be stored.
+ */
+class InodeSet {
+public:
+    /**
+     * Add a file. Returns false if it was already present (or ino is 0).
+     */
+    bool insert(uint64_t dev, uint64_t ino);
+    bool contains(uint64_t dev, uint64_t ino) const;
+
+    /**
+     * Remove a file. Returns false if it was not present.
+     */
+    bool erase(uint64_t dev, uint64_t ino);
+
+    size_t size() const { return count; }
+    void clear();
+
+private:
+    struct Slot {
+        uint64_t dev;
+        uint64_t ino;
+    };
+
+    size_t slotFor(uint64_t dev, uint64_t ino) const;
+    void grow();
+
+    std::vector<Slot> slots;
+    size_t count = 0;
+};
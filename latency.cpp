@@ -0,0 +1,141 @@
+#include "latency.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+bool latencyEnabled = false;
+
+namespace {
+
+const char *kOpNames[kLatencyOps] = {"open", "stat", "readdir", "read", "write"};
+
+const double kQuantiles[] = {0.5, 0.9, 0.99, 0.999};
+const char *kQuantileNames[] = {"p50", "p90", "p99", "p999"};
+
+struct ThreadHistograms {
+    LatencyHistogram ops[kLatencyOps];
+};
+
+std::mutex histogramsMutex;
+std::vector<std::unique_ptr<ThreadHistograms>> histograms; // Outlive their threads.
+thread_local ThreadHistograms *threadHistograms = nullptr;
+
+// The histograms of all threads added up.
+ThreadHistograms mergedHistograms() {
+    ThreadHistograms merged;
+    std::lock_guard<std::mutex> lock(histogramsMutex);
+    for (const auto &thread : histograms) {
+        for (int op = 0; op < kLatencyOps; ++op)
+            merged.ops[op].add(thread->ops[op]);
+    }
+    return merged;
+}
+
+} // namespace
+
+void LatencyHistogram::add(const LatencyHistogram &other) {
+    for (int i = 0; i < kBuckets; ++i)
+        counts[i] += other.counts[i];
+    total += other.total;
+    sum += other.sum;
+    max = std::max(max, other.max);
+}
+
+uint64_t LatencyHistogram::bucketLimit(int bucket) {
+    if (bucket < kSubBuckets)
+        return static_cast<uint64_t>(bucket);
+    int exponent = bucket / kSubBuckets + 3;
+    uint64_t step = uint64_t(1) << (exponent - 4);
+    uint64_t lower = (uint64_t(1) << exponent) + static_cast<uint64_t>(bucket % kSubBuckets) * step;
+    return lower + (step - 1);
+}
+
+uint64_t LatencyHistogram::percentile(double q) const {
+    if (total == 0)
+        return 0;
+    // The rank of the sample sought, from 1.
+    uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(q * static_cast<double>(total) + 0.5));
+    uint64_t seen = 0;
+    for (int i = 0; i < kBuckets; ++i) {
+        seen += counts[i];
+        if (seen >= rank)
+            return std::min(bucketLimit(i), max);
+    }
+    return max;
+}
+
+void enableLatency() {
+    latencyEnabled = true;
+}
+
+void recordLatency(LatencyOp op, uint64_t ns) {
+    if (!threadHistograms) {
+        std::lock_guard<std::mutex> lock(histogramsMutex);
+        histograms.push_back(std::make_unique<ThreadHistograms>());
+        threadHistograms = histograms.back().get();
+    }
+    threadHistograms->ops[static_cast<int>(op)].record(ns);
+}
+
+void printLatencies(std::ostream &out) {
+    ThreadHistograms merged = mergedHistograms();
+    char line[160];
+    std::snprintf(line, sizeof(line), "%-14s %10s %10s %10s %10s %10s %10s %10s\n", "Latency us", "Count", "Mean",
+                  "p50", "p90", "p99", "p99.9", "Max");
+    out << line;
+    for (int op = 0; op < kLatencyOps; ++op) {
+        const LatencyHistogram &histogram = merged.ops[op];
+        if (histogram.count() == 0)
+            continue;
+        std::snprintf(line, sizeof(line), "%-14s %10llu %10.1f %10.1f %10.1f %10.1f %10.1f %10.1f\n", kOpNames[op],
+                      static_cast<unsigned long long>(histogram.count()), histogram.mean() / 1000.0,
+                      histogram.percentile(0.5) / 1000.0, histogram.percentile(0.9) / 1000.0,
+                      histogram.percentile(0.99) / 1000.0, histogram.percentile(0.999) / 1000.0,
+                      histogram.maximum() / 1000.0);
+        out << line;
+    }
+}
+
+bool writeLatencyJson(const fs::path &path) {
+    std::ofstream out(path, std::ios::out | std::ios::binary);
+    if (!out) {
+        std::cerr << "Failed to create " << path << "\n";
+        return false;
+    }
+    ThreadHistograms merged = mergedHistograms();
+    out << "{\"unit\":\"ns\",\"operations\":{";
+    bool firstOp = true;
+    for (int op = 0; op < kLatencyOps; ++op) {
+        const LatencyHistogram &histogram = merged.ops[op];
+        if (histogram.count() == 0)
+            continue;
+        out << (firstOp ? "\n" : ",\n") << "\"" << kOpNames[op] << "\":{\"count\":" << histogram.count()
+            << ",\"mean\":" << static_cast<uint64_t>(histogram.mean());
+        for (size_t q = 0; q < std::size(kQuantiles); ++q)
+            out << ",\"" << kQuantileNames[q] << "\":" << histogram.percentile(kQuantiles[q]);
+        out << ",\"max\":" << histogram.maximum() << ",\"buckets\":[";
+        // Non-empty buckets as [highest value, count].
+        bool firstBucket = true;
+        for (int i = 0; i < LatencyHistogram::kBuckets; ++i) {
+            if (histogram.bucketCount(i) == 0)
+                continue;
+            out << (firstBucket ? "" : ",") << "[" << LatencyHistogram::bucketLimit(i) << ","
+                << histogram.bucketCount(i) << "]";
+            firstBucket = false;
+        }
+        out << "]}";
+        firstOp = false;
+    }
+    out << "\n}}\n";
+    if (!out) {
+        std::cerr << "Failed to write " << path << "\n";
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <bit>
+#include <cstdint>
+#include <filesystem>
+#include <iosfwd>
+
+namespace fs = std::filesystem;
+
+// I/O operations whose latencies are recorded for --latency.
+enum class LatencyOp { Open, Stat, ReadDir, Read, Write };
+const int kLatencyOps = static_cast<int>(LatencyOp::Write) + 1;
+
+/**
+ * Log-bucketed histogram of durations in the style of HdrHistogram: values
+ * below 16 ns have a bucket each, and every power of two above is split
+ * into 16 buckets, so a value is known to within 1/16 (about 6%) of itself
+ * over the whole range of uint64_t. Recording is a few instructions.
+ */
+class LatencyHistogram {
+public:
+    static const int kSubBuckets = 16;
+    static const int kBuckets = 61 * kSubBuckets;
+
+    void record(uint64_t ns) {
+        counts[bucketOf(ns)]++;
+        total++;
+        sum += ns;
+        if (ns > max)
+            max = ns;
+    }
+
+    void add(const LatencyHistogram &other);
+
+    /**
+     * The value below which a fraction q of the samples lie: the highest
+     * value of the bucket holding that sample, capped at the maximum.
+     */
+    uint64_t percentile(double q) const;
+
+    uint64_t count() const { return total; }
+    uint64_t maximum() const { return max; }
+    double mean() const { return total ? static_cast<double>(sum) / static_cast<double>(total) : 0; }
+
+    static int bucketOf(uint64_t ns) {
+        if (ns < kSubBuckets)
+            return static_cast<int>(ns);
+        int exponent = std::bit_width(ns) - 1; // At least 4.
+        return (exponent - 3) * kSubBuckets + static_cast<int>((ns >> (exponent - 4)) & (kSubBuckets - 1));
+    }
+
+    // Highest value that falls into bucket.
+    static uint64_t bucketLimit(int bucket);
+
+    uint64_t bucketCount(int bucket) const { return counts[bucket]; }
+
+private:
+    uint64_t counts[kBuckets] = {};
+    uint64_t total = 0;
+    uint64_t sum = 0;
+    uint64_t max = 0;
+};
+
+// Set once, before any work starts, by enableLatency.
+extern bool latencyEnabled;
+
+void enableLatency();
+
+/**
+ * Add a sample to the histogram of op kept by the calling thread; the
+ * histograms of all threads are added up when reported.
+ */
+void recordLatency(LatencyOp op, uint64_t ns);
+
+/**
+ * Write count, mean and percentiles (p50, p90, p99, p99.9, max) of every
+ * operation that was recorded to out.
+ */
+void printLatencies(std::ostream &out);
+
+/**
+ * Write the same figures and the non-empty buckets of every histogram to
+ * path as JSON.
+ */
+bool writeLatencyJson(const fs::path &path);
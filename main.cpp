@@ -1,267 +1,535 @@
+#include <cstdlib>
+#include <cstdio>
 #include <iostream>
-#include <fstream>
+#include <optional>
+#include <sstream>
 #include <filesystem>
-#include <vector>
 #include <string>
-#include <regex>
-#include <sstream>
-#include <optional>
-#include <algorithm>
+
+#include "budget.hpp"
+#include "compressor.hpp"
+#include "daemon.hpp"
+#include "gitignore.hpp"
+#include "gitindex.hpp"
+#include "gitobjects.hpp"
+#include "hash.hpp"
+#include "latency.hpp"
+#include "manifest.hpp"
+#include "merkle.hpp"
+#include "perfcounters.hpp"
+#include "progress.hpp"
+#include "shard.hpp"
+#include "stats.hpp"
+#include "trace.hpp"
+#include "watch.hpp"
 
 namespace fs = std::filesystem;
 
-// A structure representing a single .gitignore rule.
-struct GitIgnoreRule {
-    std::regex patternRegex; // The pattern converted to a regex.
-    bool negate = false;     // True if the rule starts with '!'
-    bool directoryOnly = false; // True if the pattern ends with '/'
-    bool anchored = false;      // True if the pattern starts with '/'
-    std::string originalPattern; // The original pattern text.
+// Command line options.
+struct Options {
+    fs::path targetDir;
+    bool incremental = false; // Reuse unchanged segments of the previous output.
+    bool trustDirMtime = false; // Skip listing directories whose mtime is unchanged.
+    bool gitIndex = false;    // Take the file list from .git/index.
+    bool untracked = false;   // With gitIndex, also add untracked files that are not ignored.
+    std::string commit;       // Combine the files of this revision instead of the work tree.
+    std::optional<std::vector<std::string>> prunedNames; // Replaces the default VCS prune set.
+    SymlinkPolicy symlinks = SymlinkPolicy::FollowOnce;
+    CombineOptions combine;
+    BudgetOptions budget;
+    ShardLimits shards;       // Split the output into shards within these limits.
+    ShardPart part;           // Only combine this part of the tree (--shard).
+    bool merge = false;       // Merge the outputs of parts instead (--merge).
+    std::vector<fs::path> mergeInputs;
+    bool watch = false;       // Keep the output up to date until interrupted.
+    WatchOptions watchOptions;
+    fs::path daemonSocket;    // Serve requests on this socket (--daemon).
+    fs::path connectSocket;   // Send a request to a daemon (--connect).
+    DaemonRequest request;
+    bool stats = false;       // Report timings and counters at the end (--stats).
+    fs::path tracePath;       // Write a timeline of the run here (--trace).
+    bool latency = false;     // Report I/O latency percentiles at the end (--latency).
+    fs::path latencyJsonPath; // Also write the histograms here (--latency-json).
+    bool perfCounters = false; // Report hardware counters per step (--perf-counters).
+    std::optional<ProgressStyle> progress; // Report progress while running.
 };
 
-// Utility: trim whitespace.
-std::string trim(const std::string &s) {
-    const char* ws = " \t\r\n";
-    size_t start = s.find_first_not_of(ws);
-    if (start == std::string::npos)
-        return "";
-    size_t end = s.find_last_not_of(ws);
-    return s.substr(start, end - start + 1);
+void printUsage(const char *program) {
+    std::cerr << "Usage: " << program << " [options] <directory_path>\n"
+              << "       " << program << " --connect <socket> [--subtree <path>] [--filter <glob>]\n"
+              << "       " << program << " --merge [<part>...]\n"
+              << "Options:\n"
+              << "  --incremental   Only regenerate the segments of changed files, using\n"
+              << "                  the manifest written next to combined.txt\n"
+              << "  --trust-dir-mtime  With --incremental, do not list directories whose mtime\n"
+              << "                  is unchanged; files rewritten in place are not noticed there.\n"
+              << "                  Only with --symlinks skip\n"
+              << "  --dedup         Write files identical to an earlier file as a reference\n"
+              << "  --near-dup      Write files similar to an earlier file (SimHash) as a reference\n"
+              << "  --boilerplate   Write leading comment blocks shared by several files (such\n"
+              << "                  as license headers) once, at the top of the output\n"
+              << "  --minify        Strip comments, trailing whitespace and extra blank lines\n"
+              << "                  from C/C++, Python, JS/TS, Java, Go and shell files\n"
+              << "  --outline       Like --minify, and also leave out function bodies\n"
+              << "  --budget TOKENS Only combine the files that fit in about TOKENS tokens\n"
+              << "  --prefer GLOB   With --budget, take files matching GLOB first (repeatable;\n"
+              << "                  earlier patterns go first)\n"
+              << "  --rank ORDER    With --budget, order files of equal preference by path\n"
+              << "                  (default), recent (newest first) or small (smallest first)\n"
+              << "  --shard-bytes SIZE  Split the output into combined.001.txt, combined.002.txt,\n"
+              << "                  ... of at most SIZE bytes each (suffixes K, M, G)\n"
+              << "  --shard-tokens COUNT  Split the output into shards of about COUNT tokens\n"
+              << "                  each (suffixes k, m)\n"
+              << "  --shard I/N     Only combine part I of N of the tree, chosen the same way by\n"
+              << "                  every run, into combined.I-of-N.txt\n"
+              << "  --shard-by UNIT With --shard, assign top-level subtrees (subtree, default)\n"
+              << "                  or single files (file) to parts\n"
+              << "  --merge         Merge the outputs of --shard runs (the parts given, or all\n"
+              << "                  combined.I-of-N.txt here) into combined.txt\n"
+              << "  --stats         Report time per phase, counters and throughput at the end\n"
+              << "  --trace FILE    Write a timeline of the run to FILE as Chrome trace-event\n"
+              << "                  JSON (open it in Perfetto or chrome://tracing)\n"
+              << "  --latency       Report latency percentiles of open, stat, readdir, read and\n"
+              << "                  write at the end\n"
+              << "  --latency-json FILE  Like --latency, and write the histograms to FILE as JSON\n"
+              << "  --perf-counters Report CPU cycles, instructions, cache and branch misses,\n"
+              << "                  page faults and context switches per step (Linux)\n"
+              << "  --progress      Show a status line with files handled, rate and time left\n"
+              << "  --progress-json Print progress as one JSON object per line, every second\n"
+              << "  --git-index     Combine the files tracked in .git/index instead of walking\n"
+              << "                  the tree (tracked files bypass the ignore rules)\n"
+              << "  --untracked     With --git-index, also add untracked files that are not ignored\n"
+              << "  --commit REV    Combine the files of a commit, read from the object store\n"
+              << "  --prune NAMES   Comma-separated names never descended into or listed\n"
+              << "                  (default .git,.hg,.svn; an empty list disables pruning)\n"
+              << "  --symlinks MODE skip, follow-once (default: each physical file and directory\n"
+              << "                  is included once) or follow (only cycles are cut)\n"
+              << "  --watch         Keep combined.txt up to date as files change (Linux)\n"
+              << "  --debounce MS   Quiet period before a burst of changes is applied (default 200)\n"
+              << "  --daemon SOCKET Keep the tree index in memory and serve requests on a\n"
+              << "                  Unix domain socket (Linux)\n"
+              << "  --connect SOCKET  Request output from a daemon and write it to stdout\n"
+              << "  --subtree PATH  With --connect, only combine files below PATH\n"
+              << "  --filter GLOB   With --connect, only combine files matching GLOB\n";
 }
 
-/**
- * Convert a .gitignore pattern into a regex string.
- * This implementation handles:
- *   - Leading '/' (anchored) by prefixing the regex with '^'
- *   - Trailing '/' (directoryOnly) by forcing a match to the end.
- *   - '*' matches any characters except '/'
- *   - '**' matches any characters (including '/')
- *   - '?' matches any single character except '/'
- *
- * This conversion is a best‐effort approximation and does not cover all edge cases.
- */
-std::string patternToRegex(const std::string &pattern, bool anchored) {
-    std::ostringstream oss;
-    if (anchored)
-        oss << "^";
+// A count with an optional K, M or G suffix (powers of unit); 0 if invalid.
+uint64_t parseCount(const std::string &text, uint64_t unit) {
+    char *end = nullptr;
+    uint64_t value = std::strtoull(text.c_str(), &end, 10);
+    if (end == text.c_str())
+        return 0;
+    std::string suffix = end;
+    if (suffix == "k" || suffix == "K")
+        return value * unit;
+    if (suffix == "m" || suffix == "M")
+        return value * unit * unit;
+    if (suffix == "g" || suffix == "G")
+        return value * unit * unit * unit;
+    return suffix.empty() ? value : 0;
+}
 
-    for (size_t i = 0; i < pattern.size(); ++i) {
-        char c = pattern[i];
-        if (c == '*') {
-            // Check for a double star.
-            if (i + 1 < pattern.size() && pattern[i+1] == '*') {
-                oss << ".*";
-                ++i;
+bool parseOptions(int argc, char* argv[], Options &options) {
+    std::vector<std::string> arguments;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--incremental") {
+            options.incremental = true;
+        } else if (arg == "--trust-dir-mtime") {
+            options.incremental = true;
+            options.trustDirMtime = true;
+        } else if (arg == "--dedup") {
+            options.combine.dedup = true;
+        } else if (arg == "--near-dup") {
+            options.combine.nearDup = true;
+        } else if (arg == "--boilerplate") {
+            options.combine.boilerplate = true;
+        } else if (arg == "--minify") {
+            options.combine.minify = true;
+        } else if (arg == "--outline") {
+            options.combine.outline = true;
+        } else if (arg == "--budget" && i + 1 < argc) {
+            options.budget.maxTokens = std::strtoull(argv[++i], nullptr, 10);
+            if (options.budget.maxTokens == 0) {
+                std::cerr << "Invalid token budget: " << argv[i] << "\n";
+                return false;
+            }
+        } else if (arg == "--prefer" && i + 1 < argc) {
+            auto rule = parseGitIgnoreLine(argv[++i]);
+            if (!rule) {
+                std::cerr << "Invalid pattern: " << argv[i] << "\n";
+                return false;
+            }
+            options.budget.prefer.push_back(std::move(*rule));
+        } else if (arg == "--rank" && i + 1 < argc) {
+            std::string order = argv[++i];
+            if (order == "path") {
+                options.budget.order = BudgetOrder::Path;
+            } else if (order == "recent") {
+                options.budget.order = BudgetOrder::Recent;
+            } else if (order == "small") {
+                options.budget.order = BudgetOrder::Small;
             } else {
-                oss << "[^/]*";
+                std::cerr << "Unknown rank order: " << order << "\n";
+                return false;
+            }
+        } else if ((arg == "--shard-bytes" || arg == "--shard-tokens") && i + 1 < argc) {
+            bool bytes = arg == "--shard-bytes";
+            uint64_t limit = parseCount(argv[++i], bytes ? 1024 : 1000);
+            if (limit == 0) {
+                std::cerr << "Invalid shard limit: " << argv[i] << "\n";
+                return false;
             }
-        } else if (c == '?') {
-            oss << "[^/]";
-        } else if (c == '.') {
-            oss << "\\.";
-        } else if (c == '+') {
-            oss << "\\+";
-        } else if (c == '(' || c == ')' || c == '|' || c == '^' || c == '$' || c == '{' || c == '}' || c == '[' || c == ']') {
-            oss << "\\" << c;
+            (bytes ? options.shards.maxBytes : options.shards.maxTokens) = limit;
+        } else if (arg == "--shard" && i + 1 < argc) {
+            unsigned long index = 0, count = 0;
+            int consumed = 0;
+            std::string value = argv[++i];
+            if (std::sscanf(value.c_str(), "%lu/%lu%n", &index, &count, &consumed) != 2 ||
+                static_cast<size_t>(consumed) != value.size() || index == 0 || index > count) {
+                std::cerr << "Invalid shard: " << value << " (expected I/N with 1 <= I <= N)\n";
+                return false;
+            }
+            options.part.index = index;
+            options.part.count = count;
+        } else if (arg == "--shard-by" && i + 1 < argc) {
+            std::string unit = argv[++i];
+            if (unit == "subtree") {
+                options.part.bySubtree = true;
+            } else if (unit == "file") {
+                options.part.bySubtree = false;
+            } else {
+                std::cerr << "Unknown shard unit: " << unit << "\n";
+                return false;
+            }
+        } else if (arg == "--merge") {
+            options.merge = true;
+        } else if (arg == "--stats") {
+            options.stats = true;
+        } else if (arg == "--trace" && i + 1 < argc) {
+            options.tracePath = argv[++i];
+        } else if (arg == "--progress") {
+            options.progress = ProgressStyle::Line;
+        } else if (arg == "--progress-json") {
+            options.progress = ProgressStyle::Json;
+        } else if (arg == "--perf-counters") {
+            options.perfCounters = true;
+        } else if (arg == "--latency") {
+            options.latency = true;
+        } else if (arg == "--latency-json" && i + 1 < argc) {
+            options.latency = true;
+            options.latencyJsonPath = argv[++i];
+        } else if (arg == "--git-index") {
+            options.gitIndex = true;
+        } else if (arg == "--untracked") {
+            options.gitIndex = true;
+            options.untracked = true;
+        } else if (arg == "--commit" && i + 1 < argc) {
+            options.commit = argv[++i];
+        } else if (arg == "--prune" && i + 1 < argc) {
+            std::vector<std::string> names;
+            std::istringstream list(argv[++i]);
+            std::string name;
+            while (std::getline(list, name, ',')) {
+                if (!name.empty())
+                    names.push_back(name);
+            }
+            options.prunedNames = std::move(names);
+        } else if (arg == "--symlinks" && i + 1 < argc) {
+            std::string mode = argv[++i];
+            if (mode == "skip") {
+                options.symlinks = SymlinkPolicy::Skip;
+            } else if (mode == "follow-once") {
+                options.symlinks = SymlinkPolicy::FollowOnce;
+            } else if (mode == "follow") {
+                options.symlinks = SymlinkPolicy::Follow;
+            } else {
+                std::cerr << "Unknown symlink mode: " << mode << "\n";
+                return false;
+            }
+        } else if (arg == "--watch") {
+            options.watch = true;
+        } else if (arg == "--debounce" && i + 1 < argc) {
+            options.watchOptions.debounceMs = std::atoi(argv[++i]);
+        } else if (arg == "--daemon" && i + 1 < argc) {
+            options.daemonSocket = argv[++i];
+        } else if (arg == "--connect" && i + 1 < argc) {
+            options.connectSocket = argv[++i];
+        } else if (arg == "--subtree" && i + 1 < argc) {
+            options.request.subtree = fs::path(argv[++i]).generic_string();
+        } else if (arg == "--filter" && i + 1 < argc) {
+            options.request.filter = argv[++i];
+        } else if (!arg.empty() && arg[0] == '-') {
+            std::cerr << "Unknown option: " << arg << "\n";
+            return false;
         } else {
-            oss << c;
+            arguments.push_back(arg);
         }
     }
-    // If the pattern was for a directory, ensure it matches a trailing slash or end.
-    // (Git’s behavior is more nuanced, but here we force end-of-string.)
-    // You might want to modify this if needed.
-    if (!pattern.empty() && pattern.back() == '/')
-        oss << ".*";
-
-    return oss.str();
-}
-
-/**
- * Parse a single line of a .gitignore file into a GitIgnoreRule.
- * Returns std::nullopt for blank lines or comments.
- */
-std::optional<GitIgnoreRule> parseGitIgnoreLine(const std::string &line) {
-    std::string trimmedLine = trim(line);
-    if (trimmedLine.empty() || trimmedLine[0] == '#')
-        return std::nullopt;
-
-    GitIgnoreRule rule;
-    rule.originalPattern = trimmedLine;
-
-    // Check for negation.
-    if (trimmedLine[0] == '!') {
-        rule.negate = true;
-        trimmedLine = trim(trimmedLine.substr(1));
+    if (options.part.count > 0 && (options.shards.maxBytes > 0 || options.shards.maxTokens > 0)) {
+        std::cerr << "--shard cannot be combined with --shard-bytes or --shard-tokens\n";
+        return false;
     }
-
-    // Check for a trailing slash.
-    if (!trimmedLine.empty() && trimmedLine.back() == '/') {
-        rule.directoryOnly = true;
+    // Modes that do not go through the file list of a single run.
+    const char *mode = !options.commit.empty()        ? "--commit"
+                       : !options.daemonSocket.empty() ? "--daemon"
+                       : options.watch                 ? "--watch"
+                                                       : nullptr;
+    if (mode && (options.budget.maxTokens > 0 || !options.budget.prefer.empty() ||
+                 options.budget.order != BudgetOrder::Path)) {
+        std::cerr << "--budget, --prefer and --rank cannot be combined with " << mode << "\n";
+        return false;
     }
-
-    // Check for anchored rule (pattern starts with '/')
-    if (!trimmedLine.empty() && trimmedLine[0] == '/') {
-        rule.anchored = true;
-        trimmedLine = trimmedLine.substr(1); // remove the leading slash
+    if (mode && (options.shards.maxBytes > 0 || options.shards.maxTokens > 0 || options.part.count > 0)) {
+        std::cerr << "--shard, --shard-bytes and --shard-tokens cannot be combined with " << mode << "\n";
+        return false;
     }
-
-    std::string regexStr = patternToRegex(trimmedLine, rule.anchored);
-    // For our purposes, match the entire string.
-    regexStr += "$";
-    try {
-        rule.patternRegex = std::regex(regexStr, std::regex::ECMAScript);
-    } catch (std::regex_error &e) {
-        std::cerr << "Regex error for pattern \"" << trimmedLine << "\": " << e.what() << "\n";
-        return std::nullopt;
+    if (!options.daemonSocket.empty() && (options.combine.dedup || options.combine.nearDup || options.combine.boilerplate)) {
+        std::cerr << "--daemon cannot be combined with --dedup, --near-dup or --boilerplate\n";
+        return false;
     }
-    return rule;
-}
-
-/**
- * Parse a .gitignore file and return a vector of rules.
- */
-std::vector<GitIgnoreRule> parseGitIgnore(const fs::path &gitignorePath) {
-    std::vector<GitIgnoreRule> rules;
-    std::ifstream file(gitignorePath);
-    if (!file.is_open())
-        return rules;
-    std::string line;
-    while (std::getline(file, line)) {
-        auto ruleOpt = parseGitIgnoreLine(line);
-        if (ruleOpt.has_value()) {
-            rules.push_back(ruleOpt.value());
-        }
+    if (!options.commit.empty() && (options.combine.nearDup || options.combine.boilerplate)) {
+        std::cerr << "--commit cannot be combined with --near-dup or --boilerplate\n";
+        return false;
     }
-    return rules;
-}
-
-/**
- * Determine if the given relative path (with '/' as separator) matches a single rule.
- */
-bool matchesRule(const GitIgnoreRule &rule, const std::string &relPath, bool isDir) {
-    // If rule is directory-only but this is not a directory, it does not match.
-    if (rule.directoryOnly && !isDir)
+    if (options.merge) {
+        options.mergeInputs.assign(arguments.begin(), arguments.end());
+        return true;
+    }
+    if (arguments.size() > 1) {
+        std::cerr << "Unexpected argument: " << arguments[1] << "\n";
         return false;
-    return std::regex_match(relPath, rule.patternRegex);
+    }
+    if (!arguments.empty())
+        options.targetDir = arguments[0];
+    return !options.targetDir.empty() || !options.connectSocket.empty();
 }
 
-/**
- * Given a list of GitIgnoreRule objects (ordered in the order they appear),
- * determine if the file with the given relative path should be ignored.
- *
- * Git’s behavior is that the last matching rule wins.
- */
-bool isIgnored(const std::vector<GitIgnoreRule> &rules, const fs::path &baseDir, const fs::path &filePath) {
-    // Compute the relative path from baseDir, using '/' as separator.
-    fs::path rel = fs::relative(filePath, baseDir);
-    std::string relPath = rel.generic_string(); // always uses '/'
-    bool ignored = false;
-    for (const auto &rule : rules) {
-        if (matchesRule(rule, relPath, fs::is_directory(filePath))) {
-            ignored = !rule.negate; // last match wins
-        }
-    }
-    return ignored;
+// Narrow files down to the token budget, if there is one, and report it.
+void applyBudget(std::vector<FileEntry> &files, const Options &options) {
+    if (options.budget.maxTokens == 0)
+        return;
+    PhaseTimer timer(Phase::Selection);
+    BudgetSummary summary;
+    size_t total = files.size();
+    files = selectWithinBudget(files, options.budget, options.combine, summary);
+    std::cout << "Budget: " << summary.selected << " of " << total << " files, about " << summary.tokens << " of "
+              << options.budget.maxTokens << " tokens (" << summary.estimated << " files read)\n";
 }
 
-/**
- * Recursively gather .gitignore rules from the given directory and its parents.
- * (For a fully correct implementation you would also need to merge rules from nested .gitignore files.)
- */
-std::vector<GitIgnoreRule> gatherGitIgnoreRules(const fs::path &startDir) {
-    std::vector<GitIgnoreRule> rules;
-    fs::path current = fs::canonical(startDir);
-    while (true) {
-        fs::path gitignoreFile = current / ".gitignore";
-        if (fs::exists(gitignoreFile) && fs::is_regular_file(gitignoreFile)) {
-            auto fileRules = parseGitIgnore(gitignoreFile);
-            // Append the rules (Git applies .gitignore files in order from the root downward)
-            rules.insert(rules.end(), fileRules.begin(), fileRules.end());
-        }
-        if (!current.has_parent_path() || current == current.parent_path())
-            break;
-        current = current.parent_path();
-    }
-    return rules;
+// Tell the progress reporter how much the writer has ahead of it.
+void announceFiles(const std::vector<FileEntry> &files) {
+    uint64_t bytes = 0;
+    for (const auto &file : files)
+        bytes += file.size;
+    setProgressTotal(files.size(), bytes);
 }
 
-/**
- * A heuristic to check if a file is binary.
- */
-bool isBinaryFile(const fs::path &filePath) {
-    std::ifstream in(filePath, std::ios::binary);
-    if (!in)
-        return false;
-    const size_t sampleSize = 512;
-    char buffer[sampleSize];
-    in.read(buffer, sampleSize);
-    std::streamsize bytesRead = in.gcount();
-    if (bytesRead == 0)
-        return false;
-    int nonPrintable = 0;
-    for (int i = 0; i < bytesRead; ++i) {
-        unsigned char c = static_cast<unsigned char>(buffer[i]);
-        if (!((c >= 32 && c <= 126) || c == 9 || c == 10 || c == 13))
-            nonPrintable++;
+// Write files as shards instead of a single output.
+int writeShardedOutput(const std::vector<FileEntry> &files, const fs::path &outputPath, const std::string &root,
+                       const Options &options) {
+    std::vector<std::vector<FileEntry>> shards;
+    {
+        PhaseTimer timer(Phase::Selection);
+        shards = partitionFiles(files, options.shards, options.combine);
     }
-    return (static_cast<double>(nonPrintable) / bytesRead) > 0.30;
+    announceFiles(files);
+    CombineSummary summary;
+    PhaseTimer timer(Phase::Combining);
+    if (!writeShards(shards, outputPath, root, options.incremental, options.combine, summary))
+        return 1;
+    std::cout << "Files have been combined into " << shards.size() << " shards (" << shardPath(outputPath, 1).string();
+    if (shards.size() > 1)
+        std::cout << " to " << shardPath(outputPath, shards.size()).string();
+    std::cout << "; " << summary.written << " written, " << summary.reused << " reused)\n";
+    return 0;
 }
 
-/**
- * Recursively process the directory and write text file contents into combined.txt.
- */
-void processDirectory(const fs::path &dir,
-                      std::ofstream &out,
-                      const std::vector<GitIgnoreRule> &rules,
-                      const fs::path &baseDir)
-{
-    for (const auto &entry : fs::directory_iterator(dir)) {
-        if (!entry.exists())
-            continue;
-        fs::path path = entry.path();
-        if (path.filename() == ".gitignore" || path.filename() == "combined.txt")
-            continue;
-        if (isIgnored(rules, baseDir, path))
-            continue;
-        if (fs::is_directory(path)) {
-            processDirectory(path, out, rules, baseDir);
-        } else {
-            if (isBinaryFile(path)) {
-                std::cerr << "Skipping binary file: " << path << "\n";
-                continue;
-            }
-            out << "# File: " << path.string() << "\n\n";
-            std::ifstream inFile(path);
-            if (inFile)
-                out << inFile.rdbuf() << "\n\n";
-            else
-                std::cerr << "Failed to open file: " << path << "\n";
-        }
+// Write the files of one part of a --shard run.
+int writePartOutput(const std::vector<FileEntry> &files, const fs::path &outputPath, const std::string &root,
+                    const Options &options) {
+    std::vector<FileEntry> selected;
+    {
+        PhaseTimer timer(Phase::Selection);
+        selected = filesForPart(files, options.part);
     }
+    announceFiles(selected);
+    CombineSummary summary;
+    PhaseTimer timer(Phase::Combining);
+    if (!writePart(selected, options.part, outputPath, root, options.incremental, options.combine, summary))
+        return 1;
+    std::cout << selected.size() << " of " << files.size() << " files have been combined into "
+              << partPath(outputPath, options.part).string() << " (" << summary.written << " written, "
+              << summary.reused << " reused)\n";
+    return 0;
 }
 
-int main(int argc, char* argv[]) {
-    if (argc < 2) {
-        std::cerr << "Usage: " << argv[0] << " <directory_path>\n";
+// Merge the outputs of a --shard run.
+int runMerge(const Options &options, const fs::path &outputPath) {
+    PhaseTimer timer(Phase::Merge);
+    std::vector<fs::path> parts = options.mergeInputs;
+    if (parts.empty())
+        parts = findParts(outputPath);
+    size_t segments = 0;
+    if (parts.empty() || !mergeParts(parts, outputPath, segments))
         return 1;
-    }
-    
-    fs::path targetDir(argv[1]);
+    std::cout << parts.size() << " parts (" << segments << " files) have been merged into " << outputPath.string() << "\n";
+    return 0;
+}
+
+int run(const Options &options) {
+    const fs::path outputPath = "combined.txt";
+    if (!options.connectSocket.empty())
+        return runClient(options.connectSocket, options.request);
+    if (options.merge)
+        return runMerge(options, outputPath);
+    if (options.prunedNames)
+        setPrunedNames(*options.prunedNames);
+    setSymlinkPolicy(options.symlinks);
+
+    fs::path targetDir = options.targetDir;
     if (!fs::exists(targetDir) || !fs::is_directory(targetDir)) {
         std::cerr << "Invalid directory: " << targetDir << "\n";
         return 1;
     }
     
-    std::ofstream outFile("combined.txt", std::ios::out | std::ios::binary);
-    if (!outFile) {
-        std::cerr << "Failed to create output file combined.txt\n";
-        return 1;
+    if (!options.daemonSocket.empty())
+        return runDaemon(targetDir, options.daemonSocket, options.watchOptions, options.combine);
+    if (options.watch)
+        return runWatchMode(targetDir, outputPath, options.watchOptions, options.combine);
+    if (!options.commit.empty()) {
+        CombineSummary summary;
+        if (!combineCommit(targetDir, options.commit, outputPath, summary, options.combine))
+            return 1;
+        std::cout << "Files of " << options.commit << " have been combined into combined.txt\n";
+        return 0;
     }
-    
+
     // Gather .gitignore rules from the directory and its parents.
-    auto rules = gatherGitIgnoreRules(targetDir);
-    processDirectory(targetDir, outFile, rules, targetDir);
-    
-    std::cout << "Files have been combined into combined.txt\n";
+    std::vector<GitIgnoreRule> rules;
+    {
+        PhaseTimer timer(Phase::Rules);
+        rules = gatherGitIgnoreRules(targetDir);
+    }
+    Manifest manifest;
+    manifest.root = targetDir.string();
+    CombineSummary summary;
+
+    if (!options.incremental) {
+        TreeListing listing;
+        {
+            PhaseTimer timer(Phase::Listing);
+            if (options.gitIndex) {
+                if (!collectGitIndexFiles(targetDir, listing, rules, options.untracked))
+                    return 1;
+            } else {
+                processDirectory(targetDir, listing, rules, targetDir);
+            }
+        }
+        setEventCount(Counter::Files, listing.files.size());
+        applyBudget(listing.files, options);
+        if (options.part.count > 0)
+            return writePartOutput(listing.files, outputPath, manifest.root, options);
+        if (options.shards.maxBytes > 0 || options.shards.maxTokens > 0)
+            return writeShardedOutput(listing.files, outputPath, manifest.root, options);
+        announceFiles(listing.files);
+        PhaseTimer timer(Phase::Combining);
+        if (!combineFiles(listing.files, outputPath, nullptr, outputPath, manifest, summary, options.combine))
+            return 1;
+        std::cout << "Files have been combined into combined.txt";
+        if (options.combine.dedup || options.combine.nearDup || summary.linked > 0)
+            std::cout << " (" << summary.deduplicated << " duplicates, " << summary.similar << " near-duplicates, "
+                      << summary.linked << " hard links referenced)";
+        std::cout << "\n";
+        return 0;
+    }
+
+    Manifest previous;
+    bool havePrevious = loadPreviousManifest(outputPath, manifest.root, previous);
+    const uint64_t rulesHash = hashRules(rules);
+    const fs::path merklePath = merklePathFor(outputPath);
+    MerkleTree previousTree;
+    // The manifest of a budgeted run does not list every file of a directory,
+    // and sharded runs have no single manifest. With symlinks followed, an
+    // unchanged directory can still gain or lose entries to aliases elsewhere.
+    const bool sharded = options.shards.maxBytes > 0 || options.shards.maxTokens > 0 || options.part.count > 0;
+    bool haveTree = options.trustDirMtime && !options.gitIndex && options.budget.maxTokens == 0 && !sharded &&
+                    symlinkPolicy() == SymlinkPolicy::Skip &&
+                    havePrevious && loadMerkleTree(merklePath, previousTree) && previousTree.rulesHash == rulesHash;
+
+    TreeListing listing;
+    size_t skippedDirs = 0;
+    {
+        PhaseTimer timer(Phase::Listing);
+        if (options.gitIndex) {
+            if (!collectGitIndexFiles(targetDir, listing, rules, options.untracked))
+                return 1;
+        } else if (haveTree) {
+            skippedDirs = processDirectoryTrustingMtimes(targetDir, listing, rules, previousTree, previous);
+        } else {
+            processDirectory(targetDir, listing, rules, targetDir);
+        }
+    }
+    setEventCount(Counter::Files, listing.files.size());
+
+    applyBudget(listing.files, options);
+    if (options.part.count > 0)
+        return writePartOutput(listing.files, outputPath, manifest.root, options);
+    if (sharded)
+        return writeShardedOutput(listing.files, outputPath, manifest.root, options);
+    MerkleTree tree;
+    {
+        announceFiles(listing.files);
+        PhaseTimer timer(Phase::Combining);
+        if (!updateOutput(listing.files, outputPath, havePrevious ? &previous : nullptr, manifest, summary,
+                          options.combine))
+            return 1;
+        tree = buildMerkleTree(listing.directories, manifest, rulesHash);
+        if (!saveMerkleTree(merklePath, tree))
+            std::cerr << "Failed to write " << merklePath << "\n";
+    }
+
+    std::cout << "Files have been combined into combined.txt ("
+              << summary.written << " written, " << summary.reused << " reused";
+    if (options.combine.dedup)
+        std::cout << ", " << summary.deduplicated << " duplicates referenced";
+    if (options.combine.nearDup)
+        std::cout << ", " << summary.similar << " near-duplicates referenced";
+    if (summary.linked > 0)
+        std::cout << ", " << summary.linked << " hard links referenced";
+    if (options.trustDirMtime)
+        std::cout << ", " << skippedDirs << " of " << listing.directories.size() << " directories unchanged";
+    std::cout << ")\nSnapshot: " << hashToHex(tree.rootHash()) << "\n";
     return 0;
 }
+
+int main(int argc, char* argv[]) {
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        printUsage(argv[0]);
+        return 1;
+    }
+    if (options.stats)
+        enableStats();
+    if (!options.tracePath.empty())
+        enableTrace();
+    if (options.latency)
+        enableLatency();
+    if (options.perfCounters)
+        enablePerfCounters();
+    if (options.progress)
+        startProgress(*options.progress);
+    int status = run(options);
+    stopProgress();
+    if (options.stats)
+        printStats(std::cerr);
+    if (options.latency)
+        printLatencies(std::cerr);
+    if (perfCountersEnabled)
+        printPerfCounters(std::cerr);
+    if (!options.latencyJsonPath.empty() && !writeLatencyJson(options.latencyJsonPath) && status == 0)
+        status = 1;
+    if (!options.tracePath.empty() && !writeTrace(options.tracePath) && status == 0)
+        status = 1;
+    return status;
+}
@@ -0,0 +1,136 @@
+#include "manifest.hpp"
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#include "hash.hpp"
+
+namespace {
+
+const char *kManifestHeader = "# ProjectCompressor manifest v3";
+// Version 2 had no sketch column.
+const char *kManifestHeaderV2 = "# ProjectCompressor manifest v2";
+
+// Escape the characters that would break the line/tab based format.
+std::string escapeField(const std::string &s) {
+    std::string result;
+    result.reserve(s.size());
+    for (char c : s) {
+        if (c == '\\')
+            result += "\\\\";
+        else if (c == '\t')
+            result += "\\t";
+        else if (c == '\n')
+            result += "\\n";
+        else
+            result += c;
+    }
+    return result;
+}
+
+std::string unescapeField(const std::string &s) {
+    std::string result;
+    result.reserve(s.size());
+    for (size_t i = 0; i < s.size(); ++i) {
+        if (s[i] == '\\' && i + 1 < s.size()) {
+            char next = s[++i];
+            result += next == 't' ? '\t' : next == 'n' ? '\n' : next;
+        } else {
+            result += s[i];
+        }
+    }
+    return result;
+}
+
+} // namespace
+
+fs::path manifestPathFor(const fs::path &outputPath) {
+    fs::path result = outputPath;
+    result += ".manifest";
+    return result;
+}
+
+bool loadManifest(const fs::path &path, Manifest &manifest) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in)
+        return false;
+    std::string line;
+    if (!std::getline(in, line) || (line != kManifestHeader && line != kManifestHeaderV2))
+        return false;
+    const bool haveSketch = line == kManifestHeader;
+
+    manifest = Manifest();
+    while (std::getline(in, line)) {
+        if (line.empty())
+            continue;
+        if (line.rfind("root\t", 0) == 0) {
+            manifest.root = unescapeField(line.substr(5));
+            continue;
+        }
+        if (line.rfind("options\t", 0) == 0) {
+            manifest.options = line.substr(8);
+            continue;
+        }
+        if (line.rfind("layout\t", 0) == 0) {
+            manifest.layout = line.substr(7);
+            continue;
+        }
+        if (line.rfind("size\t", 0) == 0) {
+            std::istringstream value(line.substr(5));
+            if (!(value >> manifest.outputSize))
+                return false;
+            continue;
+        }
+        // Segment line: kind, offset, length, size, mtime, hash, sketch, path.
+        std::istringstream fields(line);
+        ManifestEntry entry;
+        std::string kind, hash, sketch, path;
+        if (!(fields >> kind >> entry.offset >> entry.length >> entry.size >> entry.mtimeNs >> hash) ||
+            kind.size() != 1 || !hashFromHex(hash, entry.hash))
+            return false;
+        if (haveSketch && (!(fields >> sketch) || !hashFromHex(sketch, entry.sketch)))
+            return false;
+        fields.get(); // The tab in front of the path.
+        std::getline(fields, path);
+        entry.kind = kind[0];
+        entry.relPath = unescapeField(path);
+        manifest.entries.push_back(std::move(entry));
+    }
+    return true;
+}
+
+bool saveManifest(const fs::path &path, const Manifest &manifest) {
+    fs::path tmpPath = path;
+    tmpPath += ".tmp";
+    {
+        std::ofstream out(tmpPath, std::ios::out | std::ios::binary);
+        if (!out) {
+            std::cerr << "Failed to create manifest " << tmpPath << "\n";
+            return false;
+        }
+        out << kManifestHeader << "\n";
+        out << "root\t" << escapeField(manifest.root) << "\n";
+        out << "size\t" << manifest.outputSize << "\n";
+        if (!manifest.options.empty())
+            out << "options\t" << manifest.options << "\n";
+        if (!manifest.layout.empty())
+            out << "layout\t" << manifest.layout << "\n";
+        for (const auto &entry : manifest.entries) {
+            out << entry.kind << '\t' << entry.offset << '\t' << entry.length << '\t'
+                << entry.size << '\t' << entry.mtimeNs << '\t' << hashToHex(entry.hash) << '\t'
+                << hashToHex(entry.sketch) << '\t' << escapeField(entry.relPath) << "\n";
+        }
+        if (!out) {
+            std::cerr << "Failed to write manifest " << tmpPath << "\n";
+            return false;
+        }
+    }
+    std::error_code ec;
+    fs::rename(tmpPath, path, ec);
+    if (ec) {
+        std::cerr << "Failed to replace manifest " << path << ": " << ec.message() << "\n";
+        return false;
+    }
+    return true;
+}
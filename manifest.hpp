@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+// One segment of the combined output, as recorded in the manifest.
+struct ManifestEntry {
+    char kind = 'T';       // 'T' for an emitted text file, 'B' for a skipped binary file,
+                           // 'R' for a reference to an earlier file with the same or
+                           // (with near-duplicate detection) similar contents.
+    uint64_t offset = 0;   // Byte offset of the segment in the output file.
+    uint64_t length = 0;   // Segment length, including the "# File:" header.
+    uint64_t size = 0;     // Size of the source file when the segment was written.
+    int64_t mtimeNs = 0;   // Modification time of the source file (0 = always re-read).
+    uint64_t hash = 0;     // XXH64 of the file contents, also for 'R' (0 for binary files).
+    uint64_t sketch = 0;   // SimHash of the contents, if near-duplicates were looked for.
+    std::string relPath;   // Path relative to the root, using '/' as separator.
+};
+
+// The layout of a combined output file, stored next to it so that a later
+// run can reuse the segments of files that did not change.
+struct Manifest {
+    std::string root;        // Directory argument the output was generated from.
+    uint64_t outputSize = 0; // Total size of the output file.
+    std::string options;     // Space-separated options the output was generated with.
+    std::string layout;      // Options that change how segments are rendered; segments
+                             // are only reused between outputs with the same layout.
+    std::vector<ManifestEntry> entries;
+};
+
+/**
+ * Path of the manifest belonging to the given output file.
+ */
+fs::path manifestPathFor(const fs::path &outputPath);
+
+/**
+ * Load a manifest. Returns false if the file is missing or malformed.
+ */
+bool loadManifest(const fs::path &path, Manifest &manifest);
+
+/**
+ * Write a manifest, replacing any existing file atomically.
+ */
+bool saveManifest(const fs::path &path, const Manifest &manifest);
@@ -0,0 +1,229 @@
+#include "merkle.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <unordered_map>
+
+#include "hash.hpp"
+
+namespace {
+
+const char *kMerkleHeader = "# ProjectCompressor merkle v1";
+
+std::string parentOf(const std::string &relPath) {
+    size_t slash = relPath.rfind('/');
+    return slash == std::string::npos ? "" : relPath.substr(0, slash);
+}
+
+std::string nameOf(const std::string &relPath) {
+    size_t slash = relPath.rfind('/');
+    return slash == std::string::npos ? relPath : relPath.substr(slash + 1);
+}
+
+// A child of a directory as it enters the directory hash.
+struct MerkleChild {
+    std::string name;
+    char type;      // 'T' text file, 'B' binary file, 'D' directory.
+    uint64_t hash;
+};
+
+struct TrustedWalk {
+    const fs::path &baseDir;
+    const std::vector<GitIgnoreRule> &rules;
+    const MerkleTree &previousTree;
+    std::unordered_map<std::string, std::vector<const ManifestEntry *>> filesByDir;
+    std::unordered_map<std::string, std::vector<std::string>> subdirsByDir;
+    size_t skipped = 0;
+    TraversalState state;
+
+    void walk(const std::string &relDir, int64_t mtimeNs, TreeListing &listing) {
+        fs::path dir = relDir.empty() ? baseDir : baseDir / relDir;
+        bool entered = state.enter(dir);
+        DirectoryListing children;
+        auto node = previousTree.nodes.find(relDir);
+        if (node != previousTree.nodes.end() && node->second.mtimeNs != 0 && node->second.mtimeNs == mtimeNs) {
+            for (const ManifestEntry *entry : filesByDir[relDir]) {
+                FileEntry file{baseDir / entry->relPath, entry->relPath, entry->size, entry->mtimeNs};
+                if (entry->mtimeNs == 0 || entry->kind == 'R') {
+                    // Written too recently to be trusted last time, or possibly
+                    // a hard link whose inode identity is needed; look again.
+                    FileStat st;
+                    if (!statPath(file.path, st))
+                        continue;
+                    file.size = st.size;
+                    file.mtimeNs = st.mtimeNs;
+                    file.dev = st.dev;
+                    file.ino = st.ino;
+                    file.nlink = st.nlink;
+                }
+                children.files.push_back(std::move(file));
+            }
+            for (const auto &subdir : subdirsByDir[relDir]) {
+                // Only used under SymlinkPolicy::Skip, where visited holds the
+                // directories; a bind mount of one already walked is left out.
+                FileStat st;
+                if (statPath(baseDir / subdir, st) && st.isDirectory && (st.ino == 0 || state.visited.insert(st.dev, st.ino)))
+                    children.subdirs.push_back({subdir, st.mtimeNs, st.dev, st.ino});
+            }
+            skipped++;
+        } else {
+            listDirectory(dir, relDir, rules, baseDir, children, &state);
+        }
+
+        size_t fileIndex = 0;
+        for (auto &subdir : children.subdirs) {
+            while (fileIndex < children.files.size() && pathOrderLess(children.files[fileIndex].relPath, subdir.relPath))
+                listing.files.push_back(std::move(children.files[fileIndex++]));
+            listing.directories.push_back(subdir);
+            walk(subdir.relPath, subdir.mtimeNs, listing);
+        }
+        while (fileIndex < children.files.size())
+            listing.files.push_back(std::move(children.files[fileIndex++]));
+        if (entered)
+            state.leave();
+    }
+};
+
+} // namespace
+
+uint64_t MerkleTree::rootHash() const {
+    auto it = nodes.find("");
+    return it == nodes.end() ? 0 : it->second.hash;
+}
+
+fs::path merklePathFor(const fs::path &outputPath) {
+    fs::path result = outputPath;
+    result += ".merkle";
+    return result;
+}
+
+uint64_t hashRules(const std::vector<GitIgnoreRule> &rules) {
+    Hasher64 hasher;
+    for (const auto &rule : rules)
+        hasher.update(rule.originalPattern.c_str(), rule.originalPattern.size() + 1);
+    // The traversal settings decide what is listed just as much as the rules.
+    const char policy = static_cast<char>('0' + static_cast<int>(symlinkPolicy()));
+    hasher.update(&policy, 1);
+    for (const auto &name : prunedNames())
+        hasher.update(name.c_str(), name.size() + 1);
+    return hasher.digest();
+}
+
+MerkleTree buildMerkleTree(const std::vector<DirectoryEntry> &directories, const Manifest &manifest, uint64_t rulesHash) {
+    MerkleTree tree;
+    tree.rulesHash = rulesHash;
+
+    std::unordered_map<std::string, std::vector<MerkleChild>> children;
+    for (const auto &entry : manifest.entries) {
+        // A deduplicated file has the same contents as a written one.
+        char type = entry.kind == 'R' ? 'T' : entry.kind;
+        children[parentOf(entry.relPath)].push_back({nameOf(entry.relPath), type, entry.hash});
+    }
+
+    // Directories are listed parents first, so walking them backwards
+    // finishes every child before its parent.
+    const int64_t racyThresholdNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count() - 2'000'000'000;
+    for (auto dir = directories.rbegin(); dir != directories.rend(); ++dir) {
+        auto &list = children[dir->relPath];
+        std::sort(list.begin(), list.end(), [](const MerkleChild &a, const MerkleChild &b) { return a.name < b.name; });
+        Hasher64 hasher;
+        for (const auto &child : list) {
+            hasher.update(&child.type, 1);
+            hasher.update(child.name.c_str(), child.name.size() + 1);
+            unsigned char bytes[8];
+            for (int i = 0; i < 8; ++i)
+                bytes[i] = static_cast<unsigned char>(child.hash >> (8 * i));
+            hasher.update(bytes, sizeof(bytes));
+        }
+        MerkleNode node;
+        node.mtimeNs = dir->mtimeNs < racyThresholdNs ? dir->mtimeNs : 0;
+        node.hash = hasher.digest();
+        tree.nodes[dir->relPath] = node;
+        if (!dir->relPath.empty())
+            children[parentOf(dir->relPath)].push_back({nameOf(dir->relPath), 'D', node.hash});
+    }
+    return tree;
+}
+
+bool loadMerkleTree(const fs::path &path, MerkleTree &tree) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in)
+        return false;
+    std::string line;
+    if (!std::getline(in, line) || line != kMerkleHeader)
+        return false;
+
+    tree = MerkleTree();
+    while (std::getline(in, line)) {
+        if (line.empty())
+            continue;
+        std::istringstream fields(line);
+        std::string kind, hash;
+        if (!(fields >> kind))
+            return false;
+        if (kind == "rules") {
+            if (!(fields >> hash) || !hashFromHex(hash, tree.rulesHash))
+                return false;
+            continue;
+        }
+        // Directory line: "D", mtime, hash, path (empty for the root).
+        MerkleNode node;
+        std::string relPath;
+        if (kind != "D" || !(fields >> node.mtimeNs >> hash) || !hashFromHex(hash, node.hash))
+            return false;
+        fields.get();
+        std::getline(fields, relPath);
+        tree.nodes[relPath] = node;
+    }
+    return true;
+}
+
+bool saveMerkleTree(const fs::path &path, const MerkleTree &tree) {
+    fs::path tmpPath = path;
+    tmpPath += ".tmp";
+    {
+        std::ofstream out(tmpPath, std::ios::out | std::ios::binary);
+        if (!out) {
+            std::cerr << "Failed to create " << tmpPath << "\n";
+            return false;
+        }
+        out << kMerkleHeader << "\n";
+        out << "rules\t" << hashToHex(tree.rulesHash) << "\n";
+        for (const auto &[relPath, node] : tree.nodes) {
+            if (relPath.find('\n') != std::string::npos)
+                continue; // Cannot be represented; the directory is simply listed again.
+            out << "D\t" << node.mtimeNs << '\t' << hashToHex(node.hash) << '\t' << relPath << "\n";
+        }
+        if (!out)
+            return false;
+    }
+    std::error_code ec;
+    fs::rename(tmpPath, path, ec);
+    return !ec;
+}
+
+size_t processDirectoryTrustingMtimes(const fs::path &baseDir,
+                                      TreeListing &listing,
+                                      const std::vector<GitIgnoreRule> &rules,
+                                      const MerkleTree &previousTree,
+                                      const Manifest &previousManifest)
+{
+    TrustedWalk walk{baseDir, rules, previousTree, {}, {}, 0, {}};
+    for (const auto &entry : previousManifest.entries)
+        walk.filesByDir[parentOf(entry.relPath)].push_back(&entry);
+    for (const auto &[relPath, node] : previousTree.nodes) {
+        if (!relPath.empty())
+            walk.subdirsByDir[parentOf(relPath)].push_back(relPath);
+    }
+
+    FileStat st;
+    statPath(baseDir, st);
+    listing.directories.push_back({"", st.mtimeNs, st.dev, st.ino});
+    walk.state.visited.insert(st.dev, st.ino);
+    walk.walk("", st.mtimeNs, listing);
+    return walk.skipped;
+}
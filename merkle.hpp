@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "compressor.hpp"
+#include "gitignore.hpp"
+#include "manifest.hpp"
+
+namespace fs = std::filesystem;
+
+// A directory of the combined tree.
+struct MerkleNode {
+    int64_t mtimeNs = 0; // Directory mtime when hashed (0 = too recent to be trusted).
+    uint64_t hash = 0;   // Hash of the sorted child names, types and hashes.
+};
+
+/**
+ * Merkle tree over the directories of a combined output. A file contributes
+ * its content hash and a directory the hash of its sorted children, so the
+ * root hash identifies the whole snapshot and can serve as a cache key.
+ */
+struct MerkleTree {
+    uint64_t rulesHash = 0; // Hash of the ignore rules the tree was built with.
+    std::map<std::string, MerkleNode, PathOrder> nodes; // Keyed by relative path; "" is the root.
+
+    uint64_t rootHash() const;
+};
+
+/**
+ * Path of the Merkle tree file belonging to the given output file.
+ */
+fs::path merklePathFor(const fs::path &outputPath);
+
+/**
+ * Hash of a rule set, the symlink policy and the pruned names; a tree built
+ * with different ones cannot be trusted.
+ */
+uint64_t hashRules(const std::vector<GitIgnoreRule> &rules);
+
+/**
+ * Build the tree for the directories of a traversal and the segments of
+ * the manifest that was written for it.
+ */
+MerkleTree buildMerkleTree(const std::vector<DirectoryEntry> &directories, const Manifest &manifest, uint64_t rulesHash);
+
+bool loadMerkleTree(const fs::path &path, MerkleTree &tree);
+bool saveMerkleTree(const fs::path &path, const MerkleTree &tree);
+
+/**
+ * Like processDirectory, but a directory whose mtime still matches the
+ * previous tree is not listed and its files are not stat'ed: its entries
+ * are taken from the previous manifest. Adding, removing or renaming an
+ * entry updates the directory mtime; rewriting a file in place does not,
+ * which is why this is opt-in. Only valid under SymlinkPolicy::Skip: with
+ * links followed, whether an entry is an alias depends on the rest of the
+ * tree. Returns the number of directories skipped.
+ */
+size_t processDirectoryTrustingMtimes(const fs::path &baseDir,
+                                      TreeListing &listing,
+                                      const std::vector<GitIgnoreRule> &rules,
+                                      const MerkleTree &previousTree,
+                                      const Manifest &previousManifest);
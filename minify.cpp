@@ -0,0 +1,914 @@
+#include "minify.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <initializer_list>
+#include <unordered_map>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+/**
+ * A small set of delimiter bytes, searched 16 bytes at a time with SSE2
+ * (one compare per member) where available.
+ */
+class ByteSet {
+public:
+    ByteSet(std::initializer_list<char> bytes) {
+        for (char c : bytes) {
+            member[static_cast<unsigned char>(c)] = true;
+#if defined(__SSE2__)
+            needles[count] = _mm_set1_epi8(c);
+#endif
+            count++;
+        }
+    }
+
+    bool contains(char c) const { return member[static_cast<unsigned char>(c)]; }
+
+    // The first byte of [p, end) in the set, or end.
+    const char *find(const char *p, const char *end) const {
+#if defined(__SSE2__)
+        while (end - p >= 16) {
+            __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+            __m128i hits = _mm_cmpeq_epi8(chunk, needles[0]);
+            for (int i = 1; i < count; ++i)
+                hits = _mm_or_si128(hits, _mm_cmpeq_epi8(chunk, needles[i]));
+            int mask = _mm_movemask_epi8(hits);
+            if (mask != 0)
+                return p + __builtin_ctz(static_cast<unsigned>(mask));
+            p += 16;
+        }
+#endif
+        while (p < end && !contains(*p))
+            ++p;
+        return p;
+    }
+
+private:
+#if defined(__SSE2__)
+    __m128i needles[12];
+#endif
+    bool member[256] = {};
+    int count = 0;
+};
+
+const ByteSet kDoubleQuoted{'"', '\\', '\n'};
+const ByteSet kSingleQuoted{'\'', '\\', '\n'};
+const ByteSet kBackquoted{'`', '\\', '\n'};
+
+const ByteSet kRawString{')', '\n'};
+
+const ByteSet &stringDelimiters(char quote) {
+    return quote == '"' ? kDoubleQuoted : quote == '\'' ? kSingleQuoted : kBackquoted;
+}
+
+bool isBlank(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\f' || c == '\v';
+}
+
+} // namespace
+
+// What the lexer needs to know about a language.
+struct MinifyRules {
+    ByteSet code;                  // Bytes that may change the state in code.
+    ByteSet outlineCode;           // The same when outlining, outside bodies.
+    ByteSet bodyCode;              // The same in a body being left out.
+    bool slashComments;            // // and /* */
+    bool hashComments;             // #
+    bool hashNeedsWordStart;       // Shell: '#' only starts a comment at the start of a word.
+    bool shebang;                  // A '#!' first line is kept.
+    bool digitSeparators;          // C++14: a quote after a digit is part of a number.
+    bool hereDocuments;            // Shell: "<<WORD" bodies are copied unchanged.
+    bool rawStrings;               // C++: R"delimiter(...)delimiter".
+    bool regexLiterals;            // JavaScript: /.../ after an operator or keyword.
+    bool directives;               // C preprocessor lines.
+    bool braceOutline;             // Bodies are delimited by braces.
+    bool indentOutline;            // Bodies are delimited by indentation.
+    const char *tripleQuotes;      // Quotes that can open a """string""".
+    const char *multilineQuotes;   // Strings that may span lines.
+    const char *rawQuotes;         // Strings without backslash escapes.
+};
+
+namespace {
+
+const MinifyRules kCRules{{'\n', '/', '"', '\''},
+                          {'\n', '/', '"', '\'', '{', '}', ';', '#'},
+                          {'\n', '/', '"', '\'', '{', '}'},
+                          true, false, false, false, true, false, true, false, true, true, false, "", "", ""};
+const MinifyRules kPythonRules{{'\n', '#', '"', '\''},
+                               {'\n', '#', '"', '\'', '(', ')', '[', ']', '{', '}'},
+                               {'\n', '#', '"', '\''},
+                               false, true, false, true, false, false, false, false, false, false, true, "\"'", "", ""};
+const MinifyRules kJavaScriptRules{{'\n', '/', '"', '\'', '`'},
+                                   {'\n', '/', '"', '\'', '`', '{', '}', ';'},
+                                   {'\n', '/', '"', '\'', '`', '{', '}'},
+                                   true, false, false, false, false, false, false, true, false, true, false, "", "`", ""};
+const MinifyRules kJavaRules{{'\n', '/', '"', '\''},
+                             {'\n', '/', '"', '\'', '{', '}', ';'},
+                             {'\n', '/', '"', '\'', '{', '}'},
+                             true, false, false, false, false, false, false, false, false, true, false, "\"", "", ""};
+const MinifyRules kGoRules{{'\n', '/', '"', '\'', '`'},
+                           {'\n', '/', '"', '\'', '`', '{', '}', ';'},
+                           {'\n', '/', '"', '\'', '`', '{', '}'},
+                           true, false, false, false, false, false, false, false, false, true, false, "", "`", "`"};
+const MinifyRules kShellRules{{'\n', '#', '"', '\'', '`', '<'},
+                              {'\n', '#', '"', '\'', '`', '<'},
+                              {'\n', '#', '"', '\'', '`', '<'},
+                              false, true, true, true, false, true, false, false, false, false, false, "", "\"'`", "'"};
+
+// Lines shorter than this are held back whole, so that the start of a
+// line is seen before anything is decided about it.
+const size_t kHoldBytes = 4096;
+
+// Statements before a '{' are only remembered this far.
+const size_t kStatementBytes = 256;
+
+const char *kContainerWords[] = {"namespace", "class", "struct", "union", "enum", "interface", "extern", "module"};
+
+const MinifyRules *rulesFor(SourceLanguage language) {
+    switch (language) {
+    case SourceLanguage::C: return &kCRules;
+    case SourceLanguage::Python: return &kPythonRules;
+    case SourceLanguage::JavaScript: return &kJavaScriptRules;
+    case SourceLanguage::Java: return &kJavaRules;
+    case SourceLanguage::Go: return &kGoRules;
+    case SourceLanguage::Shell: return &kShellRules;
+    case SourceLanguage::None: break;
+    }
+    return nullptr;
+}
+
+bool isOneOf(char c, const char *set) {
+    return c != 0 && std::strchr(set, c) != nullptr;
+}
+
+bool isWordChar(char c) {
+    return std::isalnum(static_cast<unsigned char>(c)) || c == '_' || c == '$';
+}
+
+bool hasWord(const std::string &text, const char *word) {
+    size_t length = std::strlen(word);
+    for (size_t at = text.find(word); at != std::string::npos; at = text.find(word, at + 1)) {
+        if ((at == 0 || !isWordChar(text[at - 1])) && (at + length == text.size() || !isWordChar(text[at + length])))
+            return true;
+    }
+    return false;
+}
+
+// Whether the braces after statement hold declarations rather than code.
+bool opensContainer(const std::string &statement) {
+    if (statement.find_first_of("(=") != std::string::npos)
+        return false;
+    for (const char *word : kContainerWords) {
+        if (hasWord(statement, word))
+            return true;
+    }
+    return false;
+}
+
+// Whether a '/' after this token starts a regular expression: after an
+// operator, an opening bracket or a keyword, but not after a value.
+bool regexMayFollow(char token, const std::string &word) {
+    static const char *const kKeywords[] = {"return", "typeof", "instanceof", "in", "of", "new", "delete",
+                                            "void", "throw", "case", "do", "else", "yield", "await"};
+    if (!isWordChar(token))
+        return isOneOf(token, "\n(,=:[!&|?{};+-*%<>~^/");
+    return std::find(std::begin(kKeywords), std::end(kKeywords), word) != std::end(kKeywords);
+}
+
+bool startsWithWord(const char *text, size_t size, const char *word) {
+    size_t length = std::strlen(word);
+    return size > length && std::memcmp(text, word, length) == 0 && !isWordChar(text[length]);
+}
+
+// Whether a line comment whose bytes end with [from, to) ends in a backslash
+// (possibly before the '\r' of a CRLF), given whether the bytes before from did.
+bool endsInBackslash(const char *from, const char *to, bool before) {
+    if (to > from && to[-1] == '\r')
+        --to;
+    return to > from ? to[-1] == '\\' : before;
+}
+
+} // namespace
+
+SourceLanguage languageForPath(const fs::path &path) {
+    static const std::unordered_map<std::string, SourceLanguage> kExtensions = {
+        {".c", SourceLanguage::C},           {".h", SourceLanguage::C},
+        {".cc", SourceLanguage::C},          {".cpp", SourceLanguage::C},
+        {".cxx", SourceLanguage::C},         {".hh", SourceLanguage::C},
+        {".hpp", SourceLanguage::C},         {".hxx", SourceLanguage::C},
+        {".inl", SourceLanguage::C},         {".ipp", SourceLanguage::C},
+        {".cu", SourceLanguage::C},          {".cuh", SourceLanguage::C},
+        {".py", SourceLanguage::Python},     {".pyi", SourceLanguage::Python},
+        {".js", SourceLanguage::JavaScript}, {".mjs", SourceLanguage::JavaScript},
+        {".cjs", SourceLanguage::JavaScript}, {".jsx", SourceLanguage::JavaScript},
+        {".ts", SourceLanguage::JavaScript}, {".mts", SourceLanguage::JavaScript},
+        {".cts", SourceLanguage::JavaScript}, {".tsx", SourceLanguage::JavaScript},
+        {".java", SourceLanguage::Java},     {".go", SourceLanguage::Go},
+        {".sh", SourceLanguage::Shell},      {".bash", SourceLanguage::Shell},
+        {".zsh", SourceLanguage::Shell},     {".ksh", SourceLanguage::Shell},
+    };
+    std::string extension = path.extension().string();
+    std::transform(extension.begin(), extension.end(), extension.begin(),
+                   [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    auto it = kExtensions.find(extension);
+    return it == kExtensions.end() ? SourceLanguage::None : it->second;
+}
+
+bool canOutline(SourceLanguage language) {
+    const MinifyRules *rules = rulesFor(language);
+    return rules && (rules->braceOutline || rules->indentOutline);
+}
+
+Minifier::Minifier(SourceLanguage language, bool outline)
+    : rules(rulesFor(language)), outline(outline && canOutline(language)) {}
+
+// Decide how much of the current line is kept, from its start (Python
+// outlines only; everything is kept otherwise).
+void Minifier::decideLine(std::string &out) {
+    lineDecided = true;
+    lineLimit = std::string::npos;
+    if (!outline || !rules->indentOutline)
+        return;
+    if (lineBeganInString) {
+        if (stringElided)
+            lineLimit = 0;
+        return;
+    }
+    if (inHeader)
+        return; // The parameters of a def, continued.
+    size_t indent = 0;
+    while (lineStart + indent < out.size() && isBlank(out[lineStart + indent]))
+        indent++;
+    if (bodyIndent >= 0 && static_cast<int>(indent) > bodyIndent) {
+        if (placeholderWritten) {
+            lineLimit = 0;
+        } else {
+            out.resize(lineStart + indent);
+            out += "...";
+            lineLimit = indent + 3;
+            placeholderWritten = true;
+        }
+        blankPending = false;
+        return;
+    }
+    bodyIndent = -1;
+    const char *text = out.data() + lineStart + indent;
+    size_t size = out.size() - lineStart - indent;
+    if (startsWithWord(text, size, "def") || startsWithWord(text, size, "async")) {
+        inHeader = true;
+        headerIndent = static_cast<int>(indent);
+    }
+}
+
+void Minifier::endLine(std::string &out, bool verbatim) {
+    if (!verbatim) {
+        while (out.size() > lineStart && isBlank(out.back()))
+            out.pop_back();
+    }
+    if (!lineDecided && (verbatim || lineBeganInString || out.size() > lineStart))
+        decideLine(out);
+    if (lineDecided && lineLimit != std::string::npos && out.size() - lineStart > lineLimit)
+        out.resize(lineStart + lineLimit);
+    const bool dropped = lineDecided && lineLimit == 0;
+    if (verbatim && !lineBeganInString)
+        stringElided = lineLimit != std::string::npos;
+    const bool blank = !verbatim && out.size() == lineStart && !lineStarted;
+    if (dropped || blank) {
+        // Blank, or only a comment: the latter goes entirely.
+        if (blank && !dropped && anyLine && !lineHadComment)
+            blankPending = true;
+    } else {
+        if (blankPending && !lineStarted)
+            out.insert(out.begin() + static_cast<std::ptrdiff_t>(lineStart), '\n');
+        blankPending = false;
+        out += '\n';
+        anyLine = true;
+    }
+    if (inHeader && !verbatim && parenDepth == 0) {
+        inHeader = false;
+        bodyIndent = headerIndent;
+        placeholderWritten = false;
+    }
+    lineStart = out.size();
+    lineStarted = false;
+    lineHadComment = false;
+    lineDecided = false;
+    lineLimit = std::string::npos;
+    lineBeganInString = verbatim;
+    lastChar = '\n';
+}
+
+// A '{' in code outside a body.
+void Minifier::openBrace(std::string &out) {
+    if (inDirective || opensContainer(statement)) {
+        out += '{';
+    } else {
+        out += "{ ... }";
+        bodyDepth = 1;
+    }
+    statement.clear();
+    lastChar = '{';
+}
+
+// A byte of the delimiter set seen in code.
+void Minifier::codeByte(char c, std::string &out) {
+    const bool visible = bodyDepth == 0;
+    if (c == '\n') {
+        if (inDirective && lastChar != '\\') {
+            inDirective = false;
+            statement.clear();
+        }
+        if (visible)
+            endLine(out, false);
+        else
+            lastChar = '\n';
+        if (!hereDocuments.empty()) {
+            state = State::HereBody;
+            hereLine.clear();
+            hereLineStart = true;
+        }
+        return;
+    }
+    if (c == '/' && rules->slashComments) {
+        state = State::Slash;
+        return;
+    }
+    if (c == '#' && rules->hashComments) {
+        bool wordStart = lastChar == '\n' || isBlank(lastChar) || isOneOf(lastChar, ";|&()");
+        if (!rules->hashNeedsWordStart || wordStart) {
+            state = State::LineComment;
+            lineHadComment = true;
+            return;
+        }
+    }
+    if (c != '/' && c != '\n') {
+        lastToken = c;
+        lastWord.clear();
+    }
+    if (c == '"' && rules->rawStrings && lastChar == 'R' && (!isWordChar(beforeLast) || isOneOf(beforeLast, "uUL8"))) {
+        if (visible)
+            out += c;
+        rawDelimiter.clear();
+        state = State::RawDelimiter;
+        return;
+    }
+    if ((c == '"' || c == '\'' || c == '`') && !(c == '\'' && rules->digitSeparators && std::isdigit(static_cast<unsigned char>(lastChar)))) {
+        if (visible)
+            out += c;
+        quote = c;
+        escapes = !isOneOf(c, rules->rawQuotes);
+        multiline = isOneOf(c, rules->multilineQuotes);
+        state = isOneOf(c, rules->tripleQuotes) ? State::Quote1 : State::String;
+        return;
+    }
+    if (c == '<' && rules->hereDocuments) {
+        out += c;
+        lastChar = c;
+        state = State::HereLess;
+        return;
+    }
+    if (outline && rules->braceOutline) {
+        if (!visible) {
+            if (c == '{')
+                bodyDepth++;
+            else if (c == '}' && --bodyDepth == 0)
+                lastChar = '}';
+            return;
+        }
+        if (c == '{') {
+            openBrace(out);
+            return;
+        }
+        if ((c == '}' || c == ';') && !inDirective)
+            statement.clear();
+        if (c == '#' && rules->directives) {
+            size_t at = lineStart;
+            while (at < out.size() && isBlank(out[at]))
+                at++;
+            inDirective = at == out.size() && !lineStarted;
+        }
+    }
+    if (outline && rules->indentOutline) {
+        if (c == '(' || c == '[' || c == '{')
+            parenDepth++;
+        else if ((c == ')' || c == ']' || c == '}') && parenDepth > 0)
+            parenDepth--;
+    }
+    out += c;
+    beforeLast = lastChar;
+    lastChar = c;
+}
+
+void Minifier::feed(const char *data, size_t size, std::string &out) {
+    if (!rules) {
+        out.append(data, size);
+        return;
+    }
+    lineStart = out.size();
+    out += held;
+    held.clear();
+
+    const ByteSet &codeSet = outline ? rules->outlineCode : rules->code;
+    const char *p = data;
+    const char *end = data + size;
+    while (p < end) {
+        switch (state) {
+        case State::Code: {
+            if (skipBlanks) {
+                while (p < end && isBlank(*p))
+                    ++p;
+                if (p == end)
+                    break;
+                skipBlanks = false;
+            }
+            const bool visible = bodyDepth == 0;
+            const char *q = (visible ? codeSet : rules->bodyCode).find(p, end);
+            if (q > p) {
+                if (visible) {
+                    out.append(p, q);
+                    if (outline && statement.size() < kStatementBytes)
+                        statement.append(p, std::min<size_t>(static_cast<size_t>(q - p), kStatementBytes - statement.size()));
+                }
+                if (rules->regexLiterals) {
+                    // The last token of the run, and the word it ends.
+                    const char *s = q;
+                    while (s > p && isBlank(s[-1]))
+                        --s;
+                    if (s > p) {
+                        const char *w = s;
+                        while (w > p && isWordChar(w[-1]))
+                            --w;
+                        if (w == s) {
+                            lastWord.clear();
+                        } else if (w == p && isWordChar(lastChar)) {
+                            if (lastWord.size() < 16) // Begun in the previous run.
+                                lastWord.append(p, std::min<size_t>(static_cast<size_t>(s - p), 16));
+                        } else {
+                            lastWord.assign(w, std::min<size_t>(static_cast<size_t>(s - w), 16));
+                        }
+                        lastToken = s[-1];
+                    }
+                }
+                beforeLast = q - p >= 2 ? q[-2] : lastChar;
+                lastChar = q[-1];
+            }
+            if (q == end) {
+                p = end;
+                break;
+            }
+            p = q + 1;
+            if (*q == '#' && rules->shebang && consumed == 0 && q == data)
+                state = State::HashAtStart;
+            else
+                codeByte(*q, out);
+            break;
+        }
+        case State::Slash:
+            if (*p == '/') {
+                state = State::LineComment;
+                lineHadComment = true;
+                ++p;
+            } else if (*p == '*') {
+                state = State::BlockComment;
+                lineHadComment = true;
+                ++p;
+            } else if (rules->regexLiterals && regexMayFollow(lastToken, lastWord)) {
+                if (bodyDepth == 0)
+                    out += '/';
+                state = State::Regex;
+            } else {
+                if (bodyDepth == 0)
+                    out += '/';
+                lastChar = '/';
+                lastToken = '/';
+                lastWord.clear();
+                state = State::Code;
+            }
+            break;
+        case State::LineComment: {
+            // The newline itself is handled as code, unless (in C, where
+            // lines are spliced before comments are removed) a backslash
+            // before it continues the comment on the next line.
+            const char *q = static_cast<const char *>(std::memchr(p, '\n', static_cast<size_t>(end - p)));
+            if (rules->directives)
+                commentSplice = endsInBackslash(p, q ? q : end, commentSplice);
+            if (q && commentSplice) {
+                p = q + 1;
+                commentSplice = false;
+                continue;
+            }
+            p = q ? q : end;
+            if (q)
+                state = State::Code;
+            break;
+        }
+        case State::BlockComment: {
+            const char *q = static_cast<const char *>(std::memchr(p, '*', static_cast<size_t>(end - p)));
+            p = q ? q + 1 : end;
+            if (q)
+                state = State::BlockStar;
+            break;
+        }
+        case State::BlockStar:
+            if (*p == '/') {
+                // Keep the tokens on either side apart, by one blank at
+                // most (none at the start of a line).
+                if (lastChar != '\n' && !isBlank(lastChar)) {
+                    if (bodyDepth == 0)
+                        out += ' ';
+                    lastChar = ' ';
+                }
+                skipBlanks = true;
+                state = State::Code;
+                ++p;
+            } else if (*p == '*') {
+                ++p;
+            } else {
+                state = State::BlockComment;
+            }
+            break;
+        case State::String: {
+            const bool visible = bodyDepth == 0;
+            const char *q = stringDelimiters(quote).find(p, end);
+            if (visible)
+                out.append(p, q);
+            if (q == end) {
+                p = end;
+                break;
+            }
+            char c = *q;
+            if (c == '\n' && !multiline) {
+                // Unterminated: resynchronize at the end of the line.
+                state = State::Code;
+                p = q;
+                break;
+            }
+            p = q + 1;
+            if (c == '\n') {
+                if (visible)
+                    endLine(out, true);
+                continue;
+            }
+            if (visible)
+                out += c;
+            if (c == '\\') {
+                if (escapes)
+                    state = State::StringEscape;
+            } else {
+                state = State::Code;
+                lastChar = c;
+            }
+            break;
+        }
+        case State::StringEscape:
+        case State::TripleEscape:
+            if (bodyDepth == 0) {
+                if (*p == '\n')
+                    endLine(out, true);
+                else
+                    out += *p;
+            }
+            state = state == State::StringEscape ? State::String : State::TripleString;
+            ++p;
+            break;
+        case State::Quote1:
+            if (*p == quote) {
+                if (bodyDepth == 0)
+                    out += *p;
+                state = State::Quote2;
+                ++p;
+            } else {
+                state = State::String;
+            }
+            break;
+        case State::Quote2:
+            if (*p == quote) {
+                if (bodyDepth == 0)
+                    out += *p;
+                state = State::TripleString;
+                closingQuotes = 0;
+                ++p;
+            } else {
+                // An empty string.
+                state = State::Code;
+                lastChar = quote;
+            }
+            break;
+        case State::TripleString: {
+            const bool visible = bodyDepth == 0;
+            const char *q = stringDelimiters(quote).find(p, end);
+            if (q > p) {
+                if (visible)
+                    out.append(p, q);
+                closingQuotes = 0;
+            }
+            if (q == end) {
+                p = end;
+                break;
+            }
+            char c = *q;
+            p = q + 1;
+            if (c == '\n') {
+                if (visible)
+                    endLine(out, true);
+                closingQuotes = 0;
+                continue;
+            }
+            if (visible)
+                out += c;
+            if (c == '\\') {
+                state = State::TripleEscape;
+                closingQuotes = 0;
+            } else if (++closingQuotes == 3) {
+                state = State::Code;
+                lastChar = c;
+            }
+            break;
+        }
+        case State::HashAtStart:
+            if (*p == '!') {
+                out += "#!";
+                state = State::KeepLine;
+                ++p;
+            } else {
+                state = State::LineComment;
+                lineHadComment = true;
+            }
+            break;
+        case State::HereLess:
+            if (*p == '<') {
+                out += '<';
+                state = State::HereDash;
+                ++p;
+            } else {
+                state = State::Code;
+            }
+            break;
+        case State::HereDash:
+            hereWord.clear();
+            hereQuote = 0;
+            hereEscape = false;
+            hereQuoted = false;
+            hereStripTabs = *p == '-';
+            if (*p == '<') {
+                // "<<<": a here-string, which is an ordinary word.
+                out += '<';
+                lastChar = '<';
+                state = State::Code;
+                ++p;
+                break;
+            }
+            state = State::HereWord;
+            if (*p == '-') {
+                out += '-';
+                ++p;
+            }
+            break;
+        case State::HereWord: {
+            // Delimiters are short: byte by byte, with shell quoting.
+            char c = *p;
+            if (hereEscape) {
+                hereWord += c;
+                hereEscape = false;
+            } else if (hereQuote != 0) {
+                if (c == '\n') {
+                    state = State::Code; // Not a delimiter after all.
+                    break;
+                }
+                if (c == hereQuote)
+                    hereQuote = 0;
+                else
+                    hereWord += c;
+            } else if (c == '\'' || c == '"') {
+                hereQuote = c;
+                hereQuoted = true;
+            } else if (c == '\\') {
+                hereEscape = true;
+                hereQuoted = true;
+            } else if (isBlank(c) && hereWord.empty() && !hereQuoted) {
+                // Blanks before the word.
+            } else if (c == '\n' || isBlank(c) || isOneOf(c, ";|&<>()")) {
+                // The end of the word, which is handled as code. An
+                // unquoted number is taken for a shift, as in $((1<<2)).
+                bool number = !hereQuoted && !hereWord.empty() &&
+                              std::all_of(hereWord.begin(), hereWord.end(),
+                                          [](char d) { return std::isdigit(static_cast<unsigned char>(d)) != 0; });
+                if ((hereQuoted || !hereWord.empty()) && !number)
+                    hereDocuments.push_back({hereWord, hereStripTabs});
+                state = State::Code;
+                break;
+            } else {
+                hereWord += c;
+            }
+            out += c;
+            lastChar = c;
+            ++p;
+            break;
+        }
+        case State::HereBody: {
+            const char *q = static_cast<const char *>(std::memchr(p, '\n', static_cast<size_t>(end - p)));
+            const char *lineEnd = q ? q : end;
+            const HereDocument &document = hereDocuments.front();
+            for (const char *s = p; s < lineEnd && hereLine.size() <= document.delimiter.size(); ++s) {
+                if (hereLineStart && document.stripTabs && *s == '\t')
+                    continue;
+                hereLineStart = false;
+                hereLine += *s;
+            }
+            out.append(p, lineEnd);
+            if (!q) {
+                p = end;
+                break;
+            }
+            p = q + 1;
+            endLine(out, true);
+            if (hereLine == document.delimiter) {
+                hereDocuments.erase(hereDocuments.begin());
+                if (hereDocuments.empty())
+                    state = State::Code;
+            }
+            hereLine.clear();
+            hereLineStart = true;
+            break;
+        }
+        case State::RawDelimiter: {
+            char c = *p;
+            if (c != '(' && (rawDelimiter.size() >= 16 || isBlank(c) || isOneOf(c, "\n)\\\""))) {
+                // Not a valid raw string: lex it as an ordinary one.
+                quote = '"';
+                escapes = true;
+                multiline = false;
+                state = State::String;
+                break;
+            }
+            if (c == '(')
+                state = State::RawString;
+            else
+                rawDelimiter += c;
+            if (bodyDepth == 0)
+                out += c;
+            ++p;
+            break;
+        }
+        case State::RawString: {
+            const bool visible = bodyDepth == 0;
+            const char *q = kRawString.find(p, end);
+            if (visible)
+                out.append(p, q);
+            if (q == end) {
+                p = end;
+                break;
+            }
+            p = q + 1;
+            if (*q == '\n') {
+                if (visible)
+                    endLine(out, true);
+                continue;
+            }
+            if (visible)
+                out += ')';
+            rawMatched = 0;
+            state = State::RawClose;
+            break;
+        }
+        case State::RawClose:
+            if (rawMatched < rawDelimiter.size() && *p == rawDelimiter[rawMatched]) {
+                rawMatched++;
+            } else if (rawMatched == rawDelimiter.size() && *p == '"') {
+                state = State::Code;
+                lastChar = '"';
+            } else {
+                state = State::RawString; // Not the end; *p is lexed there.
+                break;
+            }
+            if (bodyDepth == 0)
+                out += *p;
+            ++p;
+            break;
+        case State::Regex:
+        case State::RegexClass: {
+            char c = *p;
+            if (c == '\n') {
+                state = State::Code; // Unterminated: resynchronize at the end of the line.
+                break;
+            }
+            if (bodyDepth == 0)
+                out += c;
+            ++p;
+            if (c == '\\') {
+                state = state == State::Regex ? State::RegexEscape : State::RegexClassEscape;
+            } else if (state == State::Regex && c == '[') {
+                state = State::RegexClass;
+            } else if (state == State::RegexClass && c == ']') {
+                state = State::Regex;
+            } else if (state == State::Regex && c == '/') {
+                // Like a value: a '/' after it (and its flags) divides.
+                state = State::Code;
+                lastChar = '/';
+                lastToken = ')';
+                lastWord.clear();
+            }
+            break;
+        }
+        case State::RegexEscape:
+        case State::RegexClassEscape:
+            if (*p == '\n') {
+                state = State::Code;
+                break;
+            }
+            if (bodyDepth == 0)
+                out += *p;
+            state = state == State::RegexEscape ? State::Regex : State::RegexClass;
+            ++p;
+            break;
+        case State::KeepLine: {
+            const char *q = static_cast<const char *>(std::memchr(p, '\n', static_cast<size_t>(end - p)));
+            out.append(p, q ? q : end);
+            p = q ? q : end;
+            if (q)
+                state = State::Code;
+            break;
+        }
+        }
+    }
+
+    consumed += size;
+    // Short lines are held back whole. Of a longer one, only what its end
+    // can still change is: its trailing blanks, or all of it while it may
+    // turn out to be blank.
+    if (out.size() - lineStart >= kHoldBytes || lineStarted) {
+        size_t keep = out.size();
+        while (keep > lineStart && isBlank(out[keep - 1]))
+            --keep;
+        if (!lineDecided && (keep > lineStart || lineBeganInString))
+            decideLine(out);
+        if (lineDecided && lineLimit != std::string::npos) {
+            out.resize(std::min(out.size(), lineStart + lineLimit));
+            keep = std::min(keep, out.size());
+        }
+        if (keep > lineStart && !lineStarted && blankPending) {
+            out.insert(out.begin() + static_cast<std::ptrdiff_t>(lineStart), '\n');
+            blankPending = false;
+            keep++;
+        }
+        if (keep > lineStart || (lineDecided && lineLimit == 0))
+            lineStarted = true;
+        if (lineStarted) {
+            if (lineLimit != std::string::npos)
+                lineLimit -= keep - lineStart;
+            lineStart = keep;
+        }
+    }
+    held.assign(out, lineStart, std::string::npos);
+    out.resize(lineStart);
+}
+
+void Minifier::finish(std::string &out) {
+    if (!rules)
+        return;
+    lineStart = out.size();
+    out += held;
+    held.clear();
+    bool inString = false;
+    switch (state) {
+    case State::Slash:
+        if (bodyDepth == 0)
+            out += '/';
+        break;
+    case State::Code:
+    case State::LineComment:
+    case State::BlockComment:
+    case State::BlockStar:
+    case State::HashAtStart:
+    case State::KeepLine:
+    case State::HereLess:
+    case State::HereDash:
+    case State::HereWord:
+    case State::Regex:
+    case State::RegexEscape:
+    case State::RegexClass:
+    case State::RegexClassEscape:
+        break;
+    default:
+        // Inside a string: its bytes stand as they are.
+        inString = true;
+        break;
+    }
+    state = State::Code;
+    if (!inString) {
+        while (out.size() > lineStart && isBlank(out.back()))
+            out.pop_back();
+    }
+    if (!lineDecided && out.size() > lineStart)
+        decideLine(out);
+    if (lineDecided && lineLimit != std::string::npos && out.size() - lineStart > lineLimit)
+        out.resize(lineStart + lineLimit);
+    if (blankPending && !lineStarted && out.size() > lineStart)
+        out.insert(out.begin() + static_cast<std::ptrdiff_t>(lineStart), '\n');
+}
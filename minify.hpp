@@ -0,0 +1,146 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+enum class SourceLanguage { None, C, Python, JavaScript, Java, Go, Shell };
+
+/**
+ * The language of a file, from its extension. C covers C, C++ and CUDA;
+ * JavaScript covers TypeScript. None for everything else.
+ */
+SourceLanguage languageForPath(const fs::path &path);
+
+/**
+ * Whether Minifier can outline files of language (all but shell).
+ */
+bool canOutline(SourceLanguage language);
+
+struct MinifyRules;
+
+/**
+ * Streaming comment and whitespace stripper for one file. A hand-written
+ * lexer follows code, comments and string literals; comments are removed,
+ * trailing whitespace is trimmed, lines left empty by a comment disappear
+ * and runs of blank lines collapse to one. String literals (including
+ * multi-line ones) are copied byte for byte, and indentation is kept.
+ * Input can be split anywhere: the lexer state carries over between calls.
+ *
+ * With outline set, function bodies are left out as well. In brace
+ * languages a '{' opens a body unless the statement before it declares a
+ * namespace, class, struct, union, enum, interface or extern block (and has
+ * no '(' or '='); the body is written as "{ ... }". In Python, the lines
+ * indented below a def are replaced by one "..." line.
+ */
+class Minifier {
+public:
+    explicit Minifier(SourceLanguage language, bool outline = false);
+
+    /**
+     * Minify the next size bytes of the file, appending the result to out.
+     * The end of the line in progress is held back until the line ends.
+     */
+    void feed(const char *data, size_t size, std::string &out);
+
+    /**
+     * Append whatever is held back; the file has no more bytes.
+     */
+    void finish(std::string &out);
+
+private:
+    enum class State {
+        Code,
+        Slash,        // Saw '/': division or the start of a comment.
+        LineComment,
+        BlockComment,
+        BlockStar,    // Saw '*' in a block comment.
+        String,
+        StringEscape,
+        Quote1,       // Saw a quote that may open a triple-quoted string.
+        Quote2,
+        TripleString,
+        TripleEscape,
+        HashAtStart,  // Saw '#' as the first byte: a shebang or a comment.
+        KeepLine,     // The shebang line.
+        HereLess,     // Shell: saw '<', maybe the start of "<<".
+        HereDash,     // Saw "<<": "<<-", "<<<" or the word.
+        HereWord,     // The delimiter word of a here-document.
+        HereBody,     // A line of a here-document, copied as it is.
+        RawDelimiter, // C++: after R", up to the '('.
+        RawString,
+        RawClose,     // Saw ')' in a raw string: maybe the closing delimiter.
+        Regex,        // JavaScript regular expression literal.
+        RegexEscape,
+        RegexClass,   // In [...] of a regular expression, where '/' does not end it.
+        RegexClassEscape,
+    };
+
+    // A here-document whose body starts after the current line.
+    struct HereDocument {
+        std::string delimiter;
+        bool stripTabs;         // "<<-": leading tabs of the closing line are ignored.
+    };
+
+    void endLine(std::string &out, bool verbatim);
+    void decideLine(std::string &out);
+    void codeByte(char c, std::string &out);
+    void openBrace(std::string &out);
+
+    const MinifyRules *rules;
+    const bool outline;
+    State state = State::Code;
+    char quote = 0;             // Delimiter of the string being copied.
+    bool escapes = true;        // Whether backslash escapes in that string.
+    bool multiline = false;     // Whether newlines may appear in it.
+    int closingQuotes = 0;      // Of a triple-quoted string.
+    char lastChar = '\n';       // Last code byte seen.
+    char beforeLast = '\n';     // The code byte before it (for the R of raw strings).
+    bool skipBlanks = false;    // After a block comment: drop the blanks that follow.
+    bool lineHadComment = false;
+    bool commentSplice = false; // C: the line comment so far ends in a backslash.
+    bool lineStarted = false;   // Part of the current line is already out.
+    bool anyLine = false;       // A non-blank line was written.
+    bool blankPending = false;  // A blank line goes before the next one.
+    size_t lineStart = 0;       // Offset of the current line in out.
+    uint64_t consumed = 0;      // Bytes fed before this call.
+    std::string held;           // The unfinished end of the current line.
+
+    // Outline of brace languages.
+    int bodyDepth = 0;          // Braces open in the body being left out.
+    bool inDirective = false;   // A preprocessor line: its braces do not count.
+    std::string statement;      // Start of the code since the last ';', '{' or '}'.
+
+    // Outline of Python, decided line by line.
+    bool lineDecided = false;
+    size_t lineLimit = std::string::npos; // Bytes of the current line kept.
+    bool lineBeganInString = false;
+    bool stringElided = false;  // The string that continues is in a left out body.
+    int parenDepth = 0;
+    bool inHeader = false;      // In a def line whose brackets are still open.
+    int headerIndent = 0;
+    int bodyIndent = -1;        // Lines indented deeper are in a def body.
+    bool placeholderWritten = false;
+
+    // Shell here-documents.
+    std::vector<HereDocument> hereDocuments; // Pending, in the order of their bodies.
+    std::string hereWord;       // Delimiter being read, quotes removed.
+    char hereQuote = 0;         // Quote open in it.
+    bool hereEscape = false;
+    bool hereQuoted = false;    // Part of it was quoted.
+    bool hereStripTabs = false;
+    std::string hereLine;       // Start of the body line, to compare with the delimiter.
+    bool hereLineStart = true;  // Only tabs seen on the body line so far.
+
+    // C++ raw strings.
+    std::string rawDelimiter;
+    size_t rawMatched = 0;      // Bytes of the delimiter matched after ')'.
+
+    // JavaScript: whether a '/' starts a regular expression or divides.
+    char lastToken = '\n';      // Last code byte that is not blank or a newline.
+    std::string lastWord;       // The word it ends, if it is a word character.
+};
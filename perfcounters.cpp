@@ -0,0 +1,163 @@
+#include "perfcounters.hpp"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <ostream>
+#include <string>
+
+#include "stats.hpp"
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+bool perfCountersEnabled = false;
+
+namespace {
+
+const char *kEventNames[kPerfEvents] = {"cycles", "instructions", "cache-misses", "branch-misses", "page-faults",
+                                        "ctx-switches"};
+
+int eventFds[kPerfEvents] = {-1, -1, -1, -1, -1, -1};
+int64_t runStartCounts[kPerfEvents];
+bool kernelExcluded = false;  // Only user-space events could be counted.
+
+// Counts of each step (steps run one at a time, on the main thread).
+int64_t stepCounts[kPhases][kPerfEvents] = {};
+bool stepSeen[kPhases] = {};
+
+#if defined(__linux__)
+int openEvent(uint32_t type, uint64_t config, bool excludeKernel) {
+    perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.inherit = 1;
+    attr.exclude_kernel = excludeKernel ? 1 : 0;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+}
+#endif
+
+void printRow(std::ostream &out, const char *name, const int64_t counts[kPerfEvents]) {
+    char line[192];
+    int length = std::snprintf(line, sizeof(line), "%-14s", name);
+    for (int i = 0; i < kPerfEvents; ++i) {
+        if (counts[i] < 0)
+            length += std::snprintf(line + length, sizeof(line) - length, " %14s", "n/a");
+        else
+            length += std::snprintf(line + length, sizeof(line) - length, " %14lld", static_cast<long long>(counts[i]));
+        if (i == static_cast<int>(PerfEvent::Instructions)) {
+            // Instructions per cycle, next to the two counts it comes from.
+            int64_t cycles = counts[static_cast<int>(PerfEvent::Cycles)];
+            if (counts[i] >= 0 && cycles > 0)
+                length += std::snprintf(line + length, sizeof(line) - length, " %6.2f",
+                                        static_cast<double>(counts[i]) / static_cast<double>(cycles));
+            else
+                length += std::snprintf(line + length, sizeof(line) - length, " %6s", "n/a");
+        }
+    }
+    out << line << "\n";
+}
+
+} // namespace
+
+bool enablePerfCounters() {
+#if defined(__linux__)
+    const struct {
+        uint32_t type;
+        uint64_t config;
+    } events[kPerfEvents] = {
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+        {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS},
+        {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES},
+    };
+    bool any = false;
+    std::string unavailable;
+    int lastError = 0;
+    for (int i = 0; i < kPerfEvents; ++i) {
+        // Counting kernel code as well needs perf_event_paranoid <= 1.
+        eventFds[i] = openEvent(events[i].type, events[i].config, false);
+        if (eventFds[i] < 0 && (errno == EACCES || errno == EPERM)) {
+            eventFds[i] = openEvent(events[i].type, events[i].config, true);
+            if (eventFds[i] >= 0)
+                kernelExcluded = true;
+        }
+        if (eventFds[i] < 0) {
+            lastError = errno;
+            unavailable += unavailable.empty() ? "" : ", ";
+            unavailable += kEventNames[i];
+            continue;
+        }
+        any = true;
+    }
+    if (!unavailable.empty())
+        std::cerr << "Performance counters not available: " << unavailable << " (" << std::strerror(lastError)
+                  << ")\n";
+    if (!any)
+        return false;
+    perfCountersEnabled = true;
+    readPerfCounters(runStartCounts);
+    return true;
+#else
+    std::cerr << "Performance counters are only supported on Linux\n";
+    return false;
+#endif
+}
+
+void readPerfCounters(int64_t values[kPerfEvents]) {
+    for (int i = 0; i < kPerfEvents; ++i) {
+        values[i] = -1;
+#if defined(__linux__)
+        if (eventFds[i] < 0)
+            continue;
+        uint64_t data[3]; // Value, time enabled, time running.
+        if (read(eventFds[i], data, sizeof(data)) != static_cast<ssize_t>(sizeof(data)))
+            continue;
+        if (data[2] > 0 && data[2] < data[1])
+            data[0] = static_cast<uint64_t>(static_cast<double>(data[0]) * data[1] / data[2]);
+        values[i] = static_cast<int64_t>(data[0]);
+#endif
+    }
+}
+
+void addPerfCounts(int phase, const int64_t start[kPerfEvents], const int64_t end[kPerfEvents]) {
+    stepSeen[phase] = true;
+    for (int i = 0; i < kPerfEvents; ++i) {
+        if (start[i] < 0 || end[i] < 0 || stepCounts[phase][i] < 0)
+            stepCounts[phase][i] = -1;
+        else
+            stepCounts[phase][i] += end[i] - start[i];
+    }
+}
+
+void printPerfCounters(std::ostream &out) {
+    char line[192];
+    int length = std::snprintf(line, sizeof(line), "%-14s", "Counters");
+    for (int i = 0; i < kPerfEvents; ++i) {
+        length += std::snprintf(line + length, sizeof(line) - length, " %14s", kEventNames[i]);
+        if (i == static_cast<int>(PerfEvent::Instructions))
+            length += std::snprintf(line + length, sizeof(line) - length, " %6s", "IPC");
+    }
+    out << line << "\n";
+    for (int phase = 0; phase < static_cast<int>(kFirstOperation); ++phase) {
+        if (stepSeen[phase])
+            printRow(out, phaseName(static_cast<Phase>(phase)), stepCounts[phase]);
+    }
+    int64_t now[kPerfEvents];
+    readPerfCounters(now);
+    for (int i = 0; i < kPerfEvents; ++i)
+        now[i] = now[i] < 0 ? -1 : now[i] - runStartCounts[i];
+    printRow(out, "total", now);
+    if (kernelExcluded)
+        out << "(user space only: perf_event_paranoid does not allow counting the kernel)\n";
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstdint>
+#include <iosfwd>
+
+// Hardware and kernel counters read for --perf-counters.
+enum class PerfEvent { Cycles, Instructions, CacheMisses, BranchMisses, PageFaults, ContextSwitches };
+const int kPerfEvents = static_cast<int>(PerfEvent::ContextSwitches) + 1;
+
+// Set once, before any work starts, by enablePerfCounters.
+extern bool perfCountersEnabled;
+
+/**
+ * Open the counters with perf_event_open for this process, including the
+ * threads it starts later. Counters the machine or the permissions do not
+ * allow (hardware events in most VMs, for instance) are left out with a
+ * note on stderr; returns false if none could be opened. Linux only.
+ */
+bool enablePerfCounters();
+
+/**
+ * The current value of every counter, scaled up if the kernel had to
+ * multiplex it; -1 for counters that are not open.
+ */
+void readPerfCounters(int64_t values[kPerfEvents]);
+
+/**
+ * Add the counts between start and end to the step with index phase.
+ */
+void addPerfCounts(int phase, const int64_t start[kPerfEvents], const int64_t end[kPerfEvents]);
+
+/**
+ * Write the counts of every step and of the whole run to out.
+ */
+void printPerfCounters(std::ostream &out);
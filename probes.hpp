@@ -0,0 +1,30 @@
+#pragma once
+
+/**
+ * USDT (SystemTap SDT) probes of the "projectcompressor" provider, for
+ * bpftrace and other tracers to attach to a running process:
+ *
+ *   tree__start(root), tree__done(root, files)
+ *   directory__start(dir), directory__done(dir, entries)
+ *   ignore(path, ignored)
+ *   classify(path, bytes, binary)
+ *   segment__start(path, size), segment__done(path, kind)
+ *   write(bytes, offset), copy(offset, length)
+ *
+ * Paths are C strings. A probe compiles to a single nop plus a note in the
+ * ELF file. Its arguments are evaluated whether or not a tracer is attached,
+ * so they are kept to values at hand, such as c_str() of a path. Without
+ * <sys/sdt.h> at build time (or with PROJECTCOMPRESSOR_USDT off), the
+ * macros expand to nothing and their arguments are not evaluated.
+ */
+
+#if defined(PROJECTCOMPRESSOR_HAVE_SDT)
+#include <sys/sdt.h>
+#define PROJECTCOMPRESSOR_PROBE1(name, a) DTRACE_PROBE1(projectcompressor, name, a)
+#define PROJECTCOMPRESSOR_PROBE2(name, a, b) DTRACE_PROBE2(projectcompressor, name, a, b)
+#define PROJECTCOMPRESSOR_PROBE3(name, a, b, c) DTRACE_PROBE3(projectcompressor, name, a, b, c)
+#else
+#define PROJECTCOMPRESSOR_PROBE1(name, a) ((void)0)
+#define PROJECTCOMPRESSOR_PROBE2(name, a, b) ((void)0)
+#define PROJECTCOMPRESSOR_PROBE3(name, a, b, c) ((void)0)
+#endif
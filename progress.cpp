@@ -0,0 +1,158 @@
+#include "progress.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "stats.hpp"
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace {
+
+ProgressStyle progressStyle = ProgressStyle::Line;
+bool interactive = false;   // stderr is a terminal: redraw one line.
+std::thread reporter;
+std::mutex reporterMutex;
+std::condition_variable reporterWake;
+bool stopping = false;
+
+std::atomic<bool> haveTotal{false};
+std::atomic<uint64_t> totalFiles{0};
+std::atomic<uint64_t> totalBytes{0};
+std::atomic<int64_t> combiningStartNs{0}; // Since started.
+
+// Kept by the reporter thread only.
+std::chrono::steady_clock::time_point started;
+double lastSeconds = 0;
+uint64_t lastBytesDone = 0;
+double smoothedRate = 0;    // Bytes per second, averaged over the last few samples.
+bool sawCombining = false;
+
+std::string formatMiB(uint64_t bytes) {
+    char text[32];
+    std::snprintf(text, sizeof(text), "%.1f", static_cast<double>(bytes) / (1024.0 * 1024.0));
+    return text;
+}
+
+std::string formatDuration(double seconds) {
+    long total = static_cast<long>(seconds + 0.5);
+    char text[32];
+    if (total >= 3600)
+        std::snprintf(text, sizeof(text), "%ld:%02ld:%02ld", total / 3600, total / 60 % 60, total % 60);
+    else
+        std::snprintf(text, sizeof(text), "%ld:%02ld", total / 60, total % 60);
+    return text;
+}
+
+void report(bool final) {
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    uint64_t directories = eventCount(Counter::Directories);
+    uint64_t files = eventCount(Counter::Files);
+    uint64_t filesDone = eventCount(Counter::Segments);
+    uint64_t bytesDone = eventCount(Counter::SegmentBytes);
+    uint64_t bytesWritten = eventCount(Counter::BytesWritten) + eventCount(Counter::BytesCopied);
+    const bool combining = haveTotal.load(std::memory_order_acquire);
+    const uint64_t filesTotal = totalFiles.load(std::memory_order_relaxed);
+    const uint64_t bytesTotal = totalBytes.load(std::memory_order_relaxed);
+
+    if (combining && !sawCombining) {
+        // Measure the rate from the start of the writing, not of the listing.
+        sawCombining = true;
+        lastSeconds = static_cast<double>(combiningStartNs.load(std::memory_order_relaxed)) / 1e9;
+        lastBytesDone = 0;
+    }
+    if (final && combining) {
+        double writing = seconds - static_cast<double>(combiningStartNs.load(std::memory_order_relaxed)) / 1e9;
+        smoothedRate = writing > 0 ? static_cast<double>(bytesDone) / writing : 0;
+    } else if (seconds > lastSeconds) {
+        double rate = static_cast<double>(bytesDone - lastBytesDone) / (seconds - lastSeconds);
+        smoothedRate = smoothedRate == 0 ? rate : 0.7 * smoothedRate + 0.3 * rate;
+    }
+    lastSeconds = seconds;
+    lastBytesDone = bytesDone;
+    double eta = -1;
+    if (combining && smoothedRate > 0 && bytesTotal >= bytesDone)
+        eta = static_cast<double>(bytesTotal - bytesDone) / smoothedRate;
+
+    std::string text;
+    if (progressStyle == ProgressStyle::Json) {
+        char line[512];
+        std::snprintf(line, sizeof(line),
+                      "{\"elapsed\":%.3f,\"phase\":\"%s\",\"directories\":%llu,\"files\":%llu,"
+                      "\"filesDone\":%llu,\"filesTotal\":%llu,\"bytesDone\":%llu,\"bytesTotal\":%llu,"
+                      "\"bytesWritten\":%llu,\"rate\":%.0f,\"eta\":%.1f}\n",
+                      seconds, final ? "done" : combining ? "combining" : "listing",
+                      static_cast<unsigned long long>(directories), static_cast<unsigned long long>(files),
+                      static_cast<unsigned long long>(filesDone), static_cast<unsigned long long>(filesTotal),
+                      static_cast<unsigned long long>(bytesDone), static_cast<unsigned long long>(bytesTotal),
+                      static_cast<unsigned long long>(bytesWritten), smoothedRate, eta);
+        text = line;
+    } else {
+        if (!combining) {
+            text = "Listing: " + std::to_string(directories) + " directories, " + std::to_string(files) + " files";
+        } else {
+            int percent = bytesTotal ? static_cast<int>(100.0 * static_cast<double>(bytesDone) / bytesTotal) : 100;
+            text = "Combining: " + std::to_string(filesDone) + " of " + std::to_string(filesTotal) + " files, " +
+                   formatMiB(bytesDone) + " of " + formatMiB(bytesTotal) + " MiB (" + std::to_string(percent) +
+                   "%), " + formatMiB(static_cast<uint64_t>(smoothedRate)) + " MiB/s";
+            if (!final && eta >= 0)
+                text += ", " + formatDuration(eta) + " left";
+        }
+        text += ", " + formatDuration(seconds) + " elapsed";
+        text = interactive ? "\r\033[K" + text + (final ? "\n" : "") : text + "\n";
+    }
+    std::cerr << text << std::flush;
+}
+
+void reporterLoop() {
+    const auto interval = std::chrono::milliseconds(
+        progressStyle == ProgressStyle::Json ? 1000 : interactive ? 200 : 5000);
+    std::unique_lock<std::mutex> lock(reporterMutex);
+    while (!reporterWake.wait_for(lock, interval, [] { return stopping; }))
+        report(false);
+    report(true);
+}
+
+} // namespace
+
+void startProgress(ProgressStyle style) {
+    progressStyle = style;
+#ifdef _WIN32
+    interactive = _isatty(_fileno(stderr)) != 0;
+#else
+    interactive = isatty(STDERR_FILENO) != 0;
+#endif
+    countersEnabled = true;
+    started = std::chrono::steady_clock::now();
+    reporter = std::thread(reporterLoop);
+}
+
+void setProgressTotal(uint64_t files, uint64_t bytes) {
+    totalFiles.store(files, std::memory_order_relaxed);
+    totalBytes.store(bytes, std::memory_order_relaxed);
+    combiningStartNs.store(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - started).count(),
+        std::memory_order_relaxed);
+    haveTotal.store(true, std::memory_order_release);
+}
+
+void stopProgress() {
+    if (!reporter.joinable())
+        return;
+    {
+        std::lock_guard<std::mutex> lock(reporterMutex);
+        stopping = true;
+    }
+    reporterWake.notify_one();
+    reporter.join();
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstdint>
+
+enum class ProgressStyle {
+    Line,   // A status line redrawn in place (or printed now and then when stderr is not a terminal).
+    Json,   // One JSON object per line, every second.
+};
+
+/**
+ * Start a thread that reports progress on stderr until stopProgress. It
+ * only samples the run's counters (see stats.hpp), which are relaxed
+ * atomics, so the work itself does nothing but count. While the tree is
+ * being listed it shows the directories and files found; once
+ * setProgressTotal is called it shows the files and bytes handled, the
+ * rate and the time left.
+ */
+void startProgress(ProgressStyle style);
+
+/**
+ * The files and bytes the writer is about to handle, known from the stat
+ * calls of the listing.
+ */
+void setProgressTotal(uint64_t files, uint64_t bytes);
+
+/**
+ * Print the final state and stop the thread.
+ */
+void stopProgress();
@@ -0,0 +1,394 @@
+#include "shard.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <iostream>
+#include <thread>
+#include <unordered_map>
+
+#include "budget.hpp"
+#include "hash.hpp"
+#include "manifest.hpp"
+
+namespace {
+
+const size_t kReadBufferSize = 1 << 18;
+
+// Room left in every shard for its banner.
+const uint64_t kBannerBytes = 1024;
+
+// What opening a file costs when parts are balanced, in bytes of reading.
+const uint64_t kFileCost = 4096;
+
+// Run work(i) for every i below count on up to one thread per core.
+template <typename Work>
+void parallelFor(size_t count, Work work) {
+    size_t threads = std::min<size_t>(count, std::max(1u, std::thread::hardware_concurrency()));
+    std::atomic<size_t> next{0};
+    auto worker = [&]() {
+        for (size_t i = next++; i < count; i = next++)
+            work(i);
+    };
+    std::vector<std::thread> pool;
+    for (size_t t = 1; t < threads; ++t)
+        pool.emplace_back(worker);
+    worker();
+    for (auto &thread : pool)
+        thread.join();
+}
+
+std::string shardBanner(size_t index, size_t count, const std::string &root, const std::vector<FileEntry> &files) {
+    std::string banner = "# ProjectCompressor shard " + std::to_string(index) + " of " + std::to_string(count) + "\n" +
+                         "# Root: " + root + "\n" +
+                         "# Files: " + std::to_string(files.size());
+    if (!files.empty())
+        banner += ", " + files.front().relPath + " to " + files.back().relPath;
+    return banner + "\n\n";
+}
+
+void combineSummaries(CombineSummary &total, const CombineSummary &part) {
+    total.written += part.written;
+    total.reused += part.reused;
+    total.binary += part.binary;
+    total.deduplicated += part.deduplicated;
+    total.linked += part.linked;
+    total.similar += part.similar;
+}
+
+// Files given to one part at a time: a top-level subtree or a single file.
+struct Unit {
+    std::string key;
+    uint64_t weight = 0;
+    uint64_t hash = 0;
+    std::vector<size_t> files;
+};
+
+// Parse name as the output stem, ".<index>-of-<count>" and the extension.
+bool parsePartName(const std::string &name, const fs::path &outputPath, ShardPart &part) {
+    std::string stem = outputPath.stem().string() + ".";
+    std::string extension = outputPath.extension().string();
+    if (name.size() <= stem.size() + extension.size() || name.rfind(stem, 0) != 0 ||
+        name.compare(name.size() - extension.size(), extension.size(), extension) != 0)
+        return false;
+    std::string middle = name.substr(stem.size(), name.size() - stem.size() - extension.size());
+    unsigned long index = 0, count = 0;
+    int consumed = 0;
+    if (std::sscanf(middle.c_str(), "%lu-of-%lu%n", &index, &count, &consumed) != 2 ||
+        static_cast<size_t>(consumed) != middle.size() || index == 0 || index > count)
+        return false;
+    part.index = index;
+    part.count = count;
+    return true;
+}
+
+} // namespace
+
+std::vector<std::vector<FileEntry>> partitionFiles(const std::vector<FileEntry> &files,
+                                                   const ShardLimits &limits,
+                                                   const CombineOptions &combine)
+{
+    std::vector<uint64_t> tokens(files.size(), 0);
+    if (limits.maxTokens > 0) {
+        parallelFor(files.size(), [&](size_t i) {
+            thread_local std::vector<char> buffer(kReadBufferSize);
+            estimateSegmentTokens(files[i], combine, buffer, tokens[i]);
+        });
+    }
+
+    std::vector<std::vector<FileEntry>> shards;
+    uint64_t shardBytes = kBannerBytes;
+    uint64_t shardTokens = 0;
+    for (size_t i = 0; i < files.size(); ++i) {
+        uint64_t bytes = files[i].path.string().size() + files[i].size + 14; // "# File: " and blank lines.
+        bool full = (limits.maxBytes > 0 && shardBytes + bytes > limits.maxBytes) ||
+                    (limits.maxTokens > 0 && shardTokens + tokens[i] > limits.maxTokens);
+        if (shards.empty() || (full && !shards.back().empty())) {
+            shards.emplace_back();
+            shardBytes = kBannerBytes;
+            shardTokens = 0;
+        }
+        shards.back().push_back(files[i]);
+        shardBytes += bytes;
+        shardTokens += tokens[i];
+    }
+    if (shards.empty())
+        shards.emplace_back();
+    return shards;
+}
+
+fs::path shardPath(const fs::path &outputPath, size_t index) {
+    char number[16];
+    std::snprintf(number, sizeof(number), ".%03zu", index);
+    fs::path result = outputPath.parent_path() / outputPath.stem();
+    result += number;
+    result += outputPath.extension();
+    return result;
+}
+
+bool writeShards(const std::vector<std::vector<FileEntry>> &shards,
+                 const fs::path &outputPath,
+                 const std::string &root,
+                 bool incremental,
+                 const CombineOptions &combine,
+                 CombineSummary &summary)
+{
+    std::vector<CombineSummary> summaries(shards.size());
+    std::vector<char> succeeded(shards.size(), 0);
+    parallelFor(shards.size(), [&](size_t i) {
+        fs::path path = shardPath(outputPath, i + 1);
+        CombineOptions options = combine;
+        options.banner = shardBanner(i + 1, shards.size(), root, shards[i]);
+        Manifest manifest;
+        manifest.root = root;
+        Manifest previous;
+        bool havePrevious = incremental && loadPreviousManifest(path, root, previous);
+        succeeded[i] = updateOutput(shards[i], path, havePrevious ? &previous : nullptr, manifest, summaries[i], options);
+    });
+
+    bool ok = true;
+    for (size_t i = 0; i < shards.size(); ++i) {
+        combineSummaries(summary, summaries[i]);
+        ok = ok && succeeded[i];
+    }
+
+    // Shards beyond the new count belong to an earlier run.
+    for (size_t index = shards.size() + 1;; ++index) {
+        fs::path stale = shardPath(outputPath, index);
+        std::error_code ec;
+        if (!fs::remove(stale, ec))
+            break;
+        fs::remove(manifestPathFor(stale), ec);
+    }
+    return ok;
+}
+
+std::vector<FileEntry> filesForPart(const std::vector<FileEntry> &files, const ShardPart &part) {
+    if (part.count <= 1)
+        return files;
+
+    std::vector<Unit> units;
+    std::unordered_map<std::string, size_t> unitOf;
+    uint64_t total = 0;
+    for (size_t i = 0; i < files.size(); ++i) {
+        const std::string &relPath = files[i].relPath;
+        std::string key = part.bySubtree ? relPath.substr(0, relPath.find('/')) : relPath;
+        auto it = unitOf.emplace(key, units.size()).first;
+        if (it->second == units.size())
+            units.push_back({key, 0, 0, {}});
+        Unit &unit = units[it->second];
+        unit.weight += files[i].size + kFileCost;
+        unit.files.push_back(i);
+        total += files[i].size + kFileCost;
+    }
+
+    // A subtree too large for one part is handed out file by file.
+    const uint64_t fairShare = total / part.count;
+    std::vector<Unit> split;
+    for (auto &unit : units) {
+        if (unit.weight <= fairShare || unit.files.size() == 1) {
+            split.push_back(std::move(unit));
+            continue;
+        }
+        for (size_t i : unit.files)
+            split.push_back({files[i].relPath, files[i].size + kFileCost, 0, {i}});
+    }
+    for (auto &unit : split)
+        unit.hash = hash64(unit.key.data(), unit.key.size());
+    std::sort(split.begin(), split.end(), [](const Unit &a, const Unit &b) {
+        if (a.weight != b.weight)
+            return a.weight > b.weight;
+        if (a.hash != b.hash)
+            return a.hash < b.hash;
+        return a.key < b.key;
+    });
+
+    std::vector<uint64_t> loads(part.count, 0);
+    std::vector<char> selected(files.size(), 0);
+    for (const auto &unit : split) {
+        size_t target = static_cast<size_t>(std::min_element(loads.begin(), loads.end()) - loads.begin());
+        loads[target] += unit.weight;
+        if (target + 1 == part.index) {
+            for (size_t i : unit.files)
+                selected[i] = 1;
+        }
+    }
+
+    std::vector<FileEntry> result;
+    for (size_t i = 0; i < files.size(); ++i) {
+        if (selected[i])
+            result.push_back(files[i]);
+    }
+    return result;
+}
+
+fs::path partPath(const fs::path &outputPath, const ShardPart &part) {
+    char number[48];
+    std::snprintf(number, sizeof(number), ".%zu-of-%zu", part.index, part.count);
+    fs::path result = outputPath.parent_path() / outputPath.stem();
+    result += number;
+    result += outputPath.extension();
+    return result;
+}
+
+bool writePart(const std::vector<FileEntry> &files,
+               const ShardPart &part,
+               const fs::path &outputPath,
+               const std::string &root,
+               bool incremental,
+               const CombineOptions &combine,
+               CombineSummary &summary)
+{
+    fs::path path = partPath(outputPath, part);
+    CombineOptions options = combine;
+    options.banner = shardBanner(part.index, part.count, root, files);
+    Manifest manifest;
+    manifest.root = root;
+    Manifest previous;
+    bool havePrevious = incremental && loadPreviousManifest(path, root, previous);
+    return updateOutput(files, path, havePrevious ? &previous : nullptr, manifest, summary, options);
+}
+
+std::vector<fs::path> findParts(const fs::path &outputPath) {
+    fs::path dir = outputPath.parent_path().empty() ? fs::path(".") : outputPath.parent_path();
+    std::vector<fs::path> parts;
+    size_t count = 0;
+    std::error_code ec;
+    for (const auto &entry : fs::directory_iterator(dir, ec)) {
+        ShardPart part;
+        if (!parsePartName(entry.path().filename().string(), outputPath, part))
+            continue;
+        if (count != 0 && part.count != count) {
+            std::cerr << "Found parts of runs split " << count << " and " << part.count << " ways in " << dir << "\n";
+            return {};
+        }
+        count = part.count;
+        parts.resize(count);
+        parts[part.index - 1] = entry.path();
+    }
+    if (count == 0) {
+        std::cerr << "No parts of " << outputPath.filename() << " found in " << dir << "\n";
+        return {};
+    }
+    for (size_t i = 0; i < count; ++i) {
+        if (parts[i].empty()) {
+            std::cerr << "Part " << i + 1 << " of " << count << " is missing\n";
+            return {};
+        }
+    }
+    return parts;
+}
+
+bool mergeParts(const std::vector<fs::path> &parts, const fs::path &outputPath, size_t &segments) {
+    if (parts.empty()) {
+        std::cerr << "No parts to merge\n";
+        return false;
+    }
+    std::vector<Manifest> manifests(parts.size());
+    for (size_t i = 0; i < parts.size(); ++i) {
+        if (!loadManifest(manifestPathFor(parts[i]), manifests[i])) {
+            std::cerr << "Failed to read the manifest of " << parts[i] << "\n";
+            return false;
+        }
+        std::error_code ec;
+        if (fs::file_size(parts[i], ec) != manifests[i].outputSize || ec) {
+            std::cerr << parts[i] << " does not match its manifest\n";
+            return false;
+        }
+        if (manifests[i].root != manifests[0].root || manifests[i].options != manifests[0].options ||
+            manifests[i].layout != manifests[0].layout) {
+            std::cerr << parts[i] << " was not made from the same root with the same options as " << parts[0] << "\n";
+            return false;
+        }
+    }
+    if (manifests[0].layout.find("boilerplate=") != std::string::npos) {
+        std::cerr << "Parts written with --boilerplate cannot be merged\n";
+        return false;
+    }
+
+    // (part, entry) pairs in path order.
+    std::vector<std::pair<size_t, size_t>> order;
+    for (size_t i = 0; i < manifests.size(); ++i) {
+        for (size_t j = 0; j < manifests[i].entries.size(); ++j)
+            order.emplace_back(i, j);
+    }
+    auto entryOf = [&](const std::pair<size_t, size_t> &at) -> const ManifestEntry & {
+        return manifests[at.first].entries[at.second];
+    };
+    std::stable_sort(order.begin(), order.end(), [&](const auto &a, const auto &b) {
+        return pathOrderLess(entryOf(a).relPath, entryOf(b).relPath);
+    });
+    for (size_t k = 1; k < order.size(); ++k) {
+        if (entryOf(order[k - 1]).relPath == entryOf(order[k]).relPath) {
+            std::cerr << entryOf(order[k]).relPath << " is in more than one part\n";
+            return false;
+        }
+    }
+
+    std::vector<std::FILE *> inputs(parts.size(), nullptr);
+    auto closeInputs = [&]() {
+        for (std::FILE *input : inputs) {
+            if (input)
+                std::fclose(input);
+        }
+    };
+    for (size_t i = 0; i < parts.size(); ++i) {
+        inputs[i] = std::fopen(parts[i].string().c_str(), "rb");
+        if (!inputs[i]) {
+            std::cerr << "Failed to open " << parts[i] << "\n";
+            closeInputs();
+            return false;
+        }
+    }
+
+    fs::path tmpPath = outputPath;
+    tmpPath += ".tmp";
+    OutputWriter out;
+    if (!out.open(tmpPath)) {
+        std::cerr << "Failed to create output file " << tmpPath << "\n";
+        closeInputs();
+        return false;
+    }
+
+    // Neighbouring segments of the same part are copied as one range.
+    Manifest merged;
+    merged.root = manifests[0].root;
+    merged.options = manifests[0].options;
+    merged.layout = manifests[0].layout;
+    uint64_t offset = 0;
+    size_t pendingPart = 0;
+    uint64_t pendingOffset = 0, pendingLength = 0;
+    bool ok = true;
+    for (const auto &at : order) {
+        const ManifestEntry &entry = entryOf(at);
+        if (pendingLength > 0 && (at.first != pendingPart || entry.offset != pendingOffset + pendingLength)) {
+            ok = ok && out.copyRange(inputs[pendingPart], pendingOffset, pendingLength);
+            pendingLength = 0;
+        }
+        if (pendingLength == 0) {
+            pendingPart = at.first;
+            pendingOffset = entry.offset;
+        }
+        pendingLength += entry.length;
+        merged.entries.push_back(entry);
+        merged.entries.back().offset = offset;
+        offset += entry.length;
+    }
+    ok = ok && out.copyRange(inputs[pendingPart], pendingOffset, pendingLength);
+    closeInputs();
+    ok = out.close() && ok;
+    if (!ok) {
+        std::cerr << "Failed to write output file " << tmpPath << "\n";
+        return false;
+    }
+
+    std::error_code ec;
+    fs::rename(tmpPath, outputPath, ec);
+    if (ec) {
+        std::cerr << "Failed to replace " << outputPath << ": " << ec.message() << "\n";
+        return false;
+    }
+    merged.outputSize = offset;
+    segments = merged.entries.size();
+    return saveManifest(manifestPathFor(outputPath), merged);
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "compressor.hpp"
+
+// Upper bounds on each shard; 0 means no bound.
+struct ShardLimits {
+    uint64_t maxBytes = 0;
+    uint64_t maxTokens = 0;
+};
+
+/**
+ * Cut files (in output order) into consecutive shards that each stay within
+ * limits, leaving room for the banner. A segment is sized by its header
+ * and file size, which bounds what combineFiles writes for it, and for a
+ * token limit by estimateSegmentTokens. A file is never split: one that
+ * exceeds a limit on its own gets a shard to itself. Token estimates are
+ * taken on several threads. There is always at least one shard.
+ */
+std::vector<std::vector<FileEntry>> partitionFiles(const std::vector<FileEntry> &files,
+                                                   const ShardLimits &limits,
+                                                   const CombineOptions &combine);
+
+/**
+ * Path of shard index (from 1) of outputPath: combined.txt becomes
+ * combined.001.txt.
+ */
+fs::path shardPath(const fs::path &outputPath, size_t index);
+
+/**
+ * Write every shard, several at a time, each with its own manifest. Every
+ * shard starts with a banner giving its number, the shard count, the root
+ * and its range of files, and references only point within the shard, so
+ * shards can be used on their own. With incremental, each shard reuses the
+ * segments of the previous shard with its number. Shards left over from an
+ * earlier run with more shards are removed. summary adds up all shards.
+ */
+bool writeShards(const std::vector<std::vector<FileEntry>> &shards,
+                 const fs::path &outputPath,
+                 const std::string &root,
+                 bool incremental,
+                 const CombineOptions &combine,
+                 CombineSummary &summary);
+
+// One of several independent runs over the same tree (--shard index/count).
+struct ShardPart {
+    size_t index = 0;         // From 1; 0 when the run is not split.
+    size_t count = 0;
+    bool bySubtree = true;    // Assign top-level subtrees rather than single files.
+};
+
+/**
+ * The files (in output order) that belong to part. Every process given
+ * the same listing computes the same assignment, so the parts can be made
+ * on different machines. Each top-level entry of the tree is a unit, or
+ * each file without bySubtree; a subtree larger than a fair share is split
+ * into its files. Units are weighted by their file sizes plus a fixed cost
+ * per file and handed out largest first, each to the least loaded part;
+ * equal weights are ordered by a hash of the path.
+ */
+std::vector<FileEntry> filesForPart(const std::vector<FileEntry> &files, const ShardPart &part);
+
+/**
+ * Path of the output of part: combined.txt becomes combined.2-of-4.txt.
+ */
+fs::path partPath(const fs::path &outputPath, const ShardPart &part);
+
+/**
+ * Write the output of part with a banner and a manifest, which merge
+ * needs. With incremental, the segments of the previous output of the part
+ * are reused.
+ */
+bool writePart(const std::vector<FileEntry> &files,
+               const ShardPart &part,
+               const fs::path &outputPath,
+               const std::string &root,
+               bool incremental,
+               const CombineOptions &combine,
+               CombineSummary &summary);
+
+/**
+ * The part outputs of outputPath in its directory, ordered by part number;
+ * empty (after an error message) unless all parts of one count are there.
+ */
+std::vector<fs::path> findParts(const fs::path &outputPath);
+
+/**
+ * Combine the outputs of the parts of a run into outputPath, with the
+ * segments in path order. The segments are copied by offset from the
+ * manifests of the parts, without the source files being read again, so
+ * the result matches combining the tree at once except for references:
+ * hard links, --dedup and --near-dup only refer to files of the same
+ * part, and a file whose original went to another part stays in full. The parts must have been made from
+ * the same root with the same options, and not with --boilerplate, whose
+ * numbering is per part. A manifest is written for outputPath, so a later
+ * --incremental run can start from the merged output.
+ */
+bool mergeParts(const std::vector<fs::path> &parts, const fs::path &outputPath, size_t &segments);
@@ -0,0 +1,125 @@
+#include "simhash.hpp"
+
+#include <bitset>
+#include <cstring>
+
+#include "hash.hpp"
+
+namespace {
+
+// Fewer lines than this give fingerprints that collide by chance.
+const uint32_t kMinFeatures = 8;
+
+// kSpread[b] has byte k set to bit k of b.
+struct SpreadTable {
+    uint64_t values[256];
+    constexpr SpreadTable() : values() {
+        for (int b = 0; b < 256; ++b) {
+            for (int k = 0; k < 8; ++k)
+                values[b] |= static_cast<uint64_t>((b >> k) & 1) << (8 * k);
+        }
+    }
+};
+constexpr SpreadTable kSpread;
+
+bool isBlank(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\f' || c == '\v';
+}
+
+} // namespace
+
+void SimHasher::addLine(const char *begin, const char *end) {
+    while (begin < end && isBlank(*begin))
+        ++begin;
+    while (end > begin && isBlank(end[-1]))
+        --end;
+    if (begin == end)
+        return;
+    uint64_t h = hash64(begin, static_cast<size_t>(end - begin));
+    // Eight table lookups count all 64 bits at once.
+    for (int j = 0; j < 8; ++j)
+        packed[j] += kSpread.values[(h >> (8 * j)) & 0xFF];
+    features++;
+    if (++packedLines == 255)
+        flushPacked();
+}
+
+void SimHasher::flushPacked() {
+    for (int j = 0; j < 8; ++j) {
+        for (int k = 0; k < 8; ++k)
+            bitCounts[8 * j + k] += static_cast<uint32_t>((packed[j] >> (8 * k)) & 0xFF);
+        packed[j] = 0;
+    }
+    packedLines = 0;
+}
+
+void SimHasher::update(const char *data, size_t size) {
+    const char *end = data + size;
+    while (data < end) {
+        const char *newline = static_cast<const char *>(std::memchr(data, '\n', static_cast<size_t>(end - data)));
+        if (!newline) {
+            partialLine.append(data, end);
+            return;
+        }
+        if (partialLine.empty()) {
+            addLine(data, newline);
+        } else {
+            partialLine.append(data, newline);
+            addLine(partialLine.data(), partialLine.data() + partialLine.size());
+            partialLine.clear();
+        }
+        data = newline + 1;
+    }
+}
+
+uint64_t SimHasher::digest() {
+    if (!partialLine.empty()) {
+        addLine(partialLine.data(), partialLine.data() + partialLine.size());
+        partialLine.clear();
+    }
+    flushPacked();
+    if (features < kMinFeatures)
+        return 0;
+    uint64_t fingerprint = 0;
+    for (int i = 0; i < 64; ++i) {
+        if (2 * bitCounts[i] > features)
+            fingerprint |= uint64_t(1) << i;
+    }
+    // 0 means "no fingerprint"; a text that really hashes to it is simply
+    // never matched.
+    return fingerprint;
+}
+
+uint64_t simHash(const char *data, size_t size) {
+    SimHasher hasher;
+    hasher.update(data, size);
+    return hasher.digest();
+}
+
+int hammingDistance(uint64_t a, uint64_t b) {
+    return static_cast<int>(std::bitset<64>(a ^ b).count());
+}
+
+void SimHashIndex::insert(uint64_t fingerprint, size_t id) {
+    for (uint32_t band = 0; band < 4; ++band) {
+        uint32_t key = (band << 16) | static_cast<uint32_t>((fingerprint >> (16 * band)) & 0xFFFF);
+        buckets[key].emplace_back(fingerprint, id);
+    }
+}
+
+bool SimHashIndex::find(uint64_t fingerprint, size_t &id) const {
+    bool found = false;
+    for (uint32_t band = 0; band < 4; ++band) {
+        uint32_t key = (band << 16) | static_cast<uint32_t>((fingerprint >> (16 * band)) & 0xFFFF);
+        auto it = buckets.find(key);
+        if (it == buckets.end())
+            continue;
+        for (const auto &[candidate, candidateId] : it->second) {
+            if ((!found || candidateId < id) && hammingDistance(candidate, fingerprint) <= kMaxDistance) {
+                id = candidateId;
+                found = true;
+            }
+        }
+    }
+    return found;
+}
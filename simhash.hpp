@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * Streaming 64-bit SimHash of a text. Every non-blank line, with leading
+ * and trailing whitespace removed, is one feature; texts sharing most of
+ * their lines get fingerprints that differ in only a few bits.
+ */
+class SimHasher {
+public:
+    void update(const char *data, size_t size);
+
+    /**
+     * Fingerprint of everything passed to update(), or 0 if the text has too
+     * few lines for the fingerprint to mean anything.
+     */
+    uint64_t digest();
+
+private:
+    void addLine(const char *begin, const char *end);
+    void flushPacked();
+
+    // Set bits per fingerprint bit: bit 8j+k is counted in byte k of
+    // packed[j] and moved to bitCounts before the byte can overflow.
+    uint64_t packed[8] = {};
+    uint32_t packedLines = 0;
+    uint32_t bitCounts[64] = {};
+    uint32_t features = 0;
+    std::string partialLine;
+};
+
+/**
+ * SimHash of a whole buffer.
+ */
+uint64_t simHash(const char *data, size_t size);
+
+int hammingDistance(uint64_t a, uint64_t b);
+
+/**
+ * Locality-sensitive index of fingerprints. Each fingerprint is split into
+ * four 16-bit bands and filed under each of them; two fingerprints within
+ * Hamming distance 3 agree on at least one band, so looking up the four
+ * bands finds every such neighbour.
+ */
+class SimHashIndex {
+public:
+    static const int kMaxDistance = 3;
+
+    void insert(uint64_t fingerprint, size_t id);
+
+    /**
+     * The lowest id whose fingerprint is within kMaxDistance bits of
+     * fingerprint. Returns false if there is none.
+     */
+    bool find(uint64_t fingerprint, size_t &id) const;
+
+private:
+    std::unordered_map<uint32_t, std::vector<std::pair<uint64_t, size_t>>> buckets;
+};
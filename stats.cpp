@@ -0,0 +1,133 @@
+#include "stats.hpp"
+
+#include <ctime>
+#include <ostream>
+#include <string>
+
+#ifndef _WIN32
+#include <time.h>
+#endif
+
+bool statsEnabled = false;
+bool countersEnabled = false;
+RunStats runStats;
+
+namespace {
+
+const char *kPhaseNames[kPhases] = {"rules", "listing", "selection", "combining", "merge",
+                                    "readdir", "stat", "ignore", "classify", "open", "read", "write"};
+
+// Stat and ignore happen per path; traces show them in batches instead.
+const char *kPhaseCategories[kPhases] = {"step", "step", "step", "step", "step",
+                                         "tree", nullptr, nullptr, "file", "file", "file", "file"};
+
+const int kPhaseLatencyOps[kPhases] = {-1, -1, -1, -1, -1,
+                                       static_cast<int>(LatencyOp::ReadDir), static_cast<int>(LatencyOp::Stat), -1, -1,
+                                       static_cast<int>(LatencyOp::Open), static_cast<int>(LatencyOp::Read),
+                                       static_cast<int>(LatencyOp::Write)};
+
+std::chrono::steady_clock::time_point runStart;
+int64_t runStartCpu = 0;
+
+std::string formatBytes(uint64_t bytes) {
+    const char *units[] = {"B", "KiB", "MiB", "GiB", "TiB"};
+    double value = static_cast<double>(bytes);
+    int unit = 0;
+    while (value >= 1024 && unit < 4) {
+        value /= 1024;
+        unit++;
+    }
+    char text[32];
+    std::snprintf(text, sizeof(text), unit == 0 ? "%.0f %s" : "%.1f %s", value, units[unit]);
+    return text;
+}
+
+// Bytes or files per second of wall time, or "-" when no time passed.
+std::string formatRate(double amount, int64_t wallNs, bool bytes) {
+    if (wallNs <= 0)
+        return "-";
+    double perSecond = amount * 1e9 / static_cast<double>(wallNs);
+    if (bytes)
+        return formatBytes(static_cast<uint64_t>(perSecond)) + "/s";
+    char text[32];
+    std::snprintf(text, sizeof(text), "%.0f files/s", perSecond);
+    return text;
+}
+
+} // namespace
+
+const char *phaseName(Phase phase) {
+    return kPhaseNames[static_cast<int>(phase)];
+}
+
+const char *phaseTraceCategory(Phase phase) {
+    return kPhaseCategories[static_cast<int>(phase)];
+}
+
+int phaseLatencyOp(Phase phase) {
+    return kPhaseLatencyOps[static_cast<int>(phase)];
+}
+
+int64_t processCpuNs() {
+#ifdef _WIN32
+    return static_cast<int64_t>(std::clock()) * (1000000000 / CLOCKS_PER_SEC);
+#else
+    timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+void enableStats() {
+    statsEnabled = true;
+    countersEnabled = true;
+    runStart = std::chrono::steady_clock::now();
+    runStartCpu = processCpuNs();
+}
+
+void printStats(std::ostream &out) {
+    const int64_t totalWall =
+        std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - runStart).count();
+    const int64_t totalCpu = processCpuNs() - runStartCpu;
+
+    char line[128];
+    std::snprintf(line, sizeof(line), "%-14s %12s %12s %10s\n", "Phase", "Wall ms", "CPU ms", "Calls");
+    out << line;
+    for (int i = 0; i < kPhases; ++i) {
+        uint64_t calls = runStats.calls[i].load(std::memory_order_relaxed);
+        if (calls == 0)
+            continue;
+        double wallMs = runStats.wallNs[i].load(std::memory_order_relaxed) / 1e6;
+        if (i < static_cast<int>(kFirstOperation)) {
+            double cpuMs = runStats.cpuNs[i].load(std::memory_order_relaxed) / 1e6;
+            std::snprintf(line, sizeof(line), "%-14s %12.1f %12.1f %10llu\n", phaseName(static_cast<Phase>(i)), wallMs, cpuMs,
+                          static_cast<unsigned long long>(calls));
+        } else {
+            std::snprintf(line, sizeof(line), "  %-12s %12.1f %12s %10llu\n", phaseName(static_cast<Phase>(i)), wallMs, "-",
+                          static_cast<unsigned long long>(calls));
+        }
+        out << line;
+    }
+    std::snprintf(line, sizeof(line), "%-14s %12.1f %12.1f\n", "total", totalWall / 1e6, totalCpu / 1e6);
+    out << line;
+
+    out << "Tree: " << eventCount(Counter::Directories) << " directories listed, " << eventCount(Counter::Files)
+        << " files, " << eventCount(Counter::Ignored) << " ignored, " << eventCount(Counter::Binary) << " binary\n";
+    out << "I/O: " << formatBytes(eventCount(Counter::BytesRead)) << " read, "
+        << formatBytes(eventCount(Counter::BytesWritten)) << " written, " << formatBytes(eventCount(Counter::BytesCopied))
+        << " copied from the previous output\n";
+    out << "Calls: " << eventCount(Counter::Opens) << " open, " << eventCount(Counter::Stats) << " stat, "
+        << runStats.calls[static_cast<int>(Phase::ReadDir)].load(std::memory_order_relaxed) << " readdir, "
+        << eventCount(Counter::Reads) << " fread, " << eventCount(Counter::Writes) << " fwrite (buffered), "
+        << eventCount(Counter::CopyRanges) << " copy_file_range\n";
+
+    const int64_t listingWall = runStats.wallNs[static_cast<int>(Phase::Listing)].load(std::memory_order_relaxed);
+    const int64_t combiningWall = runStats.wallNs[static_cast<int>(Phase::Combining)].load(std::memory_order_relaxed) +
+                                  runStats.wallNs[static_cast<int>(Phase::Merge)].load(std::memory_order_relaxed);
+    out << "Throughput: listing " << formatRate(static_cast<double>(eventCount(Counter::Files)), listingWall, false)
+        << ", combining " << formatRate(static_cast<double>(eventCount(Counter::BytesRead)), combiningWall, true)
+        << " read and "
+        << formatRate(static_cast<double>(eventCount(Counter::BytesWritten) + eventCount(Counter::BytesCopied)),
+                      combiningWall, true)
+        << " written\n";
+}
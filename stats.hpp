@@ -0,0 +1,186 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <iosfwd>
+#include <string>
+
+#include "latency.hpp"
+#include "perfcounters.hpp"
+#include "trace.hpp"
+
+namespace fs = std::filesystem;
+
+// Events counted for --stats.
+enum class Counter {
+    Directories,      // Directories listed.
+    Files,            // Files listed.
+    Ignored,          // Paths excluded by an ignore rule.
+    Binary,           // Files skipped as binary.
+    BytesRead,
+    BytesWritten,
+    BytesCopied,      // Written by copying a range of a previous output.
+    Opens,
+    Stats,            // stat and lstat calls.
+    Reads,            // fread calls; stdio decides when the file is read.
+    Writes,           // fwrite calls; stdio decides when the output is flushed.
+    CopyRanges,       // copy_file_range calls.
+    Segments,         // Files handled by the writer, whichever way.
+    SegmentBytes,     // Their sizes.
+};
+const int kCounters = static_cast<int>(Counter::SegmentBytes) + 1;
+
+/**
+ * Parts of a run timed for --stats. The steps of a run (Rules to Merge)
+ * are timed once each, in wall and CPU time. The operations below them
+ * happen per directory or per file, possibly on several threads; only
+ * their wall time is added up, since reading the CPU clock costs a system
+ * call.
+ */
+enum class Phase {
+    Rules,            // Gathering .gitignore rules.
+    Listing,          // Walking the tree (or reading the git index).
+    Selection,        // Budget, part assignment and shard partition.
+    Combining,        // Writing the output.
+    Merge,            // Merging the outputs of parts.
+    ReadDir,          // Reading directory entries.
+    Stat,
+    Ignore,           // Matching paths against the ignore rules.
+    Classify,         // Telling binary from text files.
+    Open,
+    Read,
+    Write,
+};
+const int kPhases = static_cast<int>(Phase::Write) + 1;
+const Phase kFirstOperation = Phase::ReadDir;
+
+struct RunStats {
+    std::atomic<uint64_t> counters[kCounters] = {};
+    std::atomic<int64_t> wallNs[kPhases] = {};
+    std::atomic<int64_t> cpuNs[kPhases] = {};
+    std::atomic<uint64_t> calls[kPhases] = {};
+};
+
+// Set once, before any work starts, by enableStats; countersEnabled is
+// also set for --progress, which only needs the counters.
+extern bool statsEnabled;
+extern bool countersEnabled;
+extern RunStats runStats;
+
+/**
+ * Start collecting statistics; the run is timed from here.
+ */
+void enableStats();
+
+/**
+ * Write the report of everything collected so far to out.
+ */
+void printStats(std::ostream &out);
+
+inline void countEvent(Counter counter, uint64_t count = 1) {
+    if (countersEnabled)
+        runStats.counters[static_cast<int>(counter)].fetch_add(count, std::memory_order_relaxed);
+}
+
+// Replace a count that was estimated while it grew by its final value.
+inline void setEventCount(Counter counter, uint64_t count) {
+    if (countersEnabled)
+        runStats.counters[static_cast<int>(counter)].store(count, std::memory_order_relaxed);
+}
+
+inline uint64_t eventCount(Counter counter) {
+    return runStats.counters[static_cast<int>(counter)].load(std::memory_order_relaxed);
+}
+
+// Process CPU time in nanoseconds.
+int64_t processCpuNs();
+
+// Name and trace category of a phase; a null category keeps it out of traces.
+const char *phaseName(Phase phase);
+const char *phaseTraceCategory(Phase phase);
+
+// The latency histogram a phase is recorded in, or -1 for none.
+int phaseLatencyOp(Phase phase);
+
+/**
+ * Adds the time until it is destroyed to a phase, records it as a span
+ * when tracing and as a sample when collecting latencies, and for the
+ * steps of a run reads the performance counters. Costs a branch when none
+ * of them is on.
+ */
+class PhaseTimer {
+public:
+    explicit PhaseTimer(Phase phase)
+        : phase(phase), active(statsEnabled || traceEnabled || latencyEnabled || perfCountersEnabled) {
+        if (!active)
+            return;
+        if (statsEnabled && phase < kFirstOperation)
+            startCpu = processCpuNs();
+        if (perfCountersEnabled && phase < kFirstOperation)
+            readPerfCounters(startCounts);
+        start = std::chrono::steady_clock::now();
+    }
+
+    ~PhaseTimer() {
+        if (!active)
+            return;
+        auto end = std::chrono::steady_clock::now();
+        if (perfCountersEnabled && phase < kFirstOperation) {
+            int64_t endCounts[kPerfEvents];
+            readPerfCounters(endCounts);
+            addPerfCounts(static_cast<int>(phase), startCounts, endCounts);
+        }
+        int64_t elapsedNs = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+        if (latencyEnabled && phaseLatencyOp(phase) >= 0)
+            recordLatency(static_cast<LatencyOp>(phaseLatencyOp(phase)), static_cast<uint64_t>(elapsedNs));
+        if (traceEnabled && phaseTraceCategory(phase))
+            recordTraceSpan(phaseName(phase), phaseTraceCategory(phase), start, end, std::move(detail));
+        if (!statsEnabled)
+            return;
+        int index = static_cast<int>(phase);
+        runStats.wallNs[index].fetch_add(elapsedNs, std::memory_order_relaxed);
+        if (phase < kFirstOperation)
+            runStats.cpuNs[index].fetch_add(processCpuNs() - startCpu, std::memory_order_relaxed);
+        runStats.calls[index].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Describe the span in a trace (a path, say); ignored when not tracing.
+    void note(const std::string &text) {
+        if (traceEnabled)
+            detail = text;
+    }
+
+    PhaseTimer(const PhaseTimer &) = delete;
+    PhaseTimer &operator=(const PhaseTimer &) = delete;
+
+private:
+    const Phase phase;
+    const bool active;
+    std::chrono::steady_clock::time_point start;
+    int64_t startCpu = 0;
+    int64_t startCounts[kPerfEvents];
+    std::string detail;
+};
+
+/**
+ * fopen for reading, counted and timed.
+ */
+inline std::FILE *openInput(const fs::path &path) {
+    PhaseTimer timer(Phase::Open);
+    countEvent(Counter::Opens);
+    return std::fopen(path.string().c_str(), "rb");
+}
+
+/**
+ * fread, counted and timed.
+ */
+inline size_t readInput(std::FILE *in, char *data, size_t size) {
+    PhaseTimer timer(Phase::Read);
+    size_t bytesRead = std::fread(data, 1, size, in);
+    countEvent(Counter::Reads);
+    countEvent(Counter::BytesRead, bytesRead);
+    return bytesRead;
+}
@@ -0,0 +1,260 @@
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <string>
+#include <thread>
+
+#include "testing.hpp"
+
+#ifdef __linux__
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <cstring>
+#endif
+
+namespace {
+
+// Runs of the ProjectCompressor binary over a small tree, whose outputs are
+// compared with a full run in a fresh directory.
+class EndToEnd : public ::testing::Test {
+protected:
+    void SetUp() override {
+        tree = dir.path() / "tree";
+        for (int i = 0; i < 6; ++i) {
+            std::string body;
+            for (int line = 0; line < 20; ++line)
+                body += "int value" + std::to_string(i) + "_" + std::to_string(line) + " = " + std::to_string(line) + ";\n";
+            writeFile(tree / ("src/file" + std::to_string(i) + ".cpp"), "// Copyright\n" + body);
+            writeFile(tree / ("lib/part" + std::to_string(i) + "/util.hpp"), "#pragma once\n" + body);
+        }
+        writeFile(tree / "README.md", "# Tree\n");
+        writeFile(tree / "copy/file0.cpp", readFile(tree / "src/file0.cpp"));
+        writeFile(tree / "data.bin", std::string("\0\1\2\3", 4));
+        age(tree);
+    }
+
+    // Move modification times to a fixed point in the past: segments of files
+    // changed in the last two seconds are never reused, as a later change could
+    // keep the mtime, and directories only stay trusted while theirs is unchanged.
+    void age(const fs::path &root) {
+        for (const auto &entry : fs::recursive_directory_iterator(root)) {
+            if (!entry.is_symlink())
+                fs::last_write_time(entry.path(), past);
+        }
+    }
+
+    // Run the binary in outDir; true if it exited with status 0.
+    bool run(const fs::path &outDir, const std::string &arguments) {
+        fs::create_directories(outDir);
+        return runIn(outDir, "'" PROJECTCOMPRESSOR_BINARY "' " + arguments);
+    }
+
+    // Run the binary in outDir and return its summary line, "" on failure.
+    std::string summary(const fs::path &outDir, const std::string &arguments) {
+        fs::create_directories(outDir);
+        std::string output = outputOf(outDir, "'" PROJECTCOMPRESSOR_BINARY "' " + arguments + " && echo ok");
+        if (output.size() < 2 || output.compare(output.size() - 2, 2, "ok") != 0)
+            return "";
+        size_t open = output.find('(');
+        size_t close = output.find(')', open);
+        return open == std::string::npos || close == std::string::npos ? "" : output.substr(open, close + 1 - open);
+    }
+
+    // The output of a full run with the given options, in a fresh directory.
+    std::string fullRun(const std::string &options) {
+        fs::path outDir = dir.path() / ("full" + std::to_string(fullRuns++));
+        if (!run(outDir, options + " '" + tree.string() + "'"))
+            return "";
+        return readFile(outDir / "combined.txt");
+    }
+
+    // Rewrite a file with contents of the same size and a later (but still
+    // past) mtime, which is all an incremental run has to go on.
+    void touchSameSize(const fs::path &path) {
+        std::string contents = readFile(path);
+        contents[contents.size() - 3] = contents[contents.size() - 3] == '0' ? '1' : '0';
+        auto mtime = fs::last_write_time(path);
+        writeFile(path, contents);
+        fs::last_write_time(path, mtime + std::chrono::seconds(2));
+    }
+
+    TempDir dir;
+    fs::path tree;
+    int fullRuns = 0;
+    const fs::file_time_type past = fs::file_time_type::clock::now() - std::chrono::minutes(10);
+};
+
+TEST_F(EndToEnd, IncrementalMatchesFullRun) {
+    for (const char *options : {"", "--dedup", "--minify", "--near-dup --dedup"}) {
+        SCOPED_TRACE(options);
+        fs::path outDir = dir.path() / ("incremental" + std::string(options));
+        const std::string incremental = "--incremental " + std::string(options) + " '" + tree.string() + "'";
+        ASSERT_TRUE(run(outDir, incremental));
+        std::string first = readFile(outDir / "combined.txt");
+        ASSERT_NE(first.find("# File: "), std::string::npos);
+        EXPECT_EQ(first, fullRun(options));
+
+        // Everything reused.
+        EXPECT_EQ(summary(outDir, incremental).find("(0 written, "), 0u);
+        EXPECT_EQ(readFile(outDir / "combined.txt"), first);
+
+        // One file changed in place; then one added and one removed.
+        touchSameSize(tree / "src/file3.cpp");
+        EXPECT_EQ(summary(outDir, incremental).find("(1 written, "), 0u);
+        EXPECT_EQ(readFile(outDir / "combined.txt"), fullRun(options));
+        writeFile(tree / "lib/part2/new.hpp", "#pragma once\n");
+        fs::remove(tree / "src/file0.cpp");
+        age(tree);
+        ASSERT_TRUE(run(outDir, incremental));
+        EXPECT_EQ(readFile(outDir / "combined.txt"), fullRun(options));
+        fs::remove(tree / "lib/part2/new.hpp");
+        writeFile(tree / "src/file0.cpp", readFile(tree / "copy/file0.cpp"));
+        age(tree);
+    }
+}
+
+TEST_F(EndToEnd, TrustedDirectoriesMatchFullRun) {
+    for (const char *options : {"", "--symlinks skip", "--symlinks follow"}) {
+        SCOPED_TRACE(options);
+        fs::path root = dir.path() / ("links" + std::string(options));
+        writeFile(root / "a/sub/x.txt", "x\n");
+        writeFile(root / "b/y.txt", "y\n");
+        age(root);
+        fs::path outDir = dir.path() / ("trusted" + std::string(options));
+        const std::string trusted = "--trust-dir-mtime " + std::string(options) + " '" + root.string() + "'";
+        auto full = [&] {
+            fs::path fullDir = dir.path() / ("full" + std::to_string(fullRuns++));
+            return run(fullDir, std::string(options) + " '" + root.string() + "'") ? readFile(fullDir / "combined.txt")
+                                                                                     : "";
+        };
+        ASSERT_TRUE(run(outDir, trusted));
+        EXPECT_EQ(readFile(outDir / "combined.txt"), full());
+
+        // Links to a directory and a file that unchanged directories hold.
+        fs::create_directories(root / "c");
+        fs::create_symlink("../a/sub", root / "c/l");
+        fs::create_symlink("../a/sub/x.txt", root / "c/xl");
+        age(root);
+        ASSERT_TRUE(run(outDir, trusted));
+        EXPECT_EQ(readFile(outDir / "combined.txt"), full());
+
+        // A link that comes first in the walk takes the file from them.
+        fs::create_symlink("a/sub/x.txt", root / "0");
+        age(root);
+        ASSERT_TRUE(run(outDir, trusted));
+        EXPECT_EQ(readFile(outDir / "combined.txt"), full());
+    }
+}
+
+TEST_F(EndToEnd, ShardsMergeToFullRun) {
+    const std::string full = fullRun("");
+    ASSERT_NE(full, "");
+    for (const char *unit : {"subtree", "file"}) {
+        SCOPED_TRACE(unit);
+        fs::path outDir = dir.path() / ("shards-" + std::string(unit));
+        for (int part = 1; part <= 3; ++part) {
+            ASSERT_TRUE(run(outDir, "--shard " + std::to_string(part) + "/3 --shard-by " + unit + " '" +
+                                        tree.string() + "'"));
+            EXPECT_TRUE(fs::exists(outDir / ("combined." + std::to_string(part) + "-of-3.txt")));
+        }
+        ASSERT_TRUE(run(outDir, "--merge"));
+        EXPECT_EQ(readFile(outDir / "combined.txt"), full);
+    }
+    // References do not cross parts: a hard link whose first name went to
+    // another part is written in full where the full run refers to it.
+    fs::create_hard_link(tree / "src/file2.cpp", tree / "lib/hard.cpp");
+    std::string expected = fullRun("");
+    const std::string reference = "# Same as: " + (tree / "lib/hard.cpp").string() + "\n\n";
+    size_t at = expected.find(reference);
+    ASSERT_NE(at, std::string::npos);
+    expected.replace(at, reference.size(), "\n" + readFile(tree / "src/file2.cpp") + "\n\n");
+    fs::path hardDir = dir.path() / "shards-hard";
+    for (int part = 1; part <= 3; ++part)
+        ASSERT_TRUE(run(hardDir, "--shard " + std::to_string(part) + "/3 --shard-by file '" + tree.string() + "'"));
+    ASSERT_TRUE(run(hardDir, "--merge"));
+    EXPECT_EQ(readFile(hardDir / "combined.txt"), expected);
+    fs::remove(tree / "lib/hard.cpp");
+
+    // A missing part is an error, not a shorter result.
+    fs::path partial = dir.path() / "partial";
+    ASSERT_TRUE(run(partial, "--shard 1/2 '" + tree.string() + "'"));
+    EXPECT_FALSE(run(partial, "--merge"));
+}
+
+#ifdef __linux__
+// True once process pid has exited (a zombie counts, as nothing here reaps it).
+bool exited(const std::string &pid) {
+    std::string stat = readFile("/proc/" + pid + "/stat");
+    size_t close = stat.rfind(')');
+    return close == std::string::npos || close + 2 >= stat.size() || stat[close + 2] == 'Z';
+}
+
+// Poll for up to timeout until done() holds.
+template <typename Done> bool waitFor(Done done, std::chrono::seconds timeout) {
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    while (!done()) {
+        if (std::chrono::steady_clock::now() > deadline)
+            return false;
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+    return true;
+}
+
+TEST_F(EndToEnd, DaemonMatchesFullRun) {
+    const fs::path socket = dir.path() / "daemon.sock";
+    for (const char *options : {"", "--minify"}) {
+        SCOPED_TRACE(options);
+        std::string pid = outputOf(dir.path(), "'" PROJECTCOMPRESSOR_BINARY "' --daemon '" + socket.string() + "' " +
+                                                   options + " '" + tree.string() + "' > daemon.log 2>&1 & echo $!");
+        ASSERT_FALSE(pid.empty());
+        ASSERT_TRUE(waitFor([&] { return fs::is_socket(socket) || exited(pid); }, std::chrono::seconds(10)));
+        ASSERT_FALSE(exited(pid)) << readFile(dir.path() / "daemon.log");
+
+        fs::path outDir = dir.path() / ("daemon" + std::string(options));
+        const std::string request = "--connect '" + socket.string() + "' > combined.txt";
+        ASSERT_TRUE(run(outDir, request));
+        EXPECT_EQ(readFile(outDir / "combined.txt"), fullRun(options));
+        // Changes are applied before a request is answered.
+        writeFile(tree / "lib/part2/new.hpp", "#pragma once // new\n");
+        ASSERT_TRUE(run(outDir, request));
+        EXPECT_EQ(readFile(outDir / "combined.txt"), fullRun(options));
+        fs::remove(tree / "lib/part2/new.hpp");
+
+        // A client that never sends its request does not keep the daemon alive.
+        sockaddr_un address{};
+        address.sun_family = AF_UNIX;
+        std::strncpy(address.sun_path, socket.c_str(), sizeof(address.sun_path) - 1);
+        int idle = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        ASSERT_EQ(::connect(idle, reinterpret_cast<sockaddr *>(&address), sizeof(address)), 0);
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        ASSERT_TRUE(runIn(dir.path(), "kill " + pid));
+        EXPECT_TRUE(waitFor([&] { return exited(pid); }, std::chrono::seconds(20)));
+        char reply[64] = {};
+        EXPECT_GT(::read(idle, reply, sizeof(reply) - 1), 0);
+        EXPECT_EQ(std::string(reply).rfind("ERROR ", 0), 0u);
+        ::close(idle);
+        if (!exited(pid))
+            runIn(dir.path(), "kill -9 " + pid);
+    }
+}
+#endif
+
+// Options a mode cannot apply are rejected rather than ignored.
+TEST_F(EndToEnd, UnsupportedCombinationsAreErrors) {
+    for (const char *mode : {"--commit HEAD", "--watch", "--daemon sock"}) {
+        for (const char *option : {"--budget 1000", "--prefer '*.md'", "--rank small", "--shard-bytes 1M",
+                                   "--shard-tokens 10k", "--shard 1/2"}) {
+            SCOPED_TRACE(std::string(mode) + " " + option);
+            EXPECT_FALSE(run(dir.path() / "rejected", std::string(mode) + " " + option + " '" + tree.string() + "'"));
+        }
+    }
+    // Neither writes the whole output at once.
+    for (const char *arguments : {"--commit HEAD --near-dup", "--commit HEAD --boilerplate", "--daemon sock --dedup",
+                                  "--daemon sock --near-dup", "--daemon sock --boilerplate"}) {
+        SCOPED_TRACE(arguments);
+        EXPECT_FALSE(run(dir.path() / "rejected", std::string(arguments) + " '" + tree.string() + "'"));
+    }
+}
+
+} // namespace
@@ -0,0 +1,124 @@
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+#include "gitindex.hpp"
+#include "hash.hpp"
+#include "testing.hpp"
+
+namespace {
+
+// An index written by the git command line, read back with readGitIndex.
+class GitIndex : public ::testing::Test {
+protected:
+    void SetUp() override {
+        if (!haveGit())
+            GTEST_SKIP() << "git is not installed";
+        repo = dir.path() / "repo";
+        fs::create_directories(repo);
+    }
+
+    void makeRepository(const std::string &initOptions = "") {
+        ASSERT_TRUE(runIn(repo, git("init -q " + initOptions)));
+        writeFile(repo / "a.txt", "a\n");
+        writeFile(repo / "dir/b.txt", "b\n");
+        writeFile(repo / "dir/sub/c.txt", "c\n");
+        writeFile(repo / "dir/sub/d.txt", "d\n");
+        ASSERT_TRUE(runIn(repo, git("add -A")));
+        // An intent-to-add entry needs the extended flags of version 3.
+        writeFile(repo / "new.txt", "new\n");
+        ASSERT_TRUE(runIn(repo, git("add -N new.txt")));
+    }
+
+    bool read(std::vector<GitIndexEntry> &entries, std::string &error) {
+        entries.clear();
+        return readGitIndex(repo / ".git/index", entries, error);
+    }
+
+    static std::vector<std::string> paths(const std::vector<GitIndexEntry> &entries) {
+        std::vector<std::string> result;
+        for (const auto &entry : entries)
+            result.push_back(entry.path);
+        return result;
+    }
+
+    const std::vector<std::string> expected = {"a.txt", "dir/b.txt", "dir/sub/c.txt", "dir/sub/d.txt", "new.txt"};
+    TempDir dir;
+    fs::path repo;
+};
+
+TEST_F(GitIndex, Versions) {
+    makeRepository();
+    for (int version : {2, 3, 4}) {
+        SCOPED_TRACE("version " + std::to_string(version));
+        ASSERT_TRUE(runIn(repo, git("update-index --index-version " + std::to_string(version))));
+        std::string data = readFile(repo / ".git/index");
+        ASSERT_GE(data.size(), 8u);
+        // The intent-to-add entry needs version 3, which git writes when asked for 2.
+        EXPECT_EQ(data[7], version == 2 ? 3 : version);
+        std::vector<GitIndexEntry> entries;
+        std::string error;
+        ASSERT_TRUE(read(entries, error)) << error;
+        EXPECT_EQ(paths(entries), expected);
+        EXPECT_TRUE(entries.back().intentToAdd);
+        EXPECT_EQ(entries[0].mode, 0100644u);
+        EXPECT_EQ(entries[0].size, 2u);
+    }
+}
+
+TEST_F(GitIndex, Sha256Repository) {
+    makeRepository("--object-format=sha256");
+    std::vector<GitIndexEntry> entries;
+    std::string error;
+    ASSERT_TRUE(read(entries, error)) << error;
+    EXPECT_EQ(paths(entries), expected);
+}
+
+TEST_F(GitIndex, ChecksumMismatchIsAnError) {
+    makeRepository();
+    fs::path index = repo / ".git/index";
+    std::string data = readFile(index);
+    data[20] ^= 1;
+    writeFile(index, data);
+    std::vector<GitIndexEntry> entries;
+    std::string error;
+    EXPECT_FALSE(read(entries, error));
+    EXPECT_EQ(error, "index checksum mismatch");
+}
+
+TEST_F(GitIndex, SplitIndexIsAnError) {
+    makeRepository();
+    ASSERT_TRUE(runIn(repo, git("update-index --split-index")));
+    std::vector<GitIndexEntry> entries;
+    std::string error;
+    EXPECT_FALSE(read(entries, error));
+    EXPECT_NE(error.find("split index"), std::string::npos);
+}
+
+TEST(Sha, KnownDigests) {
+    auto hex = [](const unsigned char *digest, size_t size) {
+        static const char digits[] = "0123456789abcdef";
+        std::string text;
+        for (size_t i = 0; i < size; ++i) {
+            text += digits[digest[i] >> 4];
+            text += digits[digest[i] & 0xF];
+        }
+        return text;
+    };
+    unsigned char digest[32];
+    sha1("", 0, digest);
+    EXPECT_EQ(hex(digest, 20), "da39a3ee5e6b4b0d3255bfef95601890afd80709");
+    sha1("abc", 3, digest);
+    EXPECT_EQ(hex(digest, 20), "a9993e364706816aba3e25717850c26c9cd0d89d");
+    // 56 bytes: the padding spills into a second block.
+    const std::string twoBlocks = "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq";
+    sha1(twoBlocks.data(), twoBlocks.size(), digest);
+    EXPECT_EQ(hex(digest, 20), "84983e441c3bd26ebaae4aa1f95129e5e54670f1");
+    sha256("abc", 3, digest);
+    EXPECT_EQ(hex(digest, 32), "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+    sha256(twoBlocks.data(), twoBlocks.size(), digest);
+    EXPECT_EQ(hex(digest, 32), "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1");
+}
+
+} // namespace
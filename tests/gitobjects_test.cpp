@@ -0,0 +1,156 @@
+#include <gtest/gtest.h>
+
+#include <string>
+
+#include "gitobjects.hpp"
+#include "testing.hpp"
+
+namespace {
+
+// A repository made with the git command line, read back with combineCommit.
+class GitObjects : public ::testing::Test {
+protected:
+    void SetUp() override {
+        if (!haveGit())
+            GTEST_SKIP() << "git is not installed";
+        repo = dir.path() / "repo";
+        fs::create_directories(repo);
+        ASSERT_TRUE(runIn(repo, git("init -q")));
+    }
+
+    bool commit(const std::string &message) {
+        return runIn(repo, git("add -A") + " && " + git("commit -q -m '" + message + "'"));
+    }
+
+    // The output of combineCommit, or "" if it failed.
+    std::string combine(const std::string &revision, const CombineOptions &options = CombineOptions()) {
+        fs::path output = dir.path() / "combined.txt";
+        fs::remove(output);
+        CombineSummary summary;
+        if (!combineCommit(repo, revision, output, summary, options))
+            return "";
+        return readFile(output);
+    }
+
+    // A file of many lines, so that its versions are stored as deltas.
+    void writeLines(const std::string &name, int changed) {
+        std::string text;
+        for (int i = 0; i < 400; ++i)
+            text += "line " + std::to_string(i) + (i == changed ? " changed" : "") + "\n";
+        writeFile(repo / name, text);
+    }
+
+    fs::path packIndex() {
+        for (const auto &entry : fs::directory_iterator(repo / ".git/objects/pack")) {
+            if (entry.path().extension() == ".idx")
+                return entry.path();
+        }
+        return {};
+    }
+
+    TempDir dir;
+    fs::path repo;
+};
+
+TEST_F(GitObjects, CorruptTreeModeIsAnError) {
+    writeFile(repo / "a.txt", "a\n");
+    ASSERT_TRUE(commit("one"));
+    std::string blob = outputOf(repo, git("rev-parse HEAD:a.txt"));
+    ASSERT_EQ(blob.size(), 40u);
+    // A tree whose only entry has a mode that is not octal.
+    std::string tree = "9z9 a.txt";
+    tree += '\0';
+    for (size_t i = 0; i < blob.size(); i += 2)
+        tree += static_cast<char>(std::stoi(blob.substr(i, 2), nullptr, 16));
+    writeFile(dir.path() / "tree", tree);
+    std::string treeId = outputOf(repo, git("hash-object -t tree --literally -w ../tree"));
+    ASSERT_EQ(treeId.size(), 40u);
+    std::string commitId = outputOf(repo, git("commit-tree " + treeId + " -m corrupt"));
+    ASSERT_EQ(commitId.size(), 40u);
+    EXPECT_EQ(combine(commitId), "");
+}
+
+TEST_F(GitObjects, PacksMatchLooseObjects) {
+    writeLines("a.txt", -1);
+    writeFile(repo / "sub/b.txt", "b\n");
+    ASSERT_TRUE(commit("one"));
+    writeLines("a.txt", 100);
+    ASSERT_TRUE(commit("two"));
+    writeLines("a.txt", 300);
+    ASSERT_TRUE(commit("three"));
+    const std::string revisions[] = {"HEAD", "HEAD~1", "HEAD~2"};
+    std::string loose[3];
+    for (int i = 0; i < 3; ++i) {
+        loose[i] = combine(revisions[i]);
+        ASSERT_NE(loose[i], "");
+    }
+    EXPECT_NE(loose[1].find("line 100 changed\n"), std::string::npos);
+
+    // Offset deltas (the default), then deltas naming their base by id.
+    for (const char *repack : {"repack -q -a -d -f", "-c repack.useDeltaBaseOffset=false repack -q -a -d -f"}) {
+        SCOPED_TRACE(repack);
+        ASSERT_TRUE(runIn(repo, git(repack)));
+        ASSERT_FALSE(packIndex().empty());
+        for (int i = 0; i < 3; ++i)
+            EXPECT_EQ(combine(revisions[i]), loose[i]);
+    }
+}
+
+TEST_F(GitObjects, CorruptPackIndexIsNotReadPastItsEnd) {
+    writeLines("a.txt", -1);
+    ASSERT_TRUE(commit("one"));
+    ASSERT_TRUE(runIn(repo, git("repack -q -a -d")));
+    fs::path index = packIndex();
+    ASSERT_FALSE(index.empty());
+    // Point every object at an entry of the (empty) 64-bit offset table.
+    std::string data = readFile(index);
+    const unsigned char *fanout = reinterpret_cast<const unsigned char *>(data.data()) + 8;
+    uint32_t count = (uint32_t(fanout[1020]) << 24) | (uint32_t(fanout[1021]) << 16) |
+                     (uint32_t(fanout[1022]) << 8) | fanout[1023];
+    size_t offsets = 8 + 256 * 4 + static_cast<size_t>(count) * 24;
+    ASSERT_LE(offsets + 4 * count, data.size());
+    for (uint32_t i = 0; i < count; ++i)
+        data.replace(offsets + 4 * i, 4, "\x80\x00\x10\x00", 4);
+    fs::permissions(index, fs::perms::owner_write, fs::perm_options::add);
+    writeFile(index, data);
+    EXPECT_EQ(combine("HEAD"), "");
+}
+
+TEST_F(GitObjects, Revisions) {
+    writeFile(repo / "a.txt", "one\n");
+    ASSERT_TRUE(commit("one"));
+    writeFile(repo / "a.txt", "two\n");
+    ASSERT_TRUE(commit("two"));
+    EXPECT_NE(combine("HEAD").find("two\n"), std::string::npos);
+    EXPECT_NE(combine("HEAD~1").find("one\n"), std::string::npos);
+    EXPECT_NE(combine("HEAD^").find("one\n"), std::string::npos);
+    EXPECT_EQ(combine("HEAD~2"), "");
+    // Too large for any integer type: an invalid revision, not an exception.
+    EXPECT_EQ(combine("HEAD~99999999999999999999"), "");
+    EXPECT_EQ(combine("HEAD^99999999999"), "");
+}
+
+// The options that apply to a commit give what they give on its checkout.
+TEST_F(GitObjects, OptionsMatchCheckout) {
+    const std::string source = "// Comment\n\nint f() {\n    return 1; // one\n}\n";
+    writeFile(repo / "a.cpp", source);
+    writeFile(repo / "sub/b.cpp", source);
+    writeFile(repo / "c.txt", "text\n");
+    ASSERT_TRUE(commit("one"));
+    for (CombineOptions options : {CombineOptions{true, false, false, true, false, ""},
+                                   CombineOptions{false, false, false, false, true, "# Banner\n\n"}}) {
+        SCOPED_TRACE(options.dedup ? "dedup, minify" : "outline");
+        TreeListing listing;
+        processDirectory(repo, listing, gatherGitIgnoreRules(repo), repo);
+        Manifest manifest;
+        CombineSummary summary;
+        fs::path checkout = dir.path() / "checkout.txt";
+        ASSERT_TRUE(combineFiles(listing.files, checkout, nullptr, "", manifest, summary, options));
+        std::string expected = readFile(checkout);
+        EXPECT_EQ(combine("HEAD", options), expected);
+        EXPECT_EQ(expected.find("// one"), std::string::npos);
+        EXPECT_EQ(expected.find("# Same as: ") != std::string::npos, options.dedup);
+    }
+}
+
+} // namespace
@@ -0,0 +1,37 @@
+#include <gtest/gtest.h>
+
+#include <cstdint>
+
+#include "inodeset.hpp"
+
+namespace {
+
+TEST(InodeSet, InsertAndErase) {
+    InodeSet set;
+    EXPECT_FALSE(set.insert(1, 0));
+    EXPECT_TRUE(set.insert(1, 5));
+    EXPECT_FALSE(set.insert(1, 5));
+    EXPECT_TRUE(set.insert(2, 5));
+    EXPECT_TRUE(set.erase(1, 5));
+    EXPECT_FALSE(set.erase(1, 5));
+    EXPECT_FALSE(set.contains(1, 5));
+    EXPECT_TRUE(set.contains(2, 5));
+    EXPECT_EQ(set.size(), 1u);
+}
+
+// Erasing from the middle of probe runs must not hide the entries after it.
+TEST(InodeSet, EraseKeepsProbeRuns) {
+    InodeSet set;
+    const uint64_t count = 5000;
+    for (uint64_t ino = 1; ino <= count; ++ino)
+        ASSERT_TRUE(set.insert(7, ino));
+    for (uint64_t ino = 1; ino <= count; ino += 3)
+        ASSERT_TRUE(set.erase(7, ino));
+    for (uint64_t ino = 1; ino <= count; ++ino)
+        EXPECT_EQ(set.contains(7, ino), (ino - 1) % 3 != 0) << ino;
+    for (uint64_t ino = 1; ino <= count; ino += 3)
+        EXPECT_TRUE(set.insert(7, ino));
+    EXPECT_EQ(set.size(), count);
+}
+
+} // namespace
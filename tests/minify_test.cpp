@@ -0,0 +1,217 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <string>
+
+#include "minify.hpp"
+
+namespace {
+
+// Minify input fed in chunks of the given size (all of it at once for 0).
+std::string minify(SourceLanguage language, const std::string &input, size_t chunk, bool outline = false) {
+    Minifier minifier(language, outline);
+    std::string out;
+    if (chunk == 0)
+        chunk = input.size() + 1;
+    for (size_t at = 0; at < input.size(); at += chunk)
+        minifier.feed(input.data() + at, std::min(chunk, input.size() - at), out);
+    minifier.finish(out);
+    return out;
+}
+
+// The lexer state carries over between calls, so the split must not matter.
+void expectMinified(SourceLanguage language, const std::string &input, const std::string &expected,
+                    bool outline = false) {
+    for (size_t chunk : {0, 1, 2, 3, 7, 64}) {
+        SCOPED_TRACE("chunks of " + std::to_string(chunk));
+        EXPECT_EQ(minify(language, input, chunk, outline), expected);
+    }
+}
+
+TEST(Minify, C) {
+    expectMinified(SourceLanguage::C,
+                   "// Header\n"
+                   "#include <cstdio>\n"
+                   "\n"
+                   "\n"
+                   "int main() {   \n"
+                   "    /* block\n"
+                   "       comment */\n"
+                   "    printf(\"// not a comment /* */\\n\"); // trailing\n"
+                   "    return '\\'' + 1'000;\n"
+                   "}\n",
+                   "#include <cstdio>\n"
+                   "\n"
+                   "int main() {\n"
+                   "    printf(\"// not a comment /* */\\n\");\n"
+                   "    return '\\'' + 1'000;\n"
+                   "}\n");
+}
+
+TEST(Minify, CRawStrings) {
+    expectMinified(SourceLanguage::C,
+                   "auto a = R\"(a\"b // c)\"; // gone\n"
+                   "auto b = u8R\"x(/* )\" \n"
+                   "// kept )x\"; auto c = FOR\"x\"; // gone\n",
+                   "auto a = R\"(a\"b // c)\";\n"
+                   "auto b = u8R\"x(/* )\" \n"
+                   "// kept )x\"; auto c = FOR\"x\";\n");
+}
+
+// Lines are spliced before comments are removed, so a backslash at the end
+// of a line comment carries it onto the next line; not so in Java.
+TEST(Minify, CLineCommentContinuation) {
+    expectMinified(SourceLanguage::C,
+                   "// note \\\n"
+                   "continued\n"
+                   "int a; // crlf \\\r\n"
+                   "continued\r\n"
+                   "int b; // \\ not at the end\n"
+                   "int c;\n",
+                   "int a;\n"
+                   "int b;\n"
+                   "int c;\n");
+    expectMinified(SourceLanguage::Java,
+                   "// note \\\n"
+                   "int a;\n",
+                   "int a;\n");
+}
+
+TEST(Minify, BlockCommentSpacing) {
+    expectMinified(SourceLanguage::C,
+                   "/* x */ const q = 1;\n"
+                   "    /* x */ int a /* y */ = b/**/+c;\n",
+                   "const q = 1;\n"
+                   "    int a = b +c;\n");
+}
+
+TEST(Minify, Python) {
+    expectMinified(SourceLanguage::Python,
+                   "#!/usr/bin/env python3\n"
+                   "# comment\n"
+                   "def f(x):  # trailing\n"
+                   "    s = \"\"\"a # kept\n"
+                   "\n"
+                   "  b\"\"\"\n"
+                   "    return '#' + s\n",
+                   "#!/usr/bin/env python3\n"
+                   "def f(x):\n"
+                   "    s = \"\"\"a # kept\n"
+                   "\n"
+                   "  b\"\"\"\n"
+                   "    return '#' + s\n");
+}
+
+TEST(Minify, JavaScript) {
+    expectMinified(SourceLanguage::JavaScript,
+                   "const a = `x // y\n"
+                   "/* z */`; // gone\n"
+                   "const b = a / 2; /* gone */\n",
+                   "const a = `x // y\n"
+                   "/* z */`;\n"
+                   "const b = a / 2;\n");
+}
+
+TEST(Minify, JavaScriptRegexLiterals) {
+    expectMinified(SourceLanguage::JavaScript,
+                   "const r = /\"|\\/\\//g; // gone\n"
+                   "if (/[/'](x)/.test(s)) return /a/ / 2; // gone\n"
+                   "x = a / b / c; // gone\n"
+                   "return /'/;\n",
+                   "const r = /\"|\\/\\//g;\n"
+                   "if (/[/'](x)/.test(s)) return /a/ / 2;\n"
+                   "x = a / b / c;\n"
+                   "return /'/;\n");
+}
+
+TEST(Minify, Java) {
+    expectMinified(SourceLanguage::Java,
+                   "/** Doc. */\n"
+                   "class A {\n"
+                   "    String s = \"\"\"\n"
+                   "        // text block\n"
+                   "        \"\"\";\n"
+                   "}\n",
+                   "class A {\n"
+                   "    String s = \"\"\"\n"
+                   "        // text block\n"
+                   "        \"\"\";\n"
+                   "}\n");
+}
+
+TEST(Minify, Go) {
+    expectMinified(SourceLanguage::Go,
+                   "package main // p\n"
+                   "var s = `raw \\ // kept\n"
+                   "`, '`' // gone\n",
+                   "package main\n"
+                   "var s = `raw \\ // kept\n"
+                   "`, '`'\n");
+}
+
+TEST(Minify, Shell) {
+    expectMinified(SourceLanguage::Shell,
+                   "#!/bin/sh\n"
+                   "# comment\n"
+                   "echo \"a # b\" 'c # d' e#f # gone\n",
+                   "#!/bin/sh\n"
+                   "echo \"a # b\" 'c # d' e#f\n");
+}
+
+TEST(Minify, ShellHereDocuments) {
+    expectMinified(SourceLanguage::Shell,
+                   "cat <<'END' # gone\n"
+                   "# kept  \n"
+                   "\n"
+                   "END\n"
+                   "cat <<-\"EOF\" > out; cat << E\\ND\n"
+                   "\t# kept\n"
+                   "\tEOF\n"
+                   "  # kept\n"
+                   "END\n"
+                   "# gone\n"
+                   "cat <<<'# string' # gone\n"
+                   "echo $((1<<2)) # gone\n",
+                   "cat <<'END'\n"
+                   "# kept  \n"
+                   "\n"
+                   "END\n"
+                   "cat <<-\"EOF\" > out; cat << E\\ND\n"
+                   "\t# kept\n"
+                   "\tEOF\n"
+                   "  # kept\n"
+                   "END\n"
+                   "cat <<<'# string'\n"
+                   "echo $((1<<2))\n");
+}
+
+TEST(Minify, OutlineBraces) {
+    expectMinified(SourceLanguage::C,
+                   "namespace n {\n"
+                   "int f(int x) {\n"
+                   "    if (x) { return 1; }\n"
+                   "    return 0;\n"
+                   "}\n"
+                   "}\n",
+                   "namespace n {\n"
+                   "int f(int x) { ... }\n"
+                   "}\n",
+                   true);
+}
+
+TEST(Minify, OutlinePython) {
+    expectMinified(SourceLanguage::Python,
+                   "class A:\n"
+                   "    def f(self,\n"
+                   "          x):\n"
+                   "        return x\n"
+                   "    y = 1\n",
+                   "class A:\n"
+                   "    def f(self,\n"
+                   "          x):\n"
+                   "        ...\n"
+                   "    y = 1\n",
+                   true);
+}
+
+} // namespace
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <string>
+#include <system_error>
+
+namespace fs = std::filesystem;
+
+/**
+ * A directory below the system temp directory, removed with everything in
+ * it when the object goes away.
+ */
+class TempDir {
+public:
+    TempDir() {
+        std::random_device random;
+        path_ = fs::temp_directory_path() / ("ProjectCompressorTests-" + std::to_string(random()));
+        fs::create_directories(path_);
+    }
+    ~TempDir() {
+        std::error_code ec;
+        fs::remove_all(path_, ec);
+    }
+    TempDir(const TempDir &) = delete;
+    TempDir &operator=(const TempDir &) = delete;
+
+    const fs::path &path() const { return path_; }
+
+private:
+    fs::path path_;
+};
+
+inline std::string readFile(const fs::path &path) {
+    std::ifstream in(path, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+inline void writeFile(const fs::path &path, const std::string &contents) {
+    fs::create_directories(path.parent_path());
+    std::ofstream(path, std::ios::binary) << contents;
+}
+
+/**
+ * Run a shell command in dir, with its output discarded; true if it exited
+ * with status 0.
+ */
+inline bool runIn(const fs::path &dir, const std::string &command) {
+    std::string line = "cd '" + dir.string() + "' && (" + command + ") >/dev/null 2>&1";
+    return std::system(line.c_str()) == 0;
+}
+
+/**
+ * Run a shell command in dir and return what it wrote to stdout, without
+ * the final newline.
+ */
+inline std::string outputOf(const fs::path &dir, const std::string &command) {
+    std::string line = "cd '" + dir.string() + "' && (" + command + ") 2>/dev/null";
+    std::string output;
+    if (std::FILE *pipe = popen(line.c_str(), "r")) {
+        char buffer[4096];
+        size_t n;
+        while ((n = std::fread(buffer, 1, sizeof(buffer), pipe)) > 0)
+            output.append(buffer, n);
+        pclose(pipe);
+    }
+    if (!output.empty() && output.back() == '\n')
+        output.pop_back();
+    return output;
+}
+
+inline bool haveGit() {
+    return std::system("git --version >/dev/null 2>&1") == 0;
+}
+
+/**
+ * git with a fixed identity and no user or system configuration, so that
+ * fixtures do not depend on the machine.
+ */
+inline std::string git(const std::string &arguments) {
+    return "GIT_CONFIG_NOSYSTEM=1 HOME=/nonexistent git -c user.name=Test -c user.email=test@example.com "
+           "-c init.defaultBranch=main " + arguments;
+}
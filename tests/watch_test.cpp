@@ -0,0 +1,95 @@
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+#include "testing.hpp"
+#include "watch.hpp"
+
+namespace {
+
+// A watched tree, compared after every change with a full walk of it.
+class Watch : public ::testing::Test {
+protected:
+    void SetUp() override {
+        root = dir.path() / "tree";
+        writeFile(root / "a/x.txt", "x\n");
+        writeFile(root / "a/y.txt", "y\n");
+        writeFile(root / "b/z.txt", "z\n");
+        previousPolicy = symlinkPolicy();
+        setSymlinkPolicy(SymlinkPolicy::FollowOnce);
+    }
+
+    void TearDown() override {
+        setSymlinkPolicy(previousPolicy);
+    }
+
+    static std::vector<std::string> relPaths(const std::vector<FileEntry> &files) {
+        std::vector<std::string> result;
+        for (const auto &file : files)
+            result.push_back(file.relPath);
+        return result;
+    }
+
+    std::vector<std::string> fullRun() {
+        TreeListing listing;
+        processDirectory(root, listing, gatherGitIgnoreRules(root), root);
+        return relPaths(listing.files);
+    }
+
+    // Apply the pending events and check the watcher against a full walk.
+    void expectSynced(TreeWatcher &watcher) {
+        watcher.readEvents();
+        watcher.flush(true);
+        EXPECT_EQ(relPaths(watcher.fileList()), fullRun());
+    }
+
+    TempDir dir;
+    fs::path root;
+    SymlinkPolicy previousPolicy = SymlinkPolicy::Skip;
+};
+
+TEST_F(Watch, IncrementalMatchesFullRun) {
+    TreeWatcher watcher(root, WatchOptions());
+    if (!watcher.start())
+        GTEST_SKIP() << "watch mode is not supported here";
+    EXPECT_EQ(relPaths(watcher.fileList()), fullRun());
+
+    writeFile(root / "a/x.txt", "changed\n");
+    expectSynced(watcher);
+    writeFile(root / "c/d/w.txt", "w\n");
+    expectSynced(watcher);
+    fs::remove(root / "a/y.txt");
+    expectSynced(watcher);
+    fs::rename(root / "c", root / "e");
+    expectSynced(watcher);
+    fs::remove_all(root / "b");
+    expectSynced(watcher);
+}
+
+TEST_F(Watch, AliasesMatchFullRun) {
+    fs::create_symlink("a", root / "link");
+    TreeWatcher watcher(root, WatchOptions());
+    if (!watcher.start())
+        GTEST_SKIP() << "watch mode is not supported here";
+    EXPECT_EQ(relPaths(watcher.fileList()), fullRun());
+
+    // A link that comes before the file in the walk includes it instead.
+    fs::create_directories(root / "0");
+    fs::create_symlink("../a/x.txt", root / "0/x.txt");
+    expectSynced(watcher);
+    EXPECT_EQ(relPaths(watcher.fileList()), (std::vector<std::string>{"0/x.txt", "a/y.txt", "b/z.txt"}));
+    // And once the link is gone, the file is reached through its own path.
+    fs::remove_all(root / "0");
+    expectSynced(watcher);
+    fs::remove(root / "link");
+    fs::rename(root / "a", root / "c");
+    expectSynced(watcher);
+    // Another path to a directory that is already included adds nothing.
+    fs::create_symlink("c", root / "d");
+    expectSynced(watcher);
+    fs::remove_all(root / "c");
+    expectSynced(watcher);
+}
+
+} // namespace
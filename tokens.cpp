@@ -0,0 +1,90 @@
+#include "tokens.hpp"
+
+#include <bitset>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+enum ByteClass : unsigned char { kSymbol, kWord, kSpace, kNewline };
+
+struct ClassTable {
+    unsigned char values[256];
+    constexpr ClassTable() : values() {
+        for (int c = 0; c < 256; ++c) {
+            bool word = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_' || c >= 0x80;
+            values[c] = word ? kWord : c == '\n' ? kNewline : (c == ' ' || c == '\t' || c == '\r') ? kSpace : kSymbol;
+        }
+    }
+};
+constexpr ClassTable kClasses;
+
+#if defined(__SSE2__)
+// Bytes x with lo <= x < lo + n (unsigned), as a byte mask.
+inline __m128i inRange(__m128i x, char lo, int n) {
+    __m128i shifted = _mm_add_epi8(_mm_sub_epi8(x, _mm_set1_epi8(lo)), _mm_set1_epi8(static_cast<char>(0x80)));
+    return _mm_cmplt_epi8(shifted, _mm_set1_epi8(static_cast<char>(n - 128)));
+}
+#endif
+
+inline unsigned popcount16(unsigned mask) {
+    return static_cast<unsigned>(std::bitset<16>(mask).count());
+}
+
+} // namespace
+
+void TokenCounter::update(const char *data, size_t size) {
+    const char *p = data;
+    const char *end = data + size;
+#if defined(__SSE2__)
+    while (end - p >= 16) {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+        __m128i letter = inRange(_mm_or_si128(x, _mm_set1_epi8(0x20)), 'a', 26);
+        __m128i digit = inRange(x, '0', 10);
+        __m128i high = _mm_cmplt_epi8(x, _mm_setzero_si128());
+        __m128i underscore = _mm_cmpeq_epi8(x, _mm_set1_epi8('_'));
+        __m128i word = _mm_or_si128(_mm_or_si128(letter, digit), _mm_or_si128(high, underscore));
+        __m128i newline = _mm_cmpeq_epi8(x, _mm_set1_epi8('\n'));
+        __m128i space = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(x, _mm_set1_epi8(' ')), _mm_cmpeq_epi8(x, _mm_set1_epi8('\t'))),
+                                     _mm_or_si128(_mm_cmpeq_epi8(x, _mm_set1_epi8('\r')), newline));
+        unsigned w = static_cast<unsigned>(_mm_movemask_epi8(word));
+        unsigned s = static_cast<unsigned>(_mm_movemask_epi8(space));
+        unsigned n = static_cast<unsigned>(_mm_movemask_epi8(newline));
+        unsigned y = ~(w | s) & 0xFFFFu;
+        words += popcount16(w & ~((w << 1) | (inWord ? 1u : 0u)));
+        wordBytes += popcount16(w);
+        symbolRuns += popcount16(y & ~((y << 1) | (inSymbols ? 1u : 0u)));
+        symbols += popcount16(y);
+        newlines += popcount16(n);
+        inWord = (w >> 15) & 1u;
+        inSymbols = (y >> 15) & 1u;
+        p += 16;
+    }
+#endif
+    for (; p < end; ++p) {
+        unsigned char c = kClasses.values[static_cast<unsigned char>(*p)];
+        if (c == kWord) {
+            words += inWord ? 0 : 1;
+            wordBytes++;
+        } else if (c == kSymbol) {
+            symbolRuns += inSymbols ? 0 : 1;
+            symbols++;
+        } else if (c == kNewline) {
+            newlines++;
+        }
+        inWord = c == kWord;
+        inSymbols = c == kSymbol;
+    }
+}
+
+uint64_t TokenCounter::count() const {
+    return words + wordBytes / 8 + symbolRuns + (symbols - symbolRuns) / 2 + newlines;
+}
+
+uint64_t estimateTokens(const char *data, size_t size) {
+    TokenCounter counter;
+    counter.update(data, size);
+    return counter.count();
+}
@@ -0,0 +1,84 @@
+#!/usr/bin/env bash
+# End-to-end benchmark: generates a synthetic tree with ProjectCompressorTreeGen
+# (unless --tree is given), then runs ProjectCompressor on it with a warm and a
+# cold page cache and appends one CSV line per run.
+#
+#   tools/bench_e2e.sh --build build [--runs 3] [--out results.csv] [--tree DIR]
+#                      [--args "--minify"] [-- <ProjectCompressorTreeGen options>]
+#
+# Cold runs drop the page cache through /proc/sys/vm/drop_caches when it is
+# writable (root outside a container), and otherwise evict the tree's files
+# with posix_fadvise, which leaves directory entries and inodes cached; the
+# "cache" column tells which one was used.
+
+set -euo pipefail
+
+build=build
+runs=3
+out=bench_e2e.csv
+tree=
+args=
+generator=()
+while [[ $# -gt 0 ]]; do
+    case "$1" in
+        --build) build=$2; shift 2 ;;
+        --runs) runs=$2; shift 2 ;;
+        --out) out=$2; shift 2 ;;
+        --tree) tree=$2; shift 2 ;;
+        --args) args=$2; shift 2 ;;
+        --) shift; generator=("$@"); break ;;
+        *) echo "Unknown option: $1" >&2; exit 1 ;;
+    esac
+done
+
+compressor=$(realpath "$build/ProjectCompressor")
+treegen=$(realpath "$build/ProjectCompressorTreeGen")
+for tool in "$compressor" "$treegen"; do
+    [[ -x $tool ]] || { echo "Not built: $tool" >&2; exit 1; }
+done
+
+scratch=$(mktemp -d)
+trap 'rm -rf "$scratch"' EXIT
+if [[ -z $tree ]]; then
+    tree=$scratch/tree
+    "$treegen" "${generator[@]}" "$tree"
+fi
+tree=$(realpath "$tree")
+mkdir "$scratch/out"
+
+dropCaches() {
+    sync
+    if [[ -w /proc/sys/vm/drop_caches ]] && { echo 3 > /proc/sys/vm/drop_caches; } 2> /dev/null; then
+        cache=dropped
+    else
+        "$treegen" --evict "$tree" > /dev/null
+        cache=fadvise
+    fi
+}
+
+[[ -s $out ]] || echo "commit,mode,cache,run,seconds,files,bytes,mib_per_s,args" > "$out"
+commit=$(git -C "$(dirname "$0")" rev-parse --short HEAD 2> /dev/null || echo unknown)
+
+for mode in warm cold; do
+    if [[ $mode == warm ]]; then
+        # One untimed run to fill the cache.
+        (cd "$scratch/out" && "$compressor" $args "$tree" > /dev/null 2>&1)
+    fi
+    for ((run = 1; run <= runs; run++)); do
+        cache=warm
+        [[ $mode == cold ]] && dropCaches
+        rm -f "$scratch/out"/combined*
+        start=$(date +%s.%N)
+        # The last --progress-json line has the files and bytes the run combined.
+        summary=$(cd "$scratch/out" && "$compressor" --progress-json $args "$tree" 2>&1 > /dev/null |
+                  grep '"phase":"done"')
+        end=$(date +%s.%N)
+        files=$(sed -n 's/.*"filesDone":\([0-9]*\).*/\1/p' <<< "$summary")
+        bytes=$(sed -n 's/.*"bytesDone":\([0-9]*\).*/\1/p' <<< "$summary")
+        line=$(awk -v s="$start" -v e="$end" -v b="$bytes" \
+               'BEGIN { t = e - s; printf "%.3f,%s,%s,%.1f", t, "'"$files"'", b, b / t / 1048576 }')
+        echo "$commit,$mode,$cache,$run,$line,\"$args\"" >> "$out"
+        echo "$mode run $run ($cache): ${line%%,*} s, $(cut -d, -f4 <<< "$line") MiB/s"
+    done
+done
+echo "Results appended to $out"
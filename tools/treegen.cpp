@@ -0,0 +1,367 @@
+// Generates synthetic source trees for end-to-end benchmarks: the shape,
+// the file sizes, the share of binary files and the .gitignore files are
+// set on the command line, and the same seed gives the same tree. Also
+// evicts a tree from the page cache for cold runs (see bench_e2e.sh).
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#if defined(__linux__)
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace {
+
+enum class SizeDistribution { Fixed, Uniform, LogNormal };
+enum class RuleComplexity { Simple, Mixed, Complex };
+
+struct TreeOptions {
+    fs::path root;
+    int depth = 3;             // Levels of directories below the root.
+    int fanout = 4;            // Subdirectories of every directory above the last level.
+    int filesPerDir = 8;
+    SizeDistribution sizes = SizeDistribution::LogNormal;
+    double sizeA = 4096;       // Fixed size, uniform minimum or log-normal median.
+    double sizeB = 1.5;        // Uniform maximum or log-normal sigma.
+    double binaryRatio = 0.1;  // Share of files with binary content.
+    double ignoreDensity = 0.2; // Share of directories with a .gitignore (the root always has one).
+    RuleComplexity rules = RuleComplexity::Mixed;
+    uint64_t seed = 1;
+};
+
+struct TreeSummary {
+    uint64_t directories = 0;
+    uint64_t files = 0;
+    uint64_t binaryFiles = 0;
+    uint64_t bytes = 0;
+    uint64_t ignoreFiles = 0;
+    uint64_t rules = 0;
+};
+
+/**
+ * SplitMix64: small, fast and the same on every platform, unlike the
+ * distributions of <random>.
+ */
+class Random {
+public:
+    explicit Random(uint64_t seed) : state(seed) {}
+
+    uint64_t next() {
+        uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        return z ^ (z >> 31);
+    }
+
+    uint64_t below(uint64_t bound) { return bound ? next() % bound : 0; }
+    double unit() { return static_cast<double>(next() >> 11) / 9007199254740992.0; } // [0, 1)
+    bool chance(double probability) { return unit() < probability; }
+
+    double normal() {
+        double u = 1.0 - unit(); // (0, 1]
+        return std::sqrt(-2.0 * std::log(u)) * std::cos(6.283185307179586 * unit());
+    }
+
+private:
+    uint64_t state;
+};
+
+// Names are drawn from small pools so that the ignore rules match some of them.
+const char *const kDirNames[] = {"src", "lib", "core", "util", "net", "build", "cache", "tmp", "test", "docs",
+                                 "generated", "vendor", "include", "tools", "assets", "logs"};
+const char *const kTextExtensions[] = {".cpp", ".hpp", ".c", ".h", ".py", ".js", ".ts", ".md", ".txt", ".log",
+                                       ".json", ".sh"};
+const char *const kBinaryExtensions[] = {".o", ".bin", ".png", ".so", ".a", ".zip"};
+const char *const kWords[] = {"int", "return", "value", "count", "buffer", "size_t", "const", "auto", "if",
+                              "for", "while", "result", "index", "std::string", "data", "node", "next", "=",
+                              "+", "(", ")", "{", "}", ";", "0", "1", "42", "nullptr", "// TODO", "true"};
+
+// Rule pools of increasing complexity; each level also draws from the ones before.
+const std::vector<std::vector<std::string>> kRulePools = {
+    {"*.log", "build/", "*.o", "*.tmp", "cache/", "*.bin"},
+    {"/generated", "tmp/", "!keep.log", "*.[oa]", "logs/*.txt", "/vendor/", "*.so", "!important.bin"},
+    {"**/cache/**", "src/**/generated/", "**/*.min.*", "!**/tmp/README.md", "test/**/*.json", "lib/?ore/",
+     "**/logs/**/*.log", "!**/build/keep.*", "assets/**/*.png", "docs/**/_*"},
+};
+
+uint64_t drawSize(const TreeOptions &options, Random &random) {
+    switch (options.sizes) {
+    case SizeDistribution::Fixed:
+        return static_cast<uint64_t>(options.sizeA);
+    case SizeDistribution::Uniform:
+        return static_cast<uint64_t>(options.sizeA) +
+               random.below(static_cast<uint64_t>(options.sizeB - options.sizeA) + 1);
+    case SizeDistribution::LogNormal:
+        break;
+    }
+    double size = options.sizeA * std::exp(options.sizeB * random.normal());
+    return static_cast<uint64_t>(std::fmin(size, 1e9)); // Keep the tail on the disk.
+}
+
+void fillText(std::string &content, uint64_t size, Random &random) {
+    content.clear();
+    size_t column = 0;
+    while (content.size() < size) {
+        const char *word = kWords[random.below(std::size(kWords))];
+        if (column > 60 + random.below(40)) {
+            content += '\n';
+            column = 0;
+            if (random.chance(0.5))
+                content += "    ";
+        } else if (column > 0) {
+            content += ' ';
+        }
+        content += word;
+        column += std::char_traits<char>::length(word) + 1;
+    }
+    content.resize(size);
+    if (size > 0)
+        content.back() = '\n';
+}
+
+void fillBinary(std::string &content, uint64_t size, Random &random) {
+    content.resize(size);
+    for (uint64_t i = 0; i < size; i += 8) {
+        uint64_t word = random.next();
+        for (uint64_t j = i; j < size && j < i + 8; ++j, word >>= 8)
+            content[j] = static_cast<char>(word);
+    }
+}
+
+bool writeFile(const fs::path &path, const std::string &content) {
+    std::FILE *file = std::fopen(path.string().c_str(), "wb");
+    if (!file) {
+        std::cerr << "Cannot create " << path.string() << "\n";
+        return false;
+    }
+    bool written = std::fwrite(content.data(), 1, content.size(), file) == content.size();
+    written = std::fclose(file) == 0 && written;
+    if (!written)
+        std::cerr << "Cannot write " << path.string() << "\n";
+    return written;
+}
+
+bool writeIgnoreFile(const fs::path &dir, const TreeOptions &options, Random &random, TreeSummary &summary) {
+    const size_t levels = static_cast<size_t>(options.rules) + 1;
+    const uint64_t count = 2 + random.below(2 * levels + 1);
+    std::string content = "# Generated\n";
+    for (uint64_t i = 0; i < count; ++i) {
+        const auto &pool = kRulePools[random.below(levels)];
+        content += pool[random.below(pool.size())] + "\n";
+    }
+    summary.ignoreFiles++;
+    summary.rules += count;
+    return writeFile(dir / ".gitignore", content);
+}
+
+bool generateDirectory(const fs::path &dir, int level, const TreeOptions &options, Random &random,
+                       TreeSummary &summary) {
+    std::error_code ec;
+    fs::create_directories(dir, ec);
+    if (ec) {
+        std::cerr << "Cannot create " << dir.string() << ": " << ec.message() << "\n";
+        return false;
+    }
+    summary.directories++;
+    if ((level == 0 || random.chance(options.ignoreDensity)) && !writeIgnoreFile(dir, options, random, summary))
+        return false;
+
+    std::string content;
+    for (int i = 0; i < options.filesPerDir; ++i) {
+        bool binary = random.chance(options.binaryRatio);
+        std::string name = "file" + std::to_string(i) +
+                           (binary ? kBinaryExtensions[random.below(std::size(kBinaryExtensions))]
+                                   : kTextExtensions[random.below(std::size(kTextExtensions))]);
+        uint64_t size = drawSize(options, random);
+        if (binary)
+            fillBinary(content, size, random);
+        else
+            fillText(content, size, random);
+        if (!writeFile(dir / name, content))
+            return false;
+        summary.files++;
+        summary.binaryFiles += binary ? 1 : 0;
+        summary.bytes += size;
+    }
+
+    if (level == options.depth)
+        return true;
+    const size_t first = random.below(std::size(kDirNames));
+    for (int i = 0; i < options.fanout; ++i) {
+        // Consecutive names of the pool, numbered once it is used up.
+        const size_t round = static_cast<size_t>(i) / std::size(kDirNames);
+        std::string name = kDirNames[(first + i) % std::size(kDirNames)];
+        if (round > 0)
+            name += std::to_string(round);
+        if (!generateDirectory(dir / name, level + 1, options, random, summary))
+            return false;
+    }
+    return true;
+}
+
+/**
+ * Drop the cached pages of every file below root with posix_fadvise, for
+ * cold runs where /proc/sys/vm/drop_caches cannot be written. Dirty pages
+ * are flushed first. Directory entries and inodes stay cached.
+ */
+bool evictTree(const fs::path &root) {
+#if defined(__linux__)
+    std::error_code ec;
+    uint64_t evicted = 0;
+    for (fs::recursive_directory_iterator it(root, ec), end; !ec && it != end; it.increment(ec)) {
+        if (!it->is_regular_file(ec))
+            continue;
+        int fd = ::open(it->path().c_str(), O_RDONLY);
+        if (fd < 0)
+            continue;
+        ::fdatasync(fd);
+        if (::posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED) == 0)
+            evicted++;
+        ::close(fd);
+    }
+    if (ec) {
+        std::cerr << "Cannot list " << root.string() << ": " << ec.message() << "\n";
+        return false;
+    }
+    std::cout << "Evicted " << evicted << " files from the page cache\n";
+    return true;
+#else
+    std::cerr << "Eviction is only supported on Linux\n";
+    return false;
+#endif
+}
+
+bool parseSizes(const std::string &value, TreeOptions &options) {
+    double a = 0, b = 0;
+    int consumed = 0;
+    if (std::sscanf(value.c_str(), "fixed:%lf%n", &a, &consumed) == 1 && static_cast<size_t>(consumed) == value.size()) {
+        options.sizes = SizeDistribution::Fixed;
+    } else if (std::sscanf(value.c_str(), "uniform:%lf:%lf%n", &a, &b, &consumed) == 2 &&
+               static_cast<size_t>(consumed) == value.size() && b >= a) {
+        options.sizes = SizeDistribution::Uniform;
+    } else if (std::sscanf(value.c_str(), "lognormal:%lf:%lf%n", &a, &b, &consumed) == 2 &&
+               static_cast<size_t>(consumed) == value.size() && b >= 0) {
+        options.sizes = SizeDistribution::LogNormal;
+    } else {
+        return false;
+    }
+    if (a < 0)
+        return false;
+    options.sizeA = a;
+    options.sizeB = b;
+    return true;
+}
+
+bool parseRatio(const char *text, double &ratio) {
+    char *end = nullptr;
+    ratio = std::strtod(text, &end);
+    return end != text && *end == '\0' && ratio >= 0 && ratio <= 1;
+}
+
+bool parseInt(const char *text, int &value, int minimum) {
+    char *end = nullptr;
+    long parsed = std::strtol(text, &end, 10);
+    if (end == text || *end != '\0' || parsed < minimum || parsed > 1000)
+        return false;
+    value = static_cast<int>(parsed);
+    return true;
+}
+
+void printUsage(const char *program) {
+    std::cerr << "Usage: " << program << " [options] <directory>\n"
+              << "       " << program << " --evict <directory>\n"
+              << "Creates a synthetic source tree in <directory>, which must not exist or be empty.\n"
+              << "Options:\n"
+              << "  --depth N          Levels of directories below the root (default 3)\n"
+              << "  --fanout N         Subdirectories per directory (default 4)\n"
+              << "  --files N          Files per directory (default 8)\n"
+              << "  --sizes DIST       File sizes in bytes: fixed:S, uniform:MIN:MAX or\n"
+              << "                     lognormal:MEDIAN:SIGMA (default lognormal:4096:1.5)\n"
+              << "  --binary R         Share of binary files, 0 to 1 (default 0.1)\n"
+              << "  --ignore-density R Share of directories with a .gitignore, 0 to 1 (default 0.2)\n"
+              << "  --rules LEVEL      Rule complexity: simple, mixed or complex (default mixed)\n"
+              << "  --seed N           Seed; the same options and seed give the same tree (default 1)\n"
+              << "  --evict            Drop the files of an existing tree from the page cache (Linux)\n";
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+    TreeOptions options;
+    bool evict = false;
+    std::vector<std::string> arguments;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool valid = true;
+        if (arg == "--depth" && i + 1 < argc) {
+            valid = parseInt(argv[++i], options.depth, 0);
+        } else if (arg == "--fanout" && i + 1 < argc) {
+            valid = parseInt(argv[++i], options.fanout, 0);
+        } else if (arg == "--files" && i + 1 < argc) {
+            valid = parseInt(argv[++i], options.filesPerDir, 0);
+        } else if (arg == "--sizes" && i + 1 < argc) {
+            valid = parseSizes(argv[++i], options);
+        } else if (arg == "--binary" && i + 1 < argc) {
+            valid = parseRatio(argv[++i], options.binaryRatio);
+        } else if (arg == "--ignore-density" && i + 1 < argc) {
+            valid = parseRatio(argv[++i], options.ignoreDensity);
+        } else if (arg == "--rules" && i + 1 < argc) {
+            std::string level = argv[++i];
+            if (level == "simple")
+                options.rules = RuleComplexity::Simple;
+            else if (level == "mixed")
+                options.rules = RuleComplexity::Mixed;
+            else if (level == "complex")
+                options.rules = RuleComplexity::Complex;
+            else
+                valid = false;
+        } else if (arg == "--seed" && i + 1 < argc) {
+            char *end = nullptr;
+            options.seed = std::strtoull(argv[++i], &end, 10);
+            valid = *end == '\0';
+        } else if (arg == "--evict") {
+            evict = true;
+        } else if (arg.rfind("--", 0) == 0) {
+            std::cerr << "Unknown option: " << arg << "\n";
+            printUsage(argv[0]);
+            return 1;
+        } else {
+            arguments.push_back(arg);
+        }
+        if (!valid) {
+            std::cerr << "Invalid value for " << arg << ": " << argv[i] << "\n";
+            return 1;
+        }
+    }
+    if (arguments.size() != 1) {
+        printUsage(argv[0]);
+        return 1;
+    }
+    options.root = arguments[0];
+    if (evict)
+        return evictTree(options.root) ? 0 : 1;
+
+    std::error_code ec;
+    if (fs::exists(options.root, ec) && !fs::is_empty(options.root, ec)) {
+        std::cerr << "Not empty: " << options.root.string() << "\n";
+        return 1;
+    }
+    Random random(options.seed);
+    TreeSummary summary;
+    if (!generateDirectory(options.root, 0, options, random, summary))
+        return 1;
+    std::cout << "Generated " << summary.directories << " directories, " << summary.files << " files ("
+              << summary.binaryFiles << " binary, " << summary.bytes << " bytes), " << summary.ignoreFiles
+              << " .gitignore files with " << summary.rules << " rules\n";
+    return 0;
+}
@@ -0,0 +1,125 @@
+#include "trace.hpp"
+
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+bool traceEnabled = false;
+
+namespace {
+
+struct TraceEvent {
+    const char *name;
+    const char *category;
+    int64_t startNs;    // Since enableTrace.
+    int64_t durationNs;
+    std::string detail;
+};
+
+// The spans of one thread, appended to by that thread only.
+struct TraceBuffer {
+    uint32_t threadId;
+    bool mainThread;
+    std::vector<TraceEvent> events;
+};
+
+std::chrono::steady_clock::time_point traceStart;
+std::thread::id mainThreadId;
+std::mutex buffersMutex;
+std::vector<std::unique_ptr<TraceBuffer>> buffers; // Outlive their threads.
+thread_local TraceBuffer *threadBuffer = nullptr;
+
+TraceBuffer &localBuffer() {
+    if (!threadBuffer) {
+        std::lock_guard<std::mutex> lock(buffersMutex);
+        buffers.push_back(std::make_unique<TraceBuffer>());
+        threadBuffer = buffers.back().get();
+        threadBuffer->threadId = static_cast<uint32_t>(buffers.size());
+        threadBuffer->mainThread = std::this_thread::get_id() == mainThreadId;
+        threadBuffer->events.reserve(4096);
+    }
+    return *threadBuffer;
+}
+
+int64_t sinceStart(std::chrono::steady_clock::time_point time) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(time - traceStart).count();
+}
+
+void writeJsonString(std::ostream &out, const std::string &text) {
+    out << '"';
+    for (char c : text) {
+        unsigned char u = static_cast<unsigned char>(c);
+        if (c == '"' || c == '\\') {
+            out << '\\' << c;
+        } else if (u < 0x20) {
+            char escaped[8];
+            std::snprintf(escaped, sizeof(escaped), "\\u%04x", u);
+            out << escaped;
+        } else {
+            out << c;
+        }
+    }
+    out << '"';
+}
+
+// Nanoseconds as the microseconds the format uses.
+void writeMicros(std::ostream &out, int64_t ns) {
+    char text[32];
+    std::snprintf(text, sizeof(text), "%.3f", static_cast<double>(ns) / 1000.0);
+    out << text;
+}
+
+} // namespace
+
+void enableTrace() {
+    traceEnabled = true;
+    traceStart = std::chrono::steady_clock::now();
+    mainThreadId = std::this_thread::get_id();
+}
+
+void recordTraceSpan(const char *name,
+                     const char *category,
+                     std::chrono::steady_clock::time_point start,
+                     std::chrono::steady_clock::time_point end,
+                     std::string detail) {
+    int64_t startNs = sinceStart(start);
+    localBuffer().events.push_back({name, category, startNs, sinceStart(end) - startNs, std::move(detail)});
+}
+
+bool writeTrace(const fs::path &path) {
+    std::ofstream out(path, std::ios::out | std::ios::binary);
+    if (!out) {
+        std::cerr << "Failed to create trace " << path << "\n";
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(buffersMutex);
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    out << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"ProjectCompressor\"}}";
+    for (const auto &buffer : buffers) {
+        out << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->threadId
+            << ",\"args\":{\"name\":\"" << (buffer->mainThread ? "main" : "worker") << "\"}}";
+        for (const auto &event : buffer->events) {
+            out << ",\n{\"name\":\"" << event.name << "\",\"cat\":\"" << event.category
+                << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->threadId << ",\"ts\":";
+            writeMicros(out, event.startNs);
+            out << ",\"dur\":";
+            writeMicros(out, event.durationNs);
+            if (!event.detail.empty()) {
+                out << ",\"args\":{\"detail\":";
+                writeJsonString(out, event.detail);
+                out << "}";
+            }
+            out << "}";
+        }
+    }
+    out << "\n]}\n";
+    if (!out) {
+        std::cerr << "Failed to write trace " << path << "\n";
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+
+namespace fs = std::filesystem;
+
+// Set once, before any work starts, by enableTrace.
+extern bool traceEnabled;
+
+/**
+ * Start recording spans; timestamps in the trace count from here.
+ */
+void enableTrace();
+
+/**
+ * Add a span to the buffer of the calling thread. Each thread appends to
+ * a buffer of its own, so recording takes no lock (except once, when a
+ * thread records its first span). detail is shown as the span's argument.
+ */
+void recordTraceSpan(const char *name,
+                     const char *category,
+                     std::chrono::steady_clock::time_point start,
+                     std::chrono::steady_clock::time_point end,
+                     std::string detail);
+
+/**
+ * Write every span recorded so far to path as Chrome trace-event JSON,
+ * which chrome://tracing and Perfetto open. Call once the worker threads
+ * are done.
+ */
+bool writeTrace(const fs::path &path);
+
+/**
+ * A span from construction to destruction, recorded if tracing is on.
+ */
+class TraceSpan {
+public:
+    TraceSpan(const char *name, const char *category) : name(name), category(category), active(traceEnabled) {
+        if (active)
+            start = std::chrono::steady_clock::now();
+    }
+
+    ~TraceSpan() {
+        if (active)
+            recordTraceSpan(name, category, start, std::chrono::steady_clock::now(), std::move(detail));
+    }
+
+    // Describe what the span is about (a path, say); ignored when not tracing.
+    void note(const std::string &text) {
+        if (active)
+            detail = text;
+    }
+
+    TraceSpan(const TraceSpan &) = delete;
+    TraceSpan &operator=(const TraceSpan &) = delete;
+
+private:
+    const char *name;
+    const char *category;
+    const bool active;
+    std::chrono::steady_clock::time_point start;
+    std::string detail;
+};
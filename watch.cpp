@@ -0,0 +1,458 @@
+#include "watch.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <fstream>
+#include <iostream>
+
+#include "manifest.hpp"
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+namespace {
+
+volatile std::sig_atomic_t stopRequested = 0;
+
+void onStopSignal(int) {
+    stopRequested = 1;
+}
+
+int64_t steadyNowMs() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// True if relPath is dir itself or lies below it.
+bool isWithin(const std::string &relPath, const std::string &dir) {
+    if (dir.empty())
+        return true;
+    return relPath.size() >= dir.size() && relPath.compare(0, dir.size(), dir) == 0 &&
+           (relPath.size() == dir.size() || relPath[dir.size()] == '/');
+}
+
+#ifdef __linux__
+const uint32_t kWatchMask = IN_CREATE | IN_DELETE | IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB |
+                            IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR;
+
+long readWatchLimit() {
+    std::ifstream in("/proc/sys/fs/inotify/max_user_watches");
+    long limit = -1;
+    in >> limit;
+    return limit;
+}
+#endif
+
+} // namespace
+
+TreeWatcher::TreeWatcher(const fs::path &root, const WatchOptions &options)
+    : root(root), options(options) {}
+
+TreeWatcher::~TreeWatcher() {
+#ifdef __linux__
+    if (inotifyFd >= 0)
+        close(inotifyFd);
+#endif
+}
+
+fs::path TreeWatcher::absolutePath(const std::string &relPath) const {
+    return relPath.empty() ? root : root / relPath;
+}
+
+bool TreeWatcher::start() {
+#ifdef __linux__
+    inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotifyFd < 0) {
+        std::cerr << "Failed to initialize inotify\n";
+        return false;
+    }
+    rescanAll();
+    nextPollMs = steadyNowMs() + options.pollIntervalMs;
+    return true;
+#else
+    std::cerr << "Watch mode is only supported on Linux\n";
+    return false;
+#endif
+}
+
+int TreeWatcher::timeoutMs() const {
+    int64_t now = steadyNowMs();
+    int64_t due = -1;
+    if (fullRescanPending || !dirtyDirs.empty())
+        due = std::min(lastEventMs + options.debounceMs, firstEventMs + options.maxDelayMs);
+    if (!polledDirs.empty())
+        due = due < 0 ? nextPollMs : std::min(due, nextPollMs);
+    if (due < 0)
+        return -1;
+    return static_cast<int>(std::max<int64_t>(0, due - now));
+}
+
+void TreeWatcher::readEvents() {
+#ifdef __linux__
+    alignas(struct inotify_event) char buffer[64 * 1024];
+    while (true) {
+        ssize_t length = read(inotifyFd, buffer, sizeof(buffer));
+        if (length <= 0)
+            break;
+        int64_t now = steadyNowMs();
+        for (char *p = buffer; p < buffer + length;) {
+            auto *event = reinterpret_cast<struct inotify_event *>(p);
+            p += sizeof(struct inotify_event) + event->len;
+
+            if (event->mask & IN_Q_OVERFLOW) {
+                // Events were lost; only a full rescan is safe.
+                fullRescanPending = true;
+            } else {
+                auto it = wdToDir.find(event->wd);
+                if (it == wdToDir.end())
+                    continue;
+                if (event->mask & IN_IGNORED) {
+                    // The kernel dropped the watch; the parent reports the removal.
+                    dirToWd.erase(it->second);
+                    wdToDir.erase(it);
+                    continue;
+                }
+                std::string name = event->len ? event->name : "";
+                if (!name.empty() && (isOutputArtifact(name) || isPrunedName(name)))
+                    continue; // Our own output being rewritten, or VCS metadata.
+                if (name == ".gitignore")
+                    fullRescanPending = true;
+                dirtyDirs.insert(it->second);
+            }
+            if (firstEventMs == 0)
+                firstEventMs = now;
+            lastEventMs = now;
+        }
+    }
+#endif
+}
+
+bool TreeWatcher::flush(bool force) {
+    int64_t now = steadyNowMs();
+    bool eventsPending = fullRescanPending || !dirtyDirs.empty();
+    bool pollDue = !polledDirs.empty() && (force || now >= nextPollMs);
+    if (eventsPending && !force && now - lastEventMs < options.debounceMs && now - firstEventMs < options.maxDelayMs)
+        eventsPending = false;
+    if (!eventsPending && !pollDue)
+        return false;
+
+    bool changed = false;
+    try {
+        if (eventsPending) {
+            for (auto it = dirtyDirs.begin(); it != dirtyDirs.end() && !fullRescanPending; ++it)
+                changed |= rescanDirectory(*it);
+            if (fullRescanPending)
+                changed = rescanAll();
+            fullRescanPending = false;
+            dirtyDirs.clear();
+            firstEventMs = lastEventMs = 0;
+        }
+        if (pollDue) {
+            std::vector<std::string> polled(polledDirs.begin(), polledDirs.end());
+            for (auto it = polled.begin(); it != polled.end() && !fullRescanPending; ++it)
+                changed |= rescanDirectory(*it);
+            if (fullRescanPending)
+                changed = rescanAll();
+            fullRescanPending = false;
+            nextPollMs = now + options.pollIntervalMs;
+        }
+    } catch (const fs::filesystem_error &e) {
+        // The tree changed underneath us; try again once it settles.
+        std::cerr << "Rescan failed, retrying: " << e.what() << "\n";
+        fullRescanPending = true;
+        firstEventMs = lastEventMs = now;
+    }
+    return changed;
+}
+
+std::vector<FileEntry> TreeWatcher::fileList() const {
+    std::vector<FileEntry> result;
+    result.reserve(files.size());
+    for (const auto &item : files)
+        result.push_back(item.second);
+    return result;
+}
+
+std::vector<FileEntry> TreeWatcher::filesUnder(const std::string &relDir) const {
+    std::vector<FileEntry> result;
+    for (auto it = files.lower_bound(relDir); it != files.end() && isWithin(it->first, relDir); ++it)
+        result.push_back(it->second);
+    return result;
+}
+
+bool TreeWatcher::rescanAll() {
+    rules = gatherGitIgnoreRules(root);
+    // A fresh walk; its traversal state is kept for the rescans that follow,
+    // so that they leave out the same aliases as a full run.
+    traversal = TraversalState();
+    FileStat rootStat;
+    statPath(root, rootStat);
+    traversal.visited.insert(rootStat.dev, rootStat.ino);
+    files.clear();
+    ScannedDirectories found;
+    scanSubtree({"", rootStat.mtimeNs, rootStat.dev, rootStat.ino}, found);
+
+    std::vector<std::string> stale;
+    for (const auto &dir : directories) {
+        if (!found.count(dir))
+            stale.push_back(dir);
+    }
+    for (const auto &dir : stale)
+        removeDirectory(dir);
+    for (const auto &dir : found) {
+        if (!directories.count(dir.first))
+            addDirectory(dir.first);
+    }
+    scanned = std::move(found);
+    // Retry directories that fell back to polling; watches may have been freed.
+    std::vector<std::string> polled(polledDirs.begin(), polledDirs.end());
+    for (const auto &dir : polled) {
+        removeDirectory(dir);
+        addDirectory(dir);
+    }
+    return true;
+}
+
+void TreeWatcher::scanSubtree(const DirectoryEntry &dir, ScannedDirectories &found) {
+    // The same order as processDirectory: all of a directory's entries are
+    // claimed in the traversal state before any subdirectory is entered.
+    fs::path path = absolutePath(dir.relPath);
+    bool entered = traversal.enter(path);
+    size_t skipped = traversal.skipped;
+    DirectoryListing listing;
+    listDirectory(path, dir.relPath, rules, root, listing, &traversal);
+    found[dir.relPath] = {{dir.dev, dir.ino}, traversal.skipped - skipped};
+    for (auto &file : listing.files)
+        files[file.relPath] = std::move(file);
+    for (const auto &subdir : listing.subdirs)
+        scanSubtree(subdir, found);
+    if (entered)
+        traversal.leave();
+}
+
+bool TreeWatcher::rescanDirectory(const std::string &relDir) {
+    if (!directories.count(relDir))
+        return false; // Removed as part of an earlier change in this batch.
+    fs::path dirPath = absolutePath(relDir);
+    FileStat dirStat;
+    if (!statPath(dirPath, dirStat) || !dirStat.isDirectory) {
+        removeSubtree(relDir);
+        if (traversal.skipped > 0)
+            fullRescanPending = true; // An alias elsewhere may be the only path left.
+        return true;
+    }
+
+    // The directory is listed again within the walk that built the tree: the
+    // inodes its entries hold are released first, so that listDirectory claims
+    // them back, and leaves out aliases of files included elsewhere.
+    std::string prefix = relDir.empty() ? "" : relDir + "/";
+    auto isChild = [&](const std::string &relPath) { return relPath.find('/', prefix.size()) == std::string::npos; };
+    std::vector<std::pair<uint64_t, uint64_t>> released;
+    for (auto it = files.lower_bound(prefix); it != files.end() && isWithin(it->first, relDir); ++it) {
+        if (isChild(it->first))
+            released.emplace_back(it->second.dev, it->second.ino);
+    }
+    for (auto it = directories.upper_bound(relDir); it != directories.end() && isWithin(*it, relDir); ++it) {
+        auto info = scanned.find(*it);
+        if (isChild(*it) && info != scanned.end())
+            released.push_back(info->second.id);
+    }
+    for (const auto &id : released)
+        traversal.visited.erase(id.first, id.second);
+
+    // Under Follow, a link to this directory or to any above it closes a cycle.
+    size_t depth = traversal.enter(root) ? 1 : 0;
+    for (size_t slash = relDir.find('/'); slash != std::string::npos; slash = relDir.find('/', slash + 1))
+        depth += traversal.enter(absolutePath(relDir.substr(0, slash)));
+    if (!relDir.empty())
+        depth += traversal.enter(dirPath);
+    size_t skippedBefore = traversal.skipped;
+    DirectoryListing listing;
+    listDirectory(dirPath, relDir, rules, root, listing, &traversal);
+    size_t skipped = traversal.skipped - skippedBefore;
+
+    std::set<std::string> present;
+    std::vector<std::pair<uint64_t, uint64_t>> claimed;
+    for (const auto &file : listing.files) {
+        present.insert(file.relPath);
+        claimed.emplace_back(file.dev, file.ino);
+    }
+    std::vector<DirectoryEntry> added;
+    for (const auto &subdir : listing.subdirs) {
+        present.insert(subdir.relPath);
+        claimed.emplace_back(subdir.dev, subdir.ino);
+        auto info = scanned.find(subdir.relPath);
+        if (!directories.count(subdir.relPath) || info == scanned.end() ||
+            info->second.id != std::make_pair(subdir.dev, subdir.ino))
+            added.push_back(subdir); // New, or a different directory under the old name.
+    }
+
+    // Drop direct children that disappeared, and subdirectories with them,
+    // before anything new claims inodes that the removals release.
+    bool changed = false;
+    for (auto it = files.lower_bound(prefix); it != files.end() && isWithin(it->first, relDir);) {
+        if (isChild(it->first) && !present.count(it->first)) {
+            it = files.erase(it);
+            changed = true;
+        } else {
+            ++it;
+        }
+    }
+    std::vector<std::string> removedDirs;
+    for (auto it = directories.upper_bound(relDir); it != directories.end() && isWithin(*it, relDir); ++it) {
+        if (isChild(*it) && !present.count(*it))
+            removedDirs.push_back(*it);
+    }
+    for (const auto &subdir : added) {
+        if (directories.count(subdir.relPath))
+            removedDirs.push_back(subdir.relPath);
+    }
+    for (const auto &dir : removedDirs) {
+        removeSubtree(dir);
+        changed = true;
+    }
+    for (const auto &id : claimed)
+        traversal.visited.insert(id.first, id.second);
+
+    for (auto &file : listing.files) {
+        auto it = files.find(file.relPath);
+        if (it != files.end() && it->second.size == file.size && it->second.mtimeNs == file.mtimeNs &&
+            it->second.dev == file.dev && it->second.ino == file.ino)
+            continue;
+        files[file.relPath] = std::move(file);
+        changed = true;
+    }
+    ScannedDirectories found;
+    for (const auto &subdir : added) {
+        // A new directory: pick up everything below it.
+        scanSubtree(subdir, found);
+        changed = true;
+    }
+    for (auto &dir : found) {
+        addDirectory(dir.first);
+        scanned[dir.first] = dir.second;
+    }
+    while (depth-- > 0)
+        traversal.leave();
+
+    // Which of several paths to the same inode is included depends on the
+    // order of the walk. Once the tree has aliases, a rescan that changes
+    // what this directory holds (or leaves out) falls back to a full walk.
+    size_t &wasSkipped = scanned[relDir].skipped;
+    std::sort(released.begin(), released.end());
+    std::sort(claimed.begin(), claimed.end());
+    if (traversal.skipped > 0 && (released != claimed || skipped != wasSkipped))
+        fullRescanPending = true;
+    wasSkipped = skipped;
+    return changed;
+}
+
+void TreeWatcher::removeSubtree(const std::string &relDir) {
+    // Release the inodes held below relDir; nothing includes them any more.
+    std::string prefix = relDir.empty() ? "" : relDir + "/";
+    for (auto it = files.lower_bound(prefix); it != files.end() && isWithin(it->first, relDir);) {
+        traversal.visited.erase(it->second.dev, it->second.ino);
+        it = files.erase(it);
+    }
+    std::vector<std::string> dirs;
+    for (auto it = directories.lower_bound(relDir); it != directories.end() && isWithin(*it, relDir); ++it)
+        dirs.push_back(*it);
+    for (const auto &dir : dirs) {
+        removeDirectory(dir);
+        auto info = scanned.find(dir);
+        if (info == scanned.end())
+            continue;
+        traversal.visited.erase(info->second.id.first, info->second.id.second);
+        scanned.erase(info);
+    }
+}
+
+void TreeWatcher::addDirectory(const std::string &relDir) {
+    directories.insert(relDir);
+#ifdef __linux__
+    int wd = inotify_add_watch(inotifyFd, absolutePath(relDir).c_str(), kWatchMask);
+    if (wd >= 0) {
+        wdToDir[wd] = relDir;
+        dirToWd[relDir] = wd;
+        polledDirs.erase(relDir);
+        return;
+    }
+    if (errno == ENOSPC || errno == ENOMEM) {
+        // Out of watches: keep the directory, but rescan it periodically.
+        polledDirs.insert(relDir);
+        if (!limitReported) {
+            std::cerr << "inotify watch limit reached (fs.inotify.max_user_watches = " << readWatchLimit()
+                      << "); falling back to polling every " << options.pollIntervalMs
+                      << " ms for the remaining directories\n";
+            limitReported = true;
+        }
+    }
+#endif
+}
+
+void TreeWatcher::removeDirectory(const std::string &relDir) {
+    directories.erase(relDir);
+    polledDirs.erase(relDir);
+    auto it = dirToWd.find(relDir);
+    if (it == dirToWd.end())
+        return;
+#ifdef __linux__
+    inotify_rm_watch(inotifyFd, it->second);
+#endif
+    wdToDir.erase(it->second);
+    dirToWd.erase(it);
+}
+
+int runWatchMode(const fs::path &targetDir, const fs::path &outputPath, const WatchOptions &options,
+                 const CombineOptions &combineOptions) {
+    TreeWatcher watcher(targetDir, options);
+    if (!watcher.start())
+        return 1;
+
+    const std::string root = targetDir.string();
+    Manifest current;
+    bool haveCurrent = loadPreviousManifest(outputPath, root, current);
+    auto writeOutput = [&]() {
+        Manifest manifest;
+        manifest.root = root;
+        CombineSummary summary;
+        if (!updateOutput(watcher.fileList(), outputPath, haveCurrent ? &current : nullptr, manifest, summary,
+                          combineOptions))
+            return false;
+        current = std::move(manifest);
+        haveCurrent = true;
+        std::cout << "Updated " << outputPath.string() << " (" << summary.written << " written, "
+                  << summary.reused << " reused)\n";
+        return true;
+    };
+    if (!writeOutput())
+        return 1;
+
+    std::cout << "Watching " << watcher.directoryCount() << " directories";
+    if (watcher.polledDirectoryCount() > 0)
+        std::cout << " (" << watcher.polledDirectoryCount() << " polled)";
+    std::cout << "; press Ctrl+C to stop\n";
+
+#ifdef __linux__
+    std::signal(SIGINT, onStopSignal);
+    std::signal(SIGTERM, onStopSignal);
+    while (!stopRequested) {
+        struct pollfd pfd = {watcher.fd(), POLLIN, 0};
+        int ready = poll(&pfd, 1, watcher.timeoutMs());
+        if (ready < 0 && errno != EINTR) {
+            std::cerr << "poll failed\n";
+            return 1;
+        }
+        if (ready > 0 && (pfd.revents & POLLIN))
+            watcher.readEvents();
+        if (watcher.flush() && !writeOutput())
+            return 1;
+    }
+#endif
+    return 0;
+}
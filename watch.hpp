@@ -0,0 +1,104 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "compressor.hpp"
+#include "gitignore.hpp"
+
+namespace fs = std::filesystem;
+
+// Tuning knobs for --watch.
+struct WatchOptions {
+    int debounceMs = 200;      // Quiet period that ends a burst of changes.
+    int maxDelayMs = 2000;     // Upper bound on how long a burst can postpone an update.
+    int pollIntervalMs = 5000; // Rescan interval for directories without an inotify watch.
+};
+
+/**
+ * An in-memory listing of a tree that is kept in sync with the file system
+ * through inotify. Changes are collected per directory and applied in
+ * batches once a burst of events has settled, so that e.g. a `git checkout`
+ * results in a single update. Directories that cannot be watched because the
+ * inotify limit is exhausted are rescanned periodically instead.
+ */
+class TreeWatcher {
+public:
+    TreeWatcher(const fs::path &root, const WatchOptions &options);
+    ~TreeWatcher();
+
+    // Set up inotify and perform the initial full scan.
+    bool start();
+
+    // The inotify descriptor; poll it for readability.
+    int fd() const { return inotifyFd; }
+
+    // Milliseconds until flush() has work to do, or -1 if nothing is pending.
+    int timeoutMs() const;
+
+    // Drain the inotify queue and record the affected directories.
+    void readEvents();
+
+    // Apply pending changes whose debounce period has expired, or all of
+    // them if force is set. Returns true if the set of files or their
+    // metadata changed.
+    bool flush(bool force = false);
+
+    // The current files, in traversal order.
+    std::vector<FileEntry> fileList() const;
+
+    // The current files at or below relDir, in traversal order.
+    std::vector<FileEntry> filesUnder(const std::string &relDir) const;
+
+    const fs::path &rootPath() const { return root; }
+    size_t directoryCount() const { return directories.size(); }
+    size_t polledDirectoryCount() const { return polledDirs.size(); }
+
+private:
+    // What the walk found for a directory: its inode, which its parent's
+    // listing holds in the traversal state, and how many aliases it left out.
+    struct ScannedDirectory {
+        std::pair<uint64_t, uint64_t> id;
+        size_t skipped = 0;
+    };
+    using ScannedDirectories = std::unordered_map<std::string, ScannedDirectory>;
+
+    bool rescanAll();
+    bool rescanDirectory(const std::string &relDir);
+    void scanSubtree(const DirectoryEntry &dir, ScannedDirectories &found);
+    void removeSubtree(const std::string &relDir);
+    void addDirectory(const std::string &relDir);
+    void removeDirectory(const std::string &relDir);
+    fs::path absolutePath(const std::string &relPath) const;
+
+    fs::path root;
+    WatchOptions options;
+    std::vector<GitIgnoreRule> rules;
+    TraversalState traversal; // Of the last full walk, updated by every rescan.
+    std::map<std::string, FileEntry, PathOrder> files;
+    std::set<std::string, PathOrder> directories;
+    ScannedDirectories scanned;
+    std::unordered_map<int, std::string> wdToDir;
+    std::unordered_map<std::string, int> dirToWd;
+    std::set<std::string, PathOrder> polledDirs;
+
+    std::set<std::string, PathOrder> dirtyDirs;
+    bool fullRescanPending = false;
+    int64_t firstEventMs = 0;
+    int64_t lastEventMs = 0;
+    int64_t nextPollMs = 0;
+    bool limitReported = false;
+    int inotifyFd = -1;
+};
+
+/**
+ * Combine targetDir into outputPath, then keep the output up to date as the
+ * tree changes until the process is interrupted. Returns the exit code.
+ */
+int runWatchMode(const fs::path &targetDir, const fs::path &outputPath, const WatchOptions &options,
+                 const CombineOptions &combineOptions);